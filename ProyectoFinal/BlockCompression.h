@@ -0,0 +1,309 @@
+#pragma once
+
+// CPU block compression for the offline texture stage
+// Gamma-correct mip generation plus BC1 (opaque) and BC3 (alpha) encoders, and the
+// matching decoders used to verify uploads. The encoders fit endpoints along the
+// principal axis of each 4x4 block; quality is close to a "fast" preset of the
+// usual tools, which is plenty for the SketchUp textures in Models/.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Converts between sRGB-encoded bytes and linear floats
+class SrgbTable
+{
+public:
+    SrgbTable()
+    {
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+
+    float ToLinear(unsigned char c) const { return toLinear[c]; }
+
+    static unsigned char FromLinear(float c)
+    {
+        c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+        float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return (unsigned char)(s * 255.0f + 0.5f);
+    }
+
+private:
+    float toLinear[256];
+};
+
+// Halves an RGBA8 image with a 2x2 box filter in linear light (alpha filtered linearly)
+inline std::vector<unsigned char> DownsampleSrgb(const std::vector<unsigned char>& src, int width, int height,
+    int& outWidth, int& outHeight)
+{
+    static const SrgbTable table;
+    outWidth = width > 1 ? width / 2 : 1;
+    outHeight = height > 1 ? height / 2 : 1;
+
+    std::vector<unsigned char> dst((size_t)outWidth * outHeight * 4);
+    for (int y = 0; y < outHeight; y++) {
+        for (int x = 0; x < outWidth; x++) {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int sx = x * 2 + dx < width ? x * 2 + dx : width - 1;
+                    int sy = y * 2 + dy < height ? y * 2 + dy : height - 1;
+                    const unsigned char* p = &src[((size_t)sy * width + sx) * 4];
+                    sum[0] += table.ToLinear(p[0]);
+                    sum[1] += table.ToLinear(p[1]);
+                    sum[2] += table.ToLinear(p[2]);
+                    sum[3] += p[3];
+                }
+            }
+            unsigned char* q = &dst[((size_t)y * outWidth + x) * 4];
+            q[0] = SrgbTable::FromLinear(sum[0] * 0.25f);
+            q[1] = SrgbTable::FromLinear(sum[1] * 0.25f);
+            q[2] = SrgbTable::FromLinear(sum[2] * 0.25f);
+            q[3] = (unsigned char)(sum[3] * 0.25f + 0.5f);
+        }
+    }
+    return dst;
+}
+
+inline uint16_t PackRgb565(const float c[3])
+{
+    int r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    r = r < 0 ? 0 : (r > 31 ? 31 : r);
+    g = g < 0 ? 0 : (g > 63 ? 63 : g);
+    b = b < 0 ? 0 : (b > 31 ? 31 : b);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackRgb565(uint16_t c, int out[3])
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// Encodes the colour half of a block (always four-colour mode)
+inline void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+{
+    // Mean and covariance of the 16 colours
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += block[i * 4 + c] / 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int it = 0; it < 8; it++) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (len < 1e-6f)
+            break;
+        axis[0] = next[0] / len; axis[1] = next[1] / len; axis[2] = next[2] / len;
+    }
+
+    // Extremes along the axis become the endpoints
+    float minT = 1e9f, maxT = -1e9f;
+    for (int i = 0; i < 16; i++) {
+        float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1]
+            + (block[i * 4 + 2] - mean[2]) * axis[2];
+        minT = t < minT ? t : minT;
+        maxT = t > maxT ? t : maxT;
+    }
+    float hi[3], lo[3];
+    for (int c = 0; c < 3; c++) {
+        hi[c] = mean[c] + axis[c] * maxT;
+        lo[c] = mean[c] + axis[c] * minT;
+    }
+
+    uint16_t c0 = PackRgb565(hi), c1 = PackRgb565(lo);
+    if (c0 < c1) {
+        uint16_t t = c0; c0 = c1; c1 = t;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int p0[3], p1[3], palette[4][3];
+        UnpackRgb565(c0, p0);
+        UnpackRgb565(c1, p1);
+        for (int c = 0; c < 3; c++) {
+            palette[0][c] = p0[c];
+            palette[1][c] = p1[c];
+            palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+            palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// Encodes the alpha half of a BC3 block (eight-value mode)
+inline void EncodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        int a = block[i * 4 + 3];
+        a0 = a > a0 ? a : a0;
+        a1 = a < a1 ? a : a1;
+    }
+
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; i++)
+        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++) {
+        int a = block[i * 4 + 3], best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 8; p++) {
+            int error = (a - palette[p]) * (a - palette[p]);
+            if (error < bestError) {
+                bestError = error;
+                best = p;
+            }
+        }
+        bits |= (uint64_t)best << (i * 3);
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(bits >> (i * 8));
+}
+
+inline void DecodeColorBlock(const unsigned char in[8], unsigned char block[64])
+{
+    uint16_t c0, c1;
+    uint32_t indices;
+    std::memcpy(&c0, in, 2);
+    std::memcpy(&c1, in + 2, 2);
+    std::memcpy(&indices, in + 4, 4);
+
+    int p0[3], p1[3], palette[4][3];
+    UnpackRgb565(c0, p0);
+    UnpackRgb565(c1, p1);
+    for (int c = 0; c < 3; c++) {
+        palette[0][c] = p0[c];
+        palette[1][c] = p1[c];
+        palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+        palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+    }
+    for (int i = 0; i < 16; i++) {
+        int p = (indices >> (i * 2)) & 3;
+        block[i * 4] = (unsigned char)palette[p][0];
+        block[i * 4 + 1] = (unsigned char)palette[p][1];
+        block[i * 4 + 2] = (unsigned char)palette[p][2];
+        block[i * 4 + 3] = 255;
+    }
+}
+
+inline void DecodeAlphaBlock(const unsigned char in[8], unsigned char block[64])
+{
+    int a0 = in[0], a1 = in[1], palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+    else {
+        for (int i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+        bits |= (uint64_t)in[2 + i] << (i * 8);
+    for (int i = 0; i < 16; i++)
+        block[i * 4 + 3] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+}
+
+// Compresses an RGBA8 image; bc3 selects BC3 (16 bytes/block) instead of BC1 (8 bytes/block)
+inline std::vector<unsigned char> CompressImage(const std::vector<unsigned char>& rgba, int width, int height, bool bc3)
+{
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t blockBytes = bc3 ? 16 : 8;
+    std::vector<unsigned char> out((size_t)blocksX * blocksY * blockBytes);
+
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            // Edge blocks repeat the last row/column
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+                    int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+                    std::memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+                }
+            }
+
+            unsigned char* dst = &out[((size_t)by * blocksX + bx) * blockBytes];
+            if (bc3) {
+                EncodeAlphaBlock(block, dst);
+                EncodeColorBlock(block, dst + 8);
+            }
+            else {
+                EncodeColorBlock(block, dst);
+            }
+        }
+    }
+    return out;
+}
+
+// Expands BC1/BC3 data back to RGBA8 (used to verify GPU uploads)
+inline std::vector<unsigned char> DecompressImage(const unsigned char* data, int width, int height, bool bc3)
+{
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t blockBytes = bc3 ? 16 : 8;
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            const unsigned char* src = data + ((size_t)by * blocksX + bx) * blockBytes;
+            if (bc3) {
+                DecodeColorBlock(src + 8, block);
+                DecodeAlphaBlock(src, block);
+            }
+            else {
+                DecodeColorBlock(src, block);
+            }
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    std::memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+        }
+    }
+    return rgba;
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+// Bounding volume hierarchies for ray queries
+// Bvh is built over any set of primitive boxes with a binned surface-area heuristic
+// and can be refit in place when the boxes move (children always follow their parent
+// in the node array, so one reverse sweep updates every node). TriangleBvh holds a
+// model's triangles in model space; ScenePicker.h puts one instance per object on top.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "ModelCache.h"
+
+// 32 bytes: a leaf has count > 0 and leftFirst indexes primitives, otherwise leftFirst
+// is the left child and leftFirst + 1 the right one
+struct BvhNode
+{
+    glm::vec3 aabbMin;
+    uint32_t leftFirst;
+    glm::vec3 aabbMax;
+    uint32_t count;
+};
+
+class Bvh
+{
+public:
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> primitives;  // Leaf ranges index into this
+
+    bool Empty() const { return this->nodes.empty(); }
+
+    void Build(const std::vector<glm::vec3>& primMin, const std::vector<glm::vec3>& primMax)
+    {
+        this->nodes.clear();
+        this->primitives.resize(primMin.size());
+        if (primMin.empty())
+            return;
+
+        this->centroids.resize(primMin.size());
+        for (size_t i = 0; i < primMin.size(); i++) {
+            this->primitives[i] = (uint32_t)i;
+            this->centroids[i] = (primMin[i] + primMax[i]) * 0.5f;
+        }
+
+        this->nodes.reserve(primMin.size() * 2);
+        BvhNode root;
+        root.leftFirst = 0;
+        root.count = (uint32_t)primMin.size();
+        this->nodes.push_back(root);
+        this->updateBounds(0, primMin, primMax);
+        this->subdivide(0, 0, primMin, primMax);
+
+        std::vector<glm::vec3>().swap(this->centroids);
+    }
+
+    // Recomputes every box from the primitives' current boxes; the tree shape stays
+    void Refit(const std::vector<glm::vec3>& primMin, const std::vector<glm::vec3>& primMax)
+    {
+        for (size_t i = this->nodes.size(); i-- > 0;) {
+            BvhNode& node = this->nodes[i];
+            if (node.count > 0) {
+                this->updateBounds((uint32_t)i, primMin, primMax);
+                continue;
+            }
+            const BvhNode& left = this->nodes[node.leftFirst];
+            const BvhNode& right = this->nodes[node.leftFirst + 1];
+            node.aabbMin = glm::min(left.aabbMin, right.aabbMin);
+            node.aabbMax = glm::max(left.aabbMax, right.aabbMax);
+        }
+    }
+
+    // Visits leaves nearest first; hit(primitive, tMax) tests one primitive and shrinks
+    // tMax on a closer hit, returning true. Returns true if anything was hit.
+    template <typename HitPrimitive>
+    bool Traverse(const glm::vec3& origin, const glm::vec3& direction, float& tMax, HitPrimitive hit) const
+    {
+        if (this->nodes.empty())
+            return false;
+
+        glm::vec3 invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        uint32_t stack[MAX_DEPTH + 2];
+        float stackEntry[MAX_DEPTH + 2];
+        int size = 0;
+        bool found = false;
+
+        float rootEntry = slab(this->nodes[0], origin, invDirection, tMax);
+        if (rootEntry == FLT_MAX)
+            return false;
+        stack[size] = 0;
+        stackEntry[size++] = rootEntry;
+
+        while (size > 0) {
+            size--;
+            if (stackEntry[size] > tMax)
+                continue;  // A closer hit was found after this node was pushed
+
+            const BvhNode& node = this->nodes[stack[size]];
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; i++)
+                    found = hit(this->primitives[node.leftFirst + i], tMax) || found;
+                continue;
+            }
+
+            // Farther child is pushed first so the nearer one is popped next
+            uint32_t nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+            float tNear = slab(this->nodes[nearChild], origin, invDirection, tMax);
+            float tFar = slab(this->nodes[farChild], origin, invDirection, tMax);
+            if (tFar < tNear) {
+                std::swap(nearChild, farChild);
+                std::swap(tNear, tFar);
+            }
+            if (tFar != FLT_MAX) {
+                stack[size] = farChild;
+                stackEntry[size++] = tFar;
+            }
+            if (tNear != FLT_MAX) {
+                stack[size] = nearChild;
+                stackEntry[size++] = tNear;
+            }
+        }
+        return found;
+    }
+
+private:
+    static const int BINS = 16;
+    static const int MAX_DEPTH = 60;
+
+    std::vector<glm::vec3> centroids;  // Build only
+
+    // Entry distance along the ray, FLT_MAX when the box is missed or beyond tMax
+    static float slab(const BvhNode& node, const glm::vec3& origin, const glm::vec3& invDirection, float tMax)
+    {
+        glm::vec3 t1 = (node.aabbMin - origin) * invDirection;
+        glm::vec3 t2 = (node.aabbMax - origin) * invDirection;
+        glm::vec3 tLow = glm::min(t1, t2), tHigh = glm::max(t1, t2);
+        float tEnter = std::max(std::max(tLow.x, tLow.y), std::max(tLow.z, 0.0f));
+        float tExit = std::min(std::min(tHigh.x, tHigh.y), std::min(tHigh.z, tMax));
+        return tEnter <= tExit ? tEnter : FLT_MAX;
+    }
+
+    static float area(const glm::vec3& extent)
+    {
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    void updateBounds(uint32_t index, const std::vector<glm::vec3>& primMin, const std::vector<glm::vec3>& primMax)
+    {
+        BvhNode& node = this->nodes[index];
+        node.aabbMin = glm::vec3(FLT_MAX);
+        node.aabbMax = glm::vec3(-FLT_MAX);
+        for (uint32_t i = 0; i < node.count; i++) {
+            uint32_t primitive = this->primitives[node.leftFirst + i];
+            node.aabbMin = glm::min(node.aabbMin, primMin[primitive]);
+            node.aabbMax = glm::max(node.aabbMax, primMax[primitive]);
+        }
+    }
+
+    void subdivide(uint32_t index, int depth, const std::vector<glm::vec3>& primMin, const std::vector<glm::vec3>& primMax)
+    {
+        BvhNode node = this->nodes[index];
+        if (node.count <= 2 || depth >= MAX_DEPTH)
+            return;
+
+        // Binned SAH over the centroid bounds of each axis
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = node.count * area(node.aabbMax - node.aabbMin);  // Cost of staying a leaf
+        float bestMin = 0.0f, bestScale = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float centroidMin = FLT_MAX, centroidMax = -FLT_MAX;
+            for (uint32_t i = 0; i < node.count; i++) {
+                float c = this->centroids[this->primitives[node.leftFirst + i]][axis];
+                centroidMin = std::min(centroidMin, c);
+                centroidMax = std::max(centroidMax, c);
+            }
+            if (centroidMin == centroidMax)
+                continue;
+
+            glm::vec3 binMin[BINS], binMax[BINS];
+            uint32_t binCount[BINS] = {};
+            for (int b = 0; b < BINS; b++) {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+            }
+            float scale = BINS / (centroidMax - centroidMin);
+            for (uint32_t i = 0; i < node.count; i++) {
+                uint32_t primitive = this->primitives[node.leftFirst + i];
+                int b = std::min(BINS - 1, (int)((this->centroids[primitive][axis] - centroidMin) * scale));
+                binCount[b]++;
+                binMin[b] = glm::min(binMin[b], primMin[primitive]);
+                binMax[b] = glm::max(binMax[b], primMax[primitive]);
+            }
+
+            // Sweep from both ends; split s puts bins [0, s] on the left
+            float leftArea[BINS - 1], rightArea[BINS - 1];
+            uint32_t leftCount[BINS - 1], rightCount[BINS - 1];
+            glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX), rMin(FLT_MAX), rMax(-FLT_MAX);
+            uint32_t lCount = 0, rCount = 0;
+            for (int s = 0; s < BINS - 1; s++) {
+                lCount += binCount[s];
+                lMin = glm::min(lMin, binMin[s]);
+                lMax = glm::max(lMax, binMax[s]);
+                leftCount[s] = lCount;
+                leftArea[s] = lCount ? area(lMax - lMin) : 0.0f;
+
+                int r = BINS - 1 - s;
+                rCount += binCount[r];
+                rMin = glm::min(rMin, binMin[r]);
+                rMax = glm::max(rMax, binMax[r]);
+                rightCount[r - 1] = rCount;
+                rightArea[r - 1] = rCount ? area(rMax - rMin) : 0.0f;
+            }
+
+            for (int s = 0; s < BINS - 1; s++) {
+                if (leftCount[s] == 0 || rightCount[s] == 0)
+                    continue;
+                float cost = leftCount[s] * leftArea[s] + rightCount[s] * rightArea[s];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = s;
+                    bestMin = centroidMin;
+                    bestScale = scale;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+            return;
+
+        // Partition primitives in place around the chosen plane
+        uint32_t i = node.leftFirst, j = node.leftFirst + node.count;
+        while (i < j) {
+            int b = std::min(BINS - 1, (int)((this->centroids[this->primitives[i]][bestAxis] - bestMin) * bestScale));
+            if (b <= bestSplit)
+                i++;
+            else
+                std::swap(this->primitives[i], this->primitives[--j]);
+        }
+        uint32_t leftCount = i - node.leftFirst;
+        if (leftCount == 0 || leftCount == node.count)
+            return;
+
+        uint32_t left = (uint32_t)this->nodes.size();
+        BvhNode child;
+        child.leftFirst = node.leftFirst;
+        child.count = leftCount;
+        this->nodes.push_back(child);
+        child.leftFirst = i;
+        child.count = node.count - leftCount;
+        this->nodes.push_back(child);
+
+        this->nodes[index].leftFirst = left;
+        this->nodes[index].count = 0;
+        this->updateBounds(left, primMin, primMax);
+        this->updateBounds(left + 1, primMin, primMax);
+        this->subdivide(left, depth + 1, primMin, primMax);
+        this->subdivide(left + 1, depth + 1, primMin, primMax);
+    }
+};
+
+// A model's triangles in model space
+class TriangleBvh
+{
+public:
+    glm::vec3 aabbMin, aabbMax;
+
+    TriangleBvh()
+        : aabbMin(0.0f), aabbMax(0.0f)
+    {
+    }
+
+    bool Empty() const { return this->bvh.Empty(); }
+    size_t TriangleCount() const { return this->triangles.size(); }
+
+    // Model-space corners of triangle i, in build order
+    void Corners(size_t i, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const
+    {
+        const Triangle& triangle = this->triangles[i];
+        v0 = triangle.v0;
+        v1 = triangle.v0 + triangle.edge1;
+        v2 = triangle.v0 + triangle.edge2;
+    }
+
+    // CPU phase: gathers every mesh's triangles from the loaded cache
+    void Build(const ModelData& data)
+    {
+        this->triangles.clear();
+        this->triangleMesh.clear();
+        std::vector<glm::vec3> primMin, primMax;
+
+        for (uint32_t m = 0; m < data.header->meshCount; m++) {
+            const CacheMesh& mesh = data.meshes[m];
+            for (uint32_t k = 0; k + 2 < mesh.indexCount; k += 3) {
+                const uint32_t* index = data.indices + mesh.firstIndex + k;
+                glm::vec3 v0 = data.vertices[mesh.baseVertex + index[0]].Position;
+                glm::vec3 v1 = data.vertices[mesh.baseVertex + index[1]].Position;
+                glm::vec3 v2 = data.vertices[mesh.baseVertex + index[2]].Position;
+
+                Triangle triangle;
+                triangle.v0 = v0;
+                triangle.edge1 = v1 - v0;
+                triangle.edge2 = v2 - v0;
+                this->triangles.push_back(triangle);
+                this->triangleMesh.push_back(m);
+                primMin.push_back(glm::min(v0, glm::min(v1, v2)));
+                primMax.push_back(glm::max(v0, glm::max(v1, v2)));
+            }
+        }
+
+        this->bvh.Build(primMin, primMax);
+        if (!this->bvh.Empty()) {
+            this->aabbMin = this->bvh.nodes[0].aabbMin;
+            this->aabbMax = this->bvh.nodes[0].aabbMax;
+        }
+    }
+
+    // Closest hit with t < tMax (ray in model space, direction need not be unit length)
+    bool Intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, uint32_t& mesh) const
+    {
+        return this->bvh.Traverse(origin, direction, tMax, [&](uint32_t primitive, float& closest) {
+            const Triangle& triangle = this->triangles[primitive];
+
+            // Moller-Trumbore, both faces
+            glm::vec3 p = glm::cross(direction, triangle.edge2);
+            float det = glm::dot(triangle.edge1, p);
+            if (std::fabs(det) < 1e-12f)
+                return false;
+            float invDet = 1.0f / det;
+            glm::vec3 s = origin - triangle.v0;
+            float u = glm::dot(s, p) * invDet;
+            if (u < 0.0f || u > 1.0f)
+                return false;
+            glm::vec3 q = glm::cross(s, triangle.edge1);
+            float v = glm::dot(direction, q) * invDet;
+            if (v < 0.0f || u + v > 1.0f)
+                return false;
+            float t = glm::dot(triangle.edge2, q) * invDet;
+            if (t <= 0.0f || t >= closest)
+                return false;
+
+            closest = t;
+            mesh = this->triangleMesh[primitive];
+            return true;
+        });
+    }
+
+private:
+    struct Triangle
+    {
+        glm::vec3 v0, edge1, edge2;
+    };
+
+    Bvh bvh;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> triangleMesh;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+// Model backed by the binary mesh cache (see ModelCache.h)
+// The whole model lives in one VAO/VBO/EBO; each mesh is a base-vertex draw range.
+// Loading is split so the CPU phase (Prepare) can run on a worker thread while the
+// GL phases (UploadGeometry, RequestTextures) stay on the context thread. Textures
+// are TextureHandles owned by the shared TextureStreamer. The GPU copy uses the packed
+// layout of VertexFormat.h; draws go through Format() for the index type and the
+// shader's decode uniforms.
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+#include "ShaderUniforms.h"
+#include "Bvh.h"
+#include "ModelCache.h"
+#include "TextureStreamer.h"
+#include "VertexFormat.h"
+
+// Per-material uniforms RenderQueue writes, resolved once per program
+struct MaterialUniforms
+{
+    Uniform<float> shininess;
+
+    explicit MaterialUniforms(const ShaderUniforms& uniforms)
+        : shininess(uniforms.Get<float>("material.shininess"))
+    {
+    }
+};
+
+class CachedModel
+{
+public:
+    std::vector<CacheMesh> meshes;
+    std::vector<CacheMaterial> materials;
+    std::vector<std::string> texturePaths;  // Distinct texture files, indexed by slot
+    glm::vec3 aabbMin, aabbMax;
+    TriangleBvh bvh;  // Model space, for ray picking
+
+    CachedModel()
+        : aabbMin(0.0f), aabbMax(0.0f), VAO(0), VBO(0), EBO(0)
+    {
+    }
+
+    ~CachedModel()
+    {
+        glDeleteVertexArrays(1, &this->VAO);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+    }
+
+    CachedModel(const CachedModel&) = delete;
+    CachedModel& operator=(const CachedModel&) = delete;
+
+    // CPU phase: read/parse the geometry, build the picking BVH and resolve material
+    // texture slots (any thread)
+    bool Prepare(const char* path)
+    {
+        this->data.reset(new ModelData());
+        if (!this->data->Load(path)) {
+            this->data.reset();
+            return false;
+        }
+
+        this->directory = this->data->directory;
+        this->meshes.assign(this->data->meshes, this->data->meshes + this->data->header->meshCount);
+        this->materials.assign(this->data->materials, this->data->materials + this->data->header->materialCount);
+        this->aabbMin = this->data->header->aabbMin;
+        this->aabbMax = this->data->header->aabbMax;
+        this->bvh.Build(*this->data);
+
+        this->diffuseSlots.assign(this->materials.size(), -1);
+        this->specularSlots.assign(this->materials.size(), -1);
+        for (size_t i = 0; i < this->materials.size(); i++) {
+            this->diffuseSlots[i] = this->textureSlot(this->materials[i].diffusePath);
+            this->specularSlots[i] = this->textureSlot(this->materials[i].specularPath);
+        }
+        return true;
+    }
+
+    // GL phase: create the buffers, then drop the CPU copy
+    void UploadGeometry()
+    {
+        if (!this->data)
+            return;
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+
+        glBindVertexArray(this->VAO);
+
+        // Straight from the mapped cache, which holds the packed copy
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        this->format.Upload(*this->data);
+
+        glBindVertexArray(0);
+
+        // The GPU owns the geometry now; unmap the cache
+        this->data.reset();
+    }
+
+    // GL phase: register every texture with the shared streamer. Identical files across
+    // models resolve to one texture; materials show their Kd colour until the image lands.
+    void RequestTextures(TextureStreamer& textureStreamer)
+    {
+        std::vector<TextureHandle> slotHandles(this->texturePaths.size(), NO_TEXTURE);
+        for (size_t slot = 0; slot < this->texturePaths.size(); slot++) {
+            glm::vec3 placeholder(1.0f);
+            for (size_t i = 0; i < this->materials.size(); i++) {
+                if (this->diffuseSlots[i] == (int)slot) {
+                    placeholder = this->materials[i].diffuseColor;
+                    break;
+                }
+            }
+            slotHandles[slot] = textureStreamer.Request(this->directory + '/' + this->texturePaths[slot], placeholder);
+        }
+
+        this->diffuseTextures.assign(this->materials.size(), NO_TEXTURE);
+        this->specularTextures.assign(this->materials.size(), NO_TEXTURE);
+        for (size_t i = 0; i < this->materials.size(); i++) {
+            this->diffuseTextures[i] = this->diffuseSlots[i] >= 0
+                ? slotHandles[this->diffuseSlots[i]]
+                : textureStreamer.Solid(this->materials[i].diffuseColor);
+            if (this->specularSlots[i] >= 0)
+                this->specularTextures[i] = slotHandles[this->specularSlots[i]];
+        }
+    }
+
+    GLuint VertexArray() const { return this->VAO; }
+    const VertexFormat& Format() const { return this->format; }
+
+    // CPU geometry between Prepare and UploadGeometry (null afterwards)
+    const ModelData* CpuData() const { return this->data.get(); }
+
+    // For models whose geometry went elsewhere (see StaticBatch); keeps meshes and materials
+    void ReleaseCpuData() { this->data.reset(); }
+
+    // Valid after RequestTextures
+    TextureHandle DiffuseTexture(GLuint material) const { return material < this->diffuseTextures.size() ? this->diffuseTextures[material] : NO_TEXTURE; }
+    TextureHandle SpecularTexture(GLuint material) const { return material < this->specularTextures.size() ? this->specularTextures[material] : NO_TEXTURE; }
+    float Shininess(GLuint material) const { return material < this->materials.size() ? this->materials[material].shininess : 16.0f; }
+
+    // Material index of a mesh, clamped for models without materials
+    GLuint MeshMaterial(size_t mesh) const
+    {
+        GLuint material = this->meshes[mesh].material;
+        return material < this->materials.size() ? material : 0;
+    }
+
+private:
+    GLuint VAO, VBO, EBO;
+    VertexFormat format;
+    std::string directory;
+    std::unique_ptr<ModelData> data;       // Only alive between Prepare and UploadGeometry
+    std::vector<int> diffuseSlots;         // Per material, -1 when the material has no map
+    std::vector<int> specularSlots;
+    std::vector<TextureHandle> diffuseTextures;  // Per material
+    std::vector<TextureHandle> specularTextures; // Per material, NO_TEXTURE when the material has no map
+
+    // Each distinct path gets one slot per model
+    int textureSlot(const char* path)
+    {
+        if (path[0] == '\0')
+            return -1;
+
+        for (size_t i = 0; i < this->texturePaths.size(); i++) {
+            if (this->texturePaths[i] == path)
+                return (int)i;
+        }
+        this->texturePaths.push_back(path);
+        return (int)this->texturePaths.size() - 1;
+    }
+};
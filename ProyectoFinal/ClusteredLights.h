@@ -0,0 +1,375 @@
+#pragma once
+
+// Clustered forward lighting
+// The view frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z depth
+// slices, exponential in view depth so near clusters stay small. Each frame the point
+// lights are binned on the CPU: a light first gets a conservative tile/slice range from
+// its sphere, then the clusters in that range are tested against the sphere four at a
+// time (SSE). Slices are split across the ThreadPool, so workers never write the same
+// cluster. lighting.frag finds its cluster from gl_FragCoord and view depth and loops
+// over that cluster's lights only.
+// GPU data lives in texture buffers (GL 3.1) on units LIGHT_TEXTURE_UNIT onwards:
+//   lights    RGBA32F, one PointLight (4 texels) per light
+//   clusters  RG32UI, first index and light count per cluster
+//   indices   R16UI, light indices, cluster after cluster
+// Lights have a radius: attenuation is windowed to reach exactly zero there, which is
+// what lets a light stay out of every cluster beyond it.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "ShaderUniforms.h"
+#include "ThreadPool.h"
+
+#if defined(__AVX__) || defined(FRUSTUM_SSE)
+#define CLUSTER_SSE
+#endif
+
+// Mirrors lighting.frag's texel layout
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;     // Lights nothing beyond this distance
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+static_assert(sizeof(PointLight) == 64, "PointLight must be 4 RGBA32F texels");
+
+// Sampler and grid uniforms of lighting.frag, resolved once per program
+struct ClusterUniforms
+{
+    Uniform<int> lights;
+    Uniform<int> clusters;
+    Uniform<int> indices;
+    Uniform<glm::vec4> grid;
+
+    explicit ClusterUniforms(const ShaderUniforms& uniforms)
+        : lights(uniforms.Get<int>("pointLightData")),
+        clusters(uniforms.Get<int>("clusterLights")),
+        indices(uniforms.Get<int>("lightIndices")),
+        grid(uniforms.Get<glm::vec4>("clusterGrid"))
+    {
+    }
+};
+
+class ClusteredLights
+{
+public:
+    // Must match the defines in lighting.frag
+    static const int CLUSTER_X = 16;
+    static const int CLUSTER_Y = 9;
+    static const int CLUSTER_Z = 24;
+    static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    static const int MAX_LIGHTS_PER_CLUSTER = 256;
+    static const GLuint LIGHT_TEXTURE_UNIT = 2;  // Units 0 and 1 hold the material maps
+
+    explicit ClusteredLights(ThreadPool* pool = nullptr)
+        : pool(pool), lightsDirty(true), projection(0.0f), width(0), height(0), sliceScale(0.0f), sliceBias(0.0f),
+        nearPlane(0.0f), farPlane(0.0f), maxPerCluster(0)
+    {
+        glGenBuffers(3, this->buffers);
+        glGenTextures(3, this->textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        this->counts.assign(CLUSTER_COUNT, 0);
+        this->scratch.resize((size_t)CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        this->table.resize((size_t)CLUSTER_COUNT * 2);
+    }
+
+    ~ClusteredLights()
+    {
+        glDeleteTextures(3, this->textures);
+        glDeleteBuffers(3, this->buffers);
+    }
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // Returns the light's index for Edit
+    size_t Add(const PointLight& light)
+    {
+        this->lights.push_back(light);
+        this->lightsDirty = true;
+        return this->lights.size() - 1;
+    }
+
+    PointLight& Edit(size_t i)
+    {
+        this->lightsDirty = true;
+        return this->lights[i];
+    }
+
+    size_t Count() const { return this->lights.size(); }
+
+    // Bins every light for this camera and uploads the tables
+    void Update(const glm::mat4& view, const glm::mat4& projection, int width, int height)
+    {
+        if (projection != this->projection || width != this->width || height != this->height)
+            this->buildClusters(projection, width, height);
+
+        this->prepareLights(view);
+        std::fill(this->counts.begin(), this->counts.end(), 0u);
+
+        // One task per group of slices; each owns its clusters outright
+        const int SLICES_PER_TASK = 2;
+        if (this->pool && this->pool->Size() > 1 && !this->spheres.empty()) {
+            for (int z = 0; z < CLUSTER_Z; z += SLICES_PER_TASK) {
+                int end = std::min(z + SLICES_PER_TASK, (int)CLUSTER_Z);
+                this->pool->Submit([this, z, end]() { this->binSlices(z, end); });
+            }
+            this->pool->Wait();
+        }
+        else {
+            this->binSlices(0, CLUSTER_Z);
+        }
+
+        this->indices.clear();
+        this->maxPerCluster = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++) {
+            uint32_t count = this->counts[c];
+            this->table[c * 2] = (uint32_t)this->indices.size();
+            this->table[c * 2 + 1] = count;
+            this->indices.insert(this->indices.end(), &this->scratch[(size_t)c * MAX_LIGHTS_PER_CLUSTER],
+                &this->scratch[(size_t)c * MAX_LIGHTS_PER_CLUSTER] + count);
+            this->maxPerCluster = std::max(this->maxPerCluster, count);
+        }
+
+        if (this->lightsDirty) {
+            this->upload(0, this->lights.data(), this->lights.size() * sizeof(PointLight));
+            this->lightsDirty = false;
+        }
+        this->upload(1, this->table.data(), this->table.size() * sizeof(uint32_t));
+        this->upload(2, this->indices.data(), this->indices.size() * sizeof(uint16_t));
+    }
+
+    // Binds the tables to LIGHT_TEXTURE_UNIT.. and sets the program's grid constants;
+    // the program must be in use
+    void Bind(const ClusterUniforms& uniforms) const
+    {
+        for (GLuint i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + LIGHT_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        ShaderUniforms::Set(uniforms.lights, (int)LIGHT_TEXTURE_UNIT);
+        ShaderUniforms::Set(uniforms.clusters, (int)LIGHT_TEXTURE_UNIT + 1);
+        ShaderUniforms::Set(uniforms.indices, (int)LIGHT_TEXTURE_UNIT + 2);
+        ShaderUniforms::Set(uniforms.grid, glm::vec4((float)CLUSTER_X / std::max(this->width, 1),
+            (float)CLUSTER_Y / std::max(this->height, 1), this->sliceScale, this->sliceBias));
+    }
+
+    // Last Update(): light references over all clusters, and the busiest cluster
+    size_t IndexCount() const { return this->indices.size(); }
+    unsigned int MaxPerCluster() const { return this->maxPerCluster; }
+
+private:
+    // A light in view space, reduced to the cluster range it can touch
+    struct Sphere
+    {
+        glm::vec3 center;
+        float radius;
+        int x0, x1, y0, y1, z0, z1;  // Inclusive
+        uint16_t light;
+    };
+
+    ThreadPool* pool;
+    GLuint buffers[3];
+    GLuint textures[3];
+    std::vector<PointLight> lights;
+    bool lightsDirty;
+
+    // View-space cluster boxes, structure of arrays in cluster order (x fastest)
+    glm::mat4 projection;
+    int width, height;
+    float sliceScale, sliceBias;  // slice = log(depth) * scale + bias
+    float nearPlane, farPlane;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+    std::vector<Sphere> spheres;
+    std::vector<uint32_t> counts;      // Per cluster
+    std::vector<uint16_t> scratch;     // MAX_LIGHTS_PER_CLUSTER slots per cluster
+    std::vector<uint32_t> table;
+    std::vector<uint16_t> indices;
+    unsigned int maxPerCluster;
+
+    static int clusterIndex(int x, int y, int z) { return (z * CLUSTER_Y + y) * CLUSTER_X + x; }
+
+    void buildClusters(const glm::mat4& projection, int width, int height)
+    {
+        this->projection = projection;
+        this->width = width;
+        this->height = height;
+
+        // Depth range from a standard perspective matrix
+        this->nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        this->farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+        this->sliceScale = CLUSTER_Z / std::log(this->farPlane / this->nearPlane);
+        this->sliceBias = -std::log(this->nearPlane) * this->sliceScale;
+
+        this->minX.resize(CLUSTER_COUNT);
+        this->minY.resize(CLUSTER_COUNT);
+        this->minZ.resize(CLUSTER_COUNT);
+        this->maxX.resize(CLUSTER_COUNT);
+        this->maxY.resize(CLUSTER_COUNT);
+        this->maxZ.resize(CLUSTER_COUNT);
+        for (int z = 0; z < CLUSTER_Z; z++) {
+            float depth0 = this->sliceDepth(z), depth1 = this->sliceDepth(z + 1);
+            for (int y = 0; y < CLUSTER_Y; y++) {
+                for (int x = 0; x < CLUSTER_X; x++) {
+                    // The tile's corner rays, cut at both slice depths
+                    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+                    for (int corner = 0; corner < 8; corner++) {
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTER_X;
+                        float ndcY = -1.0f + 2.0f * (y + ((corner >> 1) & 1)) / CLUSTER_Y;
+                        float depth = corner & 4 ? depth1 : depth0;
+                        glm::vec3 p((ndcX + projection[2][0]) * depth / projection[0][0],
+                            (ndcY + projection[2][1]) * depth / projection[1][1], -depth);
+                        low = glm::min(low, p);
+                        high = glm::max(high, p);
+                    }
+                    int c = clusterIndex(x, y, z);
+                    this->minX[c] = low.x;
+                    this->minY[c] = low.y;
+                    this->minZ[c] = low.z;
+                    this->maxX[c] = high.x;
+                    this->maxY[c] = high.y;
+                    this->maxZ[c] = high.z;
+                }
+            }
+        }
+    }
+
+    float sliceDepth(int z) const
+    {
+        return this->nearPlane * std::pow(this->farPlane / this->nearPlane, (float)z / CLUSTER_Z);
+    }
+
+    int slice(float depth) const
+    {
+        return glm::clamp((int)std::floor(std::log(depth) * this->sliceScale + this->sliceBias), 0, CLUSTER_Z - 1);
+    }
+
+    // View-space spheres and their tile/slice ranges; lights out of view are dropped
+    void prepareLights(const glm::mat4& view)
+    {
+        const glm::mat4& P = this->projection;
+        this->spheres.clear();
+        for (size_t i = 0; i < this->lights.size() && i <= 0xFFFF; i++) {
+            Sphere s;
+            s.center = glm::vec3(view * glm::vec4(this->lights[i].position, 1.0f));
+            s.radius = this->lights[i].radius;
+            s.light = (uint16_t)i;
+
+            float depth = -s.center.z;
+            float closest = depth - s.radius, farthest = depth + s.radius;
+            if (s.radius <= 0.0f || farthest < this->nearPlane || closest > this->farPlane)
+                continue;
+            s.z0 = this->slice(std::max(closest, this->nearPlane));
+            s.z1 = this->slice(std::min(farthest, this->farPlane));
+
+            // The sphere's view box projected at its nearest and farthest depth; a
+            // sphere reaching behind the near plane may cover any tile
+            s.x0 = s.y0 = 0;
+            s.x1 = CLUSTER_X - 1;
+            s.y1 = CLUSTER_Y - 1;
+            if (closest > this->nearPlane) {
+                float x0 = std::min((s.center.x - s.radius) / closest, (s.center.x - s.radius) / farthest) * P[0][0] - P[2][0];
+                float x1 = std::max((s.center.x + s.radius) / closest, (s.center.x + s.radius) / farthest) * P[0][0] - P[2][0];
+                float y0 = std::min((s.center.y - s.radius) / closest, (s.center.y - s.radius) / farthest) * P[1][1] - P[2][1];
+                float y1 = std::max((s.center.y + s.radius) / closest, (s.center.y + s.radius) / farthest) * P[1][1] - P[2][1];
+                if (x1 < -1.0f || x0 > 1.0f || y1 < -1.0f || y0 > 1.0f)
+                    continue;
+                s.x0 = glm::clamp((int)std::floor((x0 + 1.0f) * 0.5f * CLUSTER_X), 0, CLUSTER_X - 1);
+                s.x1 = glm::clamp((int)std::floor((x1 + 1.0f) * 0.5f * CLUSTER_X), 0, CLUSTER_X - 1);
+                s.y0 = glm::clamp((int)std::floor((y0 + 1.0f) * 0.5f * CLUSTER_Y), 0, CLUSTER_Y - 1);
+                s.y1 = glm::clamp((int)std::floor((y1 + 1.0f) * 0.5f * CLUSTER_Y), 0, CLUSTER_Y - 1);
+            }
+            this->spheres.push_back(s);
+        }
+    }
+
+    // Sphere against cluster boxes for slices [z0, z1)
+    void binSlices(int z0, int z1)
+    {
+        for (size_t i = 0; i < this->spheres.size(); i++) {
+            const Sphere& s = this->spheres[i];
+            int first = std::max(s.z0, z0), last = std::min(s.z1, z1 - 1);
+            for (int z = first; z <= last; z++) {
+                for (int y = s.y0; y <= s.y1; y++) {
+                    int row = clusterIndex(0, y, z);
+                    int x = s.x0;
+#if defined(CLUSTER_SSE)
+                    __m128 cx = _mm_set1_ps(s.center.x), cy = _mm_set1_ps(s.center.y), cz = _mm_set1_ps(s.center.z);
+                    __m128 r2 = _mm_set1_ps(s.radius * s.radius), zero = _mm_setzero_ps();
+                    for (; x + 3 <= s.x1; x += 4) {
+                        int c = row + x;
+                        // Per axis: how far the centre lies outside the box (0 inside)
+                        __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minX[c]), cx), zero),
+                            _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&this->maxX[c])), zero));
+                        __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minY[c]), cy), zero),
+                            _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&this->maxY[c])), zero));
+                        __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&this->minZ[c]), cz), zero),
+                            _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&this->maxZ[c])), zero));
+                        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                        int hits = _mm_movemask_ps(_mm_cmple_ps(distance2, r2));
+                        for (int k = 0; k < 4; k++) {
+                            if (hits & (1 << k))
+                                this->append(c + k, s.light);
+                        }
+                    }
+#endif
+                    for (; x <= s.x1; x++) {
+                        int c = row + x;
+                        float dx = std::max(this->minX[c] - s.center.x, 0.0f) + std::max(s.center.x - this->maxX[c], 0.0f);
+                        float dy = std::max(this->minY[c] - s.center.y, 0.0f) + std::max(s.center.y - this->maxY[c], 0.0f);
+                        float dz = std::max(this->minZ[c] - s.center.z, 0.0f) + std::max(s.center.z - this->maxZ[c], 0.0f);
+                        if (dx * dx + dy * dy + dz * dz <= s.radius * s.radius)
+                            this->append(c, s.light);
+                    }
+                }
+            }
+        }
+    }
+
+    // A full cluster drops further lights; MaxPerCluster() reaching the limit shows it
+    void append(int cluster, uint16_t light)
+    {
+        uint32_t& count = this->counts[cluster];
+        if (count < MAX_LIGHTS_PER_CLUSTER)
+            this->scratch[(size_t)cluster * MAX_LIGHTS_PER_CLUSTER + count++] = light;
+    }
+
+    // Orphans the buffer so the GPU can keep reading last frame's copy
+    void upload(int i, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
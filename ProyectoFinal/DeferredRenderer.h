@@ -0,0 +1,388 @@
+#pragma once
+
+// Deferred shading pipeline, switchable against the forward lighting.frag path
+// The opaque pass is drawn once into a compact G-buffer (gbuffer.frag):
+//   RGBA8   albedo rgb, specular map intensity
+//   RG16F   world-space normal, octahedral
+//   R16F    shininess
+//   D24S8   depth; positions are rebuilt from it
+// Shade() then lights it into its own target with deferredLight.frag, one light per
+// pass added up with blending: the sun as a full-screen triangle, every point light as
+// an instance of a sphere that encloses its radius (positions come straight from the
+// ClusteredLights table) and the spot light as a cone. Volumes draw their back faces
+// with the depth test reversed, so only pixels whose surface lies in front of the back
+// face are shaded; that holds with the camera inside a volume, and depth clamping
+// keeps volumes past the far plane. The light target tests against a copy of the
+// G-buffer depth, since sampling a texture attached to the bound framebuffer is a
+// feedback loop. Transparent meshes (glass, the second door) are then drawn forward
+// over the lit image with that depth, and Present() copies it to the window.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ShaderUniforms.h"
+#include "UniformBlocks.h"
+#include "ClusteredLights.h"
+
+class DeferredRenderer
+{
+public:
+    // G-buffer textures take the four units after the cluster tables
+    static const GLuint GBUFFER_TEXTURE_UNIT = ClusteredLights::LIGHT_TEXTURE_UNIT + 3;
+
+    // lightUniforms are deferredLight.vs/.frag's
+    DeferredRenderer(const ShaderUniforms& lightUniforms, int width, int height)
+        : program(lightUniforms.Program()), width(width), height(height), clusterUniforms(lightUniforms),
+        fullscreen(lightUniforms.Get<int>("fullscreen")),
+        lightType(lightUniforms.Get<int>("lightType")),
+        volumeTransform(lightUniforms.Get<glm::mat4>("volumeTransform")),
+        inverseViewProjection(lightUniforms.Get<glm::mat4>("inverseViewProjection")),
+        inverseScreenSize(lightUniforms.Get<glm::vec2>("inverseScreenSize")), valid(true)
+    {
+        // G-buffer
+        glGenFramebuffers(1, &this->gBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer);
+        this->albedoSpecular = this->attachTexture(GL_COLOR_ATTACHMENT0, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        this->normal = this->attachTexture(GL_COLOR_ATTACHMENT1, GL_RG16F, GL_RG, GL_FLOAT);
+        this->shininess = this->attachTexture(GL_COLOR_ATTACHMENT2, GL_R16F, GL_RED, GL_FLOAT);
+        this->depth = this->attachTexture(GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, drawBuffers);
+        this->checkFramebuffer("G-buffer");
+
+        // Light target: lit colour and the depth copy
+        glGenFramebuffers(1, &this->lightTarget);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->lightTarget);
+        glGenRenderbuffers(2, this->lightBuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->lightBuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->lightBuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->lightBuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->lightBuffers[1]);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        this->checkFramebuffer("light target");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // Samplers and the screen never change
+        glUseProgram(this->program);
+        ShaderUniforms::Set(lightUniforms.Get<int>("albedoSpecularMap"), (int)GBUFFER_TEXTURE_UNIT);
+        ShaderUniforms::Set(lightUniforms.Get<int>("normalMap"), (int)GBUFFER_TEXTURE_UNIT + 1);
+        ShaderUniforms::Set(lightUniforms.Get<int>("shininessMap"), (int)GBUFFER_TEXTURE_UNIT + 2);
+        ShaderUniforms::Set(lightUniforms.Get<int>("depthMap"), (int)GBUFFER_TEXTURE_UNIT + 3);
+        ShaderUniforms::Set(this->inverseScreenSize, glm::vec2(1.0f / width, 1.0f / height));
+        glUseProgram(0);
+
+        this->buildSphere();
+        this->buildCone();
+        glGenVertexArrays(1, &this->emptyVAO);  // Full-screen triangle, from gl_VertexID
+
+        std::cout << "G-buffer: " << width << "x" << height << ", " << width * height * BYTES_PER_PIXEL / (1024 * 1024)
+            << " MB (" << BYTES_PER_PIXEL << " bytes per pixel)" << std::endl;
+    }
+
+    ~DeferredRenderer()
+    {
+        GLuint textures[] = { this->albedoSpecular, this->normal, this->shininess, this->depth };
+        glDeleteTextures(4, textures);
+        glDeleteRenderbuffers(2, this->lightBuffers);
+        glDeleteFramebuffers(1, &this->gBuffer);
+        glDeleteFramebuffers(1, &this->lightTarget);
+        for (int i = 0; i < 2; i++) {
+            glDeleteVertexArrays(1, &this->volumes[i].VAO);
+            glDeleteBuffers(1, &this->volumes[i].VBO);
+            glDeleteBuffers(1, &this->volumes[i].EBO);
+        }
+        glDeleteVertexArrays(1, &this->emptyVAO);
+    }
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+    // False when the driver rejected a framebuffer; the forward path still works
+    bool Valid() const { return this->valid; }
+
+    // Binds and clears the G-buffer for the opaque pass (drawn with gbuffer.frag)
+    void BeginGeometry()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->gBuffer);
+        const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (GLint i = 0; i < 3; i++)
+            glClearBufferfv(GL_COLOR, i, zero);
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+    }
+
+    // Lights the G-buffer into the light target, cleared to the current clear colour.
+    // pointLights must be updated for this frame; the target stays bound with the scene
+    // depth for the transparent pass
+    void Shade(const ClusteredLights& pointLights, const SpotLightBlock& spot, const glm::mat4& viewProjection)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->lightTarget);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->lightTarget);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glUseProgram(this->program);
+        GLuint textures[] = { this->albedoSpecular, this->normal, this->shininess, this->depth };
+        for (GLuint i = 0; i < 4; i++) {
+            glActiveTexture(GL_TEXTURE0 + GBUFFER_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        pointLights.Bind(this->clusterUniforms);
+        ShaderUniforms::Set(this->inverseViewProjection, glm::inverse(viewProjection));
+
+        // Sun: every pixel, replacing the clear colour where there is geometry
+        glDepthMask(GL_FALSE);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(this->emptyVAO);
+        ShaderUniforms::Set(this->fullscreen, 1);
+        ShaderUniforms::Set(this->lightType, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // Volumes add up over it
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GEQUAL);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_DEPTH_CLAMP);
+        ShaderUniforms::Set(this->fullscreen, 0);
+
+        if (pointLights.Count() > 0) {
+            ShaderUniforms::Set(this->lightType, 1);
+            glBindVertexArray(this->volumes[0].VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, this->volumes[0].indexCount, GL_UNSIGNED_SHORT, (GLvoid*)0, (GLsizei)pointLights.Count());
+        }
+
+        ShaderUniforms::Set(this->lightType, 2);
+        float range = spotRange(spot);
+        if (range < 0.0f || spot.outerCutOff < MIN_CONE_COSINE) {
+            // No cone encloses it: full screen like the sun
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            glBindVertexArray(this->emptyVAO);
+            ShaderUniforms::Set(this->fullscreen, 1);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        else if (range > 0.0f) {
+            ShaderUniforms::Set(this->volumeTransform, coneTransform(spot, range));
+            glBindVertexArray(this->volumes[1].VAO);
+            glDrawElements(GL_TRIANGLES, this->volumes[1].indexCount, GL_UNSIGNED_SHORT, (GLvoid*)0);
+        }
+
+        glDisable(GL_DEPTH_CLAMP);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDepthFunc(GL_LESS);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glBindVertexArray(0);
+    }
+
+    // Copies the lit image to the window's framebuffer and binds it again
+    void Present()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->lightTarget);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    static const int BYTES_PER_PIXEL = 4 + 4 + 2 + 4;
+    static const int SPHERE_SUBDIVISIONS = 1;  // 80 triangles
+    static const int CONE_SEGMENTS = 16;
+    static constexpr float MIN_CONE_COSINE = 0.05f;  // Cones stop at about 87 degrees
+
+    // A position-only mesh
+    struct Volume
+    {
+        GLuint VAO = 0, VBO = 0, EBO = 0;
+        GLsizei indexCount = 0;
+    };
+
+    GLuint program;
+    int width, height;
+    ClusterUniforms clusterUniforms;  // Only pointLightData is used
+    Uniform<int> fullscreen;
+    Uniform<int> lightType;
+    Uniform<glm::mat4> volumeTransform;
+    Uniform<glm::mat4> inverseViewProjection;
+    Uniform<glm::vec2> inverseScreenSize;
+    bool valid;
+
+    GLuint gBuffer, lightTarget;
+    GLuint albedoSpecular, normal, shininess, depth;
+    GLuint lightBuffers[2];  // Colour, depth copy
+    Volume volumes[2];       // Sphere, cone
+    GLuint emptyVAO;
+
+    GLuint attachTexture(GLenum attachment, GLint internalFormat, GLenum format, GLenum type)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, this->width, this->height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void checkFramebuffer(const char* name)
+    {
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR::DEFERRED::FRAMEBUFFER " << name << " incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+            this->valid = false;
+        }
+    }
+
+    // Distance where the spot falls below one 8-bit step, where its cone ends; negative
+    // when it never does. The forward path has no cutoff, so beyond it the two differ by
+    // less than the framebuffer can show.
+    static float spotRange(const SpotLightBlock& spot)
+    {
+        float brightest = 0.0f;
+        for (int i = 0; i < 3; i++)
+            brightest = std::max(brightest, std::max(spot.ambient[i], std::max(spot.diffuse[i], spot.specular[i])));
+        float c = spot.constant - 256.0f * brightest;
+        if (c >= 0.0f)
+            return 0.0f;
+        if (spot.quadratic > 0.0f)
+            return (-spot.linear + std::sqrt(spot.linear * spot.linear - 4.0f * spot.quadratic * c)) / (2.0f * spot.quadratic);
+        if (spot.linear > 0.0f)
+            return -c / spot.linear;
+        return -1.0f;
+    }
+
+    // Unit cone (apex at the origin, base at z = 1) onto the spot's outer cone
+    static glm::mat4 coneTransform(const SpotLightBlock& spot, float range)
+    {
+        glm::vec3 axis = glm::normalize(spot.direction);
+        glm::vec3 up = std::fabs(axis.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 x = glm::normalize(glm::cross(up, axis));
+        glm::vec3 y = glm::cross(axis, x);
+        float sine = std::sqrt(std::max(1.0f - spot.outerCutOff * spot.outerCutOff, 0.0f));
+        float radius = range * sine / spot.outerCutOff;
+
+        glm::mat4 transform(1.0f);
+        transform[0] = glm::vec4(x * radius, 0.0f);
+        transform[1] = glm::vec4(y * radius, 0.0f);
+        transform[2] = glm::vec4(axis * range, 0.0f);
+        transform[3] = glm::vec4(spot.position, 1.0f);
+        return transform;
+    }
+
+    // Subdivided icosahedron, pushed out until its faces clear the unit sphere
+    void buildSphere()
+    {
+        const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+        std::vector<glm::vec3> positions = {
+            glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+            glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+            glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+        };
+        std::vector<GLushort> indices = {
+            0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+            3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+        };
+        for (int s = 0; s < SPHERE_SUBDIVISIONS; s++) {
+            std::vector<GLushort> split;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                GLushort a = indices[i], b = indices[i + 1], c = indices[i + 2];
+                GLushort ab = midpoint(positions, a, b), bc = midpoint(positions, b, c), ca = midpoint(positions, c, a);
+                GLushort triangles[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+                split.insert(split.end(), triangles, triangles + 12);
+            }
+            indices.swap(split);
+        }
+
+        float inradius = 1.0f;
+        for (size_t i = 0; i < positions.size(); i++)
+            positions[i] = glm::normalize(positions[i]);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+            inradius = std::min(inradius, std::fabs(glm::dot(glm::normalize(glm::cross(b - a, c - a)), a)));
+        }
+        for (size_t i = 0; i < positions.size(); i++)
+            positions[i] /= inradius;
+
+        this->upload(this->volumes[0], positions, indices, glm::vec3(0.0f));
+    }
+
+    // Midpoint vertices are shared (an edge split twice would leave cracks otherwise)
+    static GLushort midpoint(std::vector<glm::vec3>& positions, GLushort a, GLushort b)
+    {
+        glm::vec3 middle = (positions[a] + positions[b]) * 0.5f;
+        for (size_t i = 0; i < positions.size(); i++) {
+            if (positions[i] == middle)
+                return (GLushort)i;
+        }
+        positions.push_back(middle);
+        return (GLushort)(positions.size() - 1);
+    }
+
+    // Apex, a ring that clears the unit circle, and the base centre
+    void buildCone()
+    {
+        const float PI = 3.14159265f;
+        float ringRadius = 1.0f / std::cos(PI / CONE_SEGMENTS);
+        std::vector<glm::vec3> positions(1, glm::vec3(0.0f));
+        for (int i = 0; i < CONE_SEGMENTS; i++) {
+            float angle = 2.0f * PI * i / CONE_SEGMENTS;
+            positions.push_back(glm::vec3(std::cos(angle) * ringRadius, std::sin(angle) * ringRadius, 1.0f));
+        }
+        positions.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+
+        std::vector<GLushort> indices;
+        GLushort centre = (GLushort)(CONE_SEGMENTS + 1);
+        for (int i = 0; i < CONE_SEGMENTS; i++) {
+            GLushort current = (GLushort)(1 + i), next = (GLushort)(1 + (i + 1) % CONE_SEGMENTS);
+            GLushort triangles[] = { 0, current, next, centre, next, current };
+            indices.insert(indices.end(), triangles, triangles + 6);
+        }
+
+        this->upload(this->volumes[1], positions, indices, glm::vec3(0.0f, 0.0f, 0.5f));
+    }
+
+    // Winds every triangle counter-clockwise seen from outside (the mesh is convex around
+    // inside), then uploads it as attribute 0
+    static void upload(Volume& volume, const std::vector<glm::vec3>& positions, std::vector<GLushort>& indices, const glm::vec3& inside)
+    {
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            glm::vec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+            if (glm::dot(glm::cross(b - a, c - a), (a + b + c) / 3.0f - inside) < 0.0f)
+                std::swap(indices[i + 1], indices[i + 2]);
+        }
+
+        glGenVertexArrays(1, &volume.VAO);
+        glGenBuffers(1, &volume.VBO);
+        glGenBuffers(1, &volume.EBO);
+        glBindVertexArray(volume.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, volume.VBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volume.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+        glBindVertexArray(0);
+        volume.indexCount = (GLsizei)indices.size();
+    }
+};
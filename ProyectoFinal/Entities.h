@@ -0,0 +1,466 @@
+#pragma once
+
+// Entity-component storage for the scene
+// An entity is an id; its components live in the archetype (table) for its exact set of
+// components, with one array per component type, so systems walk tightly packed arrays of
+// just the data they need. Archetypes grow in fixed-size chunks that are never moved:
+// a component keeps its address for the life of the scene, which is what lets tweens and
+// state machine actions hold pointers into animators. Components are chosen when an
+// entity is created and entities are never removed, so creating one is an append.
+// Transforms form a parent/child graph. Each caches its local matrix and its world matrix
+// (the parent's world times local), and only the entities marked dirty rebuild them: a
+// changed local matrix rebuilds the node's own world matrix and those of its descendants,
+// parents first. Animators are compared with the values last applied, so tweens need not
+// report anything; placements edited by hand call MarkDirty(). A static entity costs
+// nothing after the frame it was created.
+// Systems, once per frame in this order:
+//   Animate()       rebuilds the dirty matrices and the boxes of the entities that moved
+//   UpdatePicker()  moves their picker instances along
+//   Submit()        frustum-culls the boxes with one SIMD pass, queues the visible models
+// Each() runs any other per-chunk loop over the archetypes that have a set of components.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "CachedModel.h"
+#include "Frustum.h"
+#include "RenderQueue.h"
+#include "ScenePicker.h"
+
+typedef uint32_t Entity;
+const Entity NO_ENTITY = 0xFFFFFFFFu;
+
+// Placement relative to the parent: rotation and scale turn about pivot (in the entity's
+// own space), which then lands on pivot + position. Matrices and links are kept by Entities.
+struct TransformComponent
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 pivot = glm::vec3(0.0f);
+
+    glm::mat4 local = glm::mat4(1.0f);
+    glm::mat4 world = glm::mat4(1.0f);
+    Entity parent = NO_ENTITY;
+    Entity firstChild = NO_ENTITY;
+    Entity nextSibling = NO_ENTITY;
+    uint32_t depth = 0;   // Parents have smaller depths
+    bool dirty = false;   // Local matrix out of date
+};
+
+// A model drawn through the RenderQueue; needs TRANSFORM and BOUNDS as well
+struct RenderableComponent
+{
+    CachedModel* model = nullptr;
+    float alpha = 1.0f;                  // Below 1 draws in the transparent pass
+    std::vector<unsigned int> programs;  // Lighting variant per material
+    std::vector<unsigned char> lods;     // Level drawn last frame, per mesh
+    int pickId = -1;                     // Assigned by AddToPicker
+};
+
+// Motion on top of the placement, in its space: a rotation of angle degrees about axis
+// (unit length) through the transform's pivot, then offset. angle and offset are what the
+// tweens animate.
+struct AnimatorComponent
+{
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float angle = 0.0f;
+    glm::vec3 offset = glm::vec3(0.0f);
+
+    float appliedAngle = 0.0f;  // In the local matrix
+    glm::vec3 appliedOffset = glm::vec3(0.0f);
+};
+
+// Clicking the entity sends an event to this state machine object (see BindObject)
+struct InteractableComponent
+{
+    int object = -1;
+};
+
+// World-space box of the renderable
+struct BoundsComponent
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+};
+
+class Entities
+{
+public:
+    // Component bits
+    static const unsigned int TRANSFORM = 1;
+    static const unsigned int RENDERABLE = 2;
+    static const unsigned int ANIMATOR = 4;
+    static const unsigned int INTERACTABLE = 8;
+    static const unsigned int BOUNDS = 16;
+    static const int COMPONENT_COUNT = 5;
+
+    static const size_t CHUNK_SIZE = 256;  // Rows per chunk
+
+    // Up to CHUNK_SIZE rows of one archetype; the arrays of components the archetype
+    // lacks are null
+    struct Chunk
+    {
+        size_t count;
+        Entity entities[CHUNK_SIZE];
+        std::unique_ptr<TransformComponent[]> transforms;
+        std::unique_ptr<RenderableComponent[]> renderables;
+        std::unique_ptr<AnimatorComponent[]> animators;
+        std::unique_ptr<InteractableComponent[]> interactables;
+        std::unique_ptr<BoundsComponent[]> bounds;
+    };
+
+    Entities()
+        : visibleEntities(0)
+    {
+        for (int i = 0; i < (1 << COMPONENT_COUNT); i++)
+            this->archetypeOf[i] = -1;
+    }
+
+    Entities(const Entities&) = delete;
+    Entities& operator=(const Entities&) = delete;
+
+    // New entity with default components
+    Entity Create(unsigned int components)
+    {
+        int archetypeIndex = this->archetypeOf[components];
+        if (archetypeIndex < 0) {
+            archetypeIndex = (int)this->archetypes.size();
+            this->archetypeOf[components] = archetypeIndex;
+            Archetype added;
+            added.components = components;
+            added.count = 0;
+            this->archetypes.push_back(std::move(added));
+        }
+
+        Archetype& archetype = this->archetypes[archetypeIndex];
+        if (archetype.count % CHUNK_SIZE == 0)
+            archetype.chunks.push_back(NewChunk(components));
+
+        Entity entity = (Entity)this->locations.size();
+        Location location = { (uint32_t)archetypeIndex, (uint32_t)archetype.count };
+        this->locations.push_back(location);
+
+        Chunk& chunk = *archetype.chunks.back();
+        chunk.entities[chunk.count++] = entity;
+        archetype.count++;
+        if (components & TRANSFORM)
+            this->MarkDirty(entity);
+        return entity;
+    }
+
+    // Makes child's placement relative to parent (NO_ENTITY for the world). False, and
+    // nothing changes, if parent is child or one of its descendants.
+    bool SetParent(Entity child, Entity parent)
+    {
+        for (Entity ancestor = parent; ancestor != NO_ENTITY; ancestor = this->Transform(ancestor).parent) {
+            if (ancestor == child)
+                return false;
+        }
+
+        TransformComponent& transform = this->Transform(child);
+        if (transform.parent != NO_ENTITY) {
+            Entity* link = &this->Transform(transform.parent).firstChild;
+            while (*link != child)
+                link = &this->Transform(*link).nextSibling;
+            *link = transform.nextSibling;
+        }
+
+        transform.parent = parent;
+        transform.nextSibling = NO_ENTITY;
+        if (parent != NO_ENTITY) {
+            TransformComponent& parentTransform = this->Transform(parent);
+            transform.nextSibling = parentTransform.firstChild;
+            parentTransform.firstChild = child;
+        }
+        this->setDepth(child, parent == NO_ENTITY ? 0 : this->Transform(parent).depth + 1);
+        this->MarkDirty(child);
+        return true;
+    }
+
+    // After editing a placement; its world matrix and its descendants' follow in Animate()
+    void MarkDirty(Entity entity)
+    {
+        TransformComponent& transform = this->Transform(entity);
+        if (!transform.dirty) {
+            transform.dirty = true;
+            this->dirtyEntities.push_back(entity);
+        }
+    }
+
+    bool Has(Entity entity, unsigned int components) const
+    {
+        return (this->archetypes[this->locations[entity].archetype].components & components) == components;
+    }
+
+    // The entity must have the component; references stay valid
+    TransformComponent& Transform(Entity entity) { return this->chunk(entity).transforms[this->row(entity)]; }
+    RenderableComponent& Renderable(Entity entity) { return this->chunk(entity).renderables[this->row(entity)]; }
+    AnimatorComponent& Animator(Entity entity) { return this->chunk(entity).animators[this->row(entity)]; }
+    InteractableComponent& Interactable(Entity entity) { return this->chunk(entity).interactables[this->row(entity)]; }
+    BoundsComponent& Bounds(Entity entity) { return this->chunk(entity).bounds[this->row(entity)]; }
+
+    // Calls function(chunk) for each chunk of the archetypes that have all of components
+    template <typename Function>
+    void Each(unsigned int components, Function function)
+    {
+        for (Archetype& archetype : this->archetypes) {
+            if ((archetype.components & components) != components)
+                continue;
+            for (std::unique_ptr<Chunk>& chunk : archetype.chunks)
+                function(*chunk);
+        }
+    }
+
+    // Makes an interactable entity part of a state machine object; several entities can
+    // share one and move together
+    void BindObject(Entity entity, int object)
+    {
+        this->Interactable(entity).object = object;
+        if (object >= (int)this->objectEntities.size())
+            this->objectEntities.resize(object + 1);
+        this->objectEntities[object].push_back(entity);
+    }
+
+    // Entities bound to a state machine object, for its actions
+    const std::vector<Entity>& ObjectEntities(int object) const
+    {
+        static const std::vector<Entity> none;
+        return object >= 0 && object < (int)this->objectEntities.size() ? this->objectEntities[object] : none;
+    }
+
+    void Animate()
+    {
+        this->moved.clear();
+        this->Each(TRANSFORM | ANIMATOR, [this](Chunk& chunk) {
+            AnimatorComponent* animators = chunk.animators.get();
+            for (size_t i = 0; i < chunk.count; i++) {
+                AnimatorComponent& animator = animators[i];
+                if (animator.angle == animator.appliedAngle && animator.offset == animator.appliedOffset)
+                    continue;
+                animator.appliedAngle = animator.angle;
+                animator.appliedOffset = animator.offset;
+
+                // Nothing else depends on a free-standing entity, so it is done right here
+                const TransformComponent& transform = chunk.transforms[i];
+                if (!transform.dirty && transform.parent == NO_ENTITY && transform.firstChild == NO_ENTITY) {
+                    this->updateLocal(chunk, i);
+                    this->updateWorld(chunk, i);
+                }
+                else {
+                    this->MarkDirty(chunk.entities[i]);
+                }
+            }
+        });
+
+        // Every other dirty local first, then world matrices from the shallowest dirty nodes
+        // down (bucketed by depth, which stays small); a dirty node below another is
+        // reached through its ancestor
+        this->depthBuckets.clear();
+        for (Entity entity : this->dirtyEntities) {
+            uint32_t depth = this->Transform(entity).depth;
+            this->updateLocal(this->chunk(entity), this->row(entity));
+            if (depth >= this->depthBuckets.size())
+                this->depthBuckets.resize(depth + 1);
+            this->depthBuckets[depth].push_back(entity);
+        }
+        this->dirtyEntities.clear();
+        for (std::vector<Entity>& bucket : this->depthBuckets) {
+            for (Entity entity : bucket) {
+                if (this->Transform(entity).dirty)
+                    this->updateSubtree(entity);
+            }
+        }
+    }
+
+    // Boxes of every renderable, once their models have loaded; Animate() keeps the boxes
+    // of the ones that move up to date
+    void UpdateBounds()
+    {
+        this->Each(TRANSFORM | RENDERABLE | BOUNDS, [](Chunk& chunk) {
+            for (size_t i = 0; i < chunk.count; i++) {
+                const CachedModel& model = *chunk.renderables[i].model;
+                TransformAabb(chunk.transforms[i].world, model.aabbMin, model.aabbMax, chunk.bounds[i].min, chunk.bounds[i].max);
+            }
+        });
+    }
+
+    // Adds every renderable at its current world matrix, after loading; call picker.Build() next
+    void AddToPicker(ScenePicker& picker)
+    {
+        this->Each(TRANSFORM | RENDERABLE, [this, &picker](Chunk& chunk) {
+            for (size_t i = 0; i < chunk.count; i++) {
+                RenderableComponent& renderable = chunk.renderables[i];
+                renderable.pickId = picker.Add(renderable.model->bvh, chunk.transforms[i].world);
+                if (renderable.pickId < 0)
+                    continue;
+                if (renderable.pickId >= (int)this->pickEntities.size())
+                    this->pickEntities.resize(renderable.pickId + 1, NO_ENTITY);
+                this->pickEntities[renderable.pickId] = chunk.entities[i];
+            }
+        });
+    }
+
+    // Call picker.Refit() next
+    void UpdatePicker(ScenePicker& picker)
+    {
+        for (Entity entity : this->moved) {
+            if (this->Has(entity, RENDERABLE))
+                picker.SetTransform(this->Renderable(entity).pickId, this->Transform(entity).world);
+        }
+    }
+
+    // State machine object behind a picker hit, or -1 for anything not interactable
+    int PickedObject(int pickId)
+    {
+        if (pickId < 0 || pickId >= (int)this->pickEntities.size() || this->pickEntities[pickId] == NO_ENTITY)
+            return -1;
+        Entity entity = this->pickEntities[pickId];
+        return this->Has(entity, INTERACTABLE) ? this->Interactable(entity).object : -1;
+    }
+
+    // Entities outside the frustum never reach the queue, which culls the meshes of the rest
+    void Submit(RenderQueue& queue, const Frustum& frustum)
+    {
+        const unsigned int drawn = TRANSFORM | RENDERABLE | BOUNDS;
+        this->boxes.Clear();
+        this->Each(drawn, [this](Chunk& chunk) {
+            for (size_t i = 0; i < chunk.count; i++)
+                this->boxes.Add(chunk.bounds[i].min, chunk.bounds[i].max);
+        });
+        this->visibleEntities = this->boxes.Cull(frustum, this->visible);
+
+        size_t box = 0;
+        this->Each(drawn, [this, &queue, &box](Chunk& chunk) {
+            for (size_t i = 0; i < chunk.count; i++, box++) {
+                if (!this->visible[box])
+                    continue;
+                RenderableComponent& renderable = chunk.renderables[i];
+                queue.Submit(*renderable.model, renderable.programs, chunk.transforms[i].world, renderable.alpha,
+                    &renderable.lods);
+            }
+        });
+    }
+
+    size_t EntityCount() const { return this->locations.size(); }
+    size_t DrawnEntities() const { return this->boxes.Size(); }
+    size_t VisibleEntities() const { return this->visibleEntities; }
+    size_t MovedEntities() const { return this->moved.size(); }  // In the last Animate()
+
+    void PrintStats() const
+    {
+        std::cout << "Entities: " << this->locations.size() << " in " << this->archetypes.size() << " archetypes" << std::endl;
+    }
+
+private:
+    struct Archetype
+    {
+        unsigned int components;
+        size_t count;
+        std::vector<std::unique_ptr<Chunk> > chunks;
+    };
+
+    struct Location
+    {
+        uint32_t archetype;
+        uint32_t index;  // Row across the archetype's chunks
+    };
+
+    std::vector<Archetype> archetypes;
+    int archetypeOf[1 << COMPONENT_COUNT];  // Component bits -> archetype, -1 if none yet
+    std::vector<Location> locations;        // Per entity
+    std::vector<std::vector<Entity> > objectEntities;  // Per state machine object
+    std::vector<Entity> pickEntities;                  // Per picker id
+    std::vector<Entity> dirtyEntities;                 // Local matrix out of date, unordered
+    std::vector<std::vector<Entity> > depthBuckets;    // Animate() scratch: dirty entities per depth
+    std::vector<Entity> moved;                         // World matrix rebuilt by the last Animate()
+    AabbList boxes;                      // Submit() scratch, in Each() order
+    std::vector<unsigned char> visible;
+    size_t visibleEntities;
+
+    Chunk& chunk(Entity entity)
+    {
+        const Location& location = this->locations[entity];
+        return *this->archetypes[location.archetype].chunks[location.index / CHUNK_SIZE];
+    }
+
+    size_t row(Entity entity) const { return this->locations[entity].index % CHUNK_SIZE; }
+
+    // T(position) T(pivot) R S T(-pivot), with the animator's motion folded into R and position
+    void updateLocal(Chunk& chunk, size_t row)
+    {
+        TransformComponent& transform = chunk.transforms[row];
+
+        glm::vec3 position = transform.position;
+        glm::quat rotation = transform.rotation;
+        if (chunk.animators) {
+            const AnimatorComponent& animator = chunk.animators[row];
+            position += transform.rotation * animator.offset;
+            rotation = rotation * glm::angleAxis(glm::radians(animator.angle), animator.axis);
+        }
+
+        glm::mat3 linear = glm::mat3_cast(rotation);
+        for (int column = 0; column < 3; column++) {
+            linear[column] *= transform.scale[column];
+            transform.local[column] = glm::vec4(linear[column], 0.0f);
+        }
+        transform.local[3] = glm::vec4(position + transform.pivot - linear * transform.pivot, 1.0f);
+    }
+
+    // World matrix and box of one entity whose parent is up to date
+    void updateWorld(Chunk& chunk, size_t row)
+    {
+        TransformComponent& transform = chunk.transforms[row];
+        if (transform.parent == NO_ENTITY)
+            transform.world = transform.local;
+        else
+            transform.world = this->Transform(transform.parent).world * transform.local;
+        transform.dirty = false;
+        this->moved.push_back(chunk.entities[row]);
+
+        if (chunk.renderables && chunk.bounds) {
+            const CachedModel& model = *chunk.renderables[row].model;
+            TransformAabb(transform.world, model.aabbMin, model.aabbMax, chunk.bounds[row].min, chunk.bounds[row].max);
+        }
+    }
+
+    void updateSubtree(Entity entity)
+    {
+        this->updateWorld(this->chunk(entity), this->row(entity));
+        for (Entity child = this->Transform(entity).firstChild; child != NO_ENTITY; child = this->Transform(child).nextSibling)
+            this->updateSubtree(child);
+    }
+
+    void setDepth(Entity entity, uint32_t depth)
+    {
+        TransformComponent& transform = this->Transform(entity);
+        transform.depth = depth;
+        for (Entity child = transform.firstChild; child != NO_ENTITY; child = this->Transform(child).nextSibling)
+            this->setDepth(child, depth + 1);
+    }
+
+    static std::unique_ptr<Chunk> NewChunk(unsigned int components)
+    {
+        std::unique_ptr<Chunk> chunk(new Chunk());
+        chunk->count = 0;
+        if (components & TRANSFORM)
+            chunk->transforms.reset(new TransformComponent[CHUNK_SIZE]);
+        if (components & RENDERABLE)
+            chunk->renderables.reset(new RenderableComponent[CHUNK_SIZE]);
+        if (components & ANIMATOR)
+            chunk->animators.reset(new AnimatorComponent[CHUNK_SIZE]);
+        if (components & INTERACTABLE)
+            chunk->interactables.reset(new InteractableComponent[CHUNK_SIZE]);
+        if (components & BOUNDS)
+            chunk->bounds.reset(new BoundsComponent[CHUNK_SIZE]);
+        return chunk;
+    }
+};
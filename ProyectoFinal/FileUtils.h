@@ -0,0 +1,50 @@
+#pragma once
+
+// Small file helpers shared by the model, texture and program caches
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+
+// 64-bit FNV-1a, used to key caches on file contents
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline bool ReadWholeFile(const std::string& path, std::vector<char>& out)
+{
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    out.resize((size_t)size);
+    return size == 0 || (bool)file.read(out.data(), size);
+}
+
+// Writes to a temporary file first so a crash never leaves a torn file behind
+inline bool WriteWholeFile(const std::string& path, const void* data, size_t size)
+{
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(static_cast<const char*>(data), (std::streamsize)size))
+            return false;
+    }
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// View-frustum culling
+// Planes come straight from the view-projection matrix (Gribb/Hartmann). Boxes are kept
+// as centre/extent in structure-of-arrays form so one SSE instruction tests a plane
+// against 4 boxes (8 with AVX): a box is outside when, for some plane,
+// dot(n, centre) + w + dot(|n|, extent) < 0.
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+struct Frustum
+{
+    glm::vec4 planes[6];  // left, right, bottom, top, near, far; normals point inwards
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection);  // Rows of the matrix
+        this->planes[0] = m[3] + m[0];
+        this->planes[1] = m[3] - m[0];
+        this->planes[2] = m[3] + m[1];
+        this->planes[3] = m[3] - m[1];
+        this->planes[4] = m[3] + m[2];
+        this->planes[5] = m[3] - m[2];
+        for (int i = 0; i < 6; i++)
+            this->planes[i] /= glm::length(glm::vec3(this->planes[i]));
+    }
+};
+
+// World-space box around a transformed local box (Arvo: centre moves, extent takes |M|)
+inline void TransformAabb(const glm::mat4& transform, const glm::vec3& localMin, const glm::vec3& localMax,
+    glm::vec3& worldMin, glm::vec3& worldMax)
+{
+    glm::vec3 center = glm::vec3(transform * glm::vec4((localMin + localMax) * 0.5f, 1.0f));
+    glm::vec3 extent = (localMax - localMin) * 0.5f;
+    glm::vec3 worldExtent(0.0f);
+    for (int column = 0; column < 3; column++)
+        worldExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+    worldMin = center - worldExtent;
+    worldMax = center + worldExtent;
+}
+
+// Boxes as centre/extent SoA, padded to a multiple of 8 for the vector loop
+class AabbList
+{
+public:
+    AabbList()
+        : count(0)
+    {
+    }
+
+    size_t Size() const { return this->count; }
+
+    void Clear()
+    {
+        this->count = 0;
+        for (int i = 0; i < 6; i++)
+            this->data[i].clear();
+    }
+
+    void Add(const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+    {
+        if (this->count % 8 == 0) {
+            for (int i = 0; i < 6; i++)
+                this->data[i].resize(this->count + 8, 0.0f);
+        }
+
+        glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+        glm::vec3 extent = (aabbMax - aabbMin) * 0.5f;
+        for (int axis = 0; axis < 3; axis++) {
+            this->data[axis][this->count] = center[axis];
+            this->data[3 + axis][this->count] = extent[axis];
+        }
+        this->count++;
+    }
+
+    // visible[i] = 1 when box i intersects the frustum; returns the number of visible boxes
+    size_t Cull(const Frustum& frustum, std::vector<unsigned char>& visible) const
+    {
+        visible.resize(this->count);
+        const float* cx = this->data[0].data();
+        const float* cy = this->data[1].data();
+        const float* cz = this->data[2].data();
+        const float* ex = this->data[3].data();
+        const float* ey = this->data[4].data();
+        const float* ez = this->data[5].data();
+        size_t visibleCount = 0;
+
+#if defined(__AVX__)
+        for (size_t i = 0; i < this->count; i += 8) {
+            __m256 centerX = _mm256_loadu_ps(cx + i), centerY = _mm256_loadu_ps(cy + i), centerZ = _mm256_loadu_ps(cz + i);
+            __m256 extentX = _mm256_loadu_ps(ex + i), extentY = _mm256_loadu_ps(ey + i), extentZ = _mm256_loadu_ps(ez + i);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(plane.x)),
+                    _mm256_mul_ps(centerY, _mm256_set1_ps(plane.y))),
+                    _mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, _mm256_set1_ps(std::fabs(plane.x))),
+                    _mm256_mul_ps(extentY, _mm256_set1_ps(std::fabs(plane.y)))),
+                    _mm256_mul_ps(extentZ, _mm256_set1_ps(std::fabs(plane.z))));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+            visibleCount += this->store(_mm256_movemask_ps(inside), i, 8, visible);
+        }
+#elif defined(FRUSTUM_SSE)
+        for (size_t i = 0; i < this->count; i += 4) {
+            __m128 centerX = _mm_loadu_ps(cx + i), centerY = _mm_loadu_ps(cy + i), centerZ = _mm_loadu_ps(cz + i);
+            __m128 extentX = _mm_loadu_ps(ex + i), extentY = _mm_loadu_ps(ey + i), extentZ = _mm_loadu_ps(ez + i);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)),
+                    _mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::fabs(plane.x))),
+                    _mm_mul_ps(extentY, _mm_set1_ps(std::fabs(plane.y)))),
+                    _mm_mul_ps(extentZ, _mm_set1_ps(std::fabs(plane.z))));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            visibleCount += this->store(_mm_movemask_ps(inside), i, 4, visible);
+        }
+#else
+        for (size_t i = 0; i < this->count; i++) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++) {
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w;
+                float radius = std::fabs(plane.x) * ex[i] + std::fabs(plane.y) * ey[i] + std::fabs(plane.z) * ez[i];
+                inside = distance + radius >= 0.0f;
+            }
+            visible[i] = inside ? 1 : 0;
+            visibleCount += inside ? 1 : 0;
+        }
+#endif
+        return visibleCount;
+    }
+
+private:
+    std::vector<float> data[6];  // centre x/y/z, extent x/y/z
+    size_t count;
+
+    // Writes one lane mask, skipping the padding past count
+    size_t store(int mask, size_t first, size_t lanes, std::vector<unsigned char>& visible) const
+    {
+        size_t visibleCount = 0;
+        for (size_t lane = 0; lane < lanes && first + lane < this->count; lane++) {
+            visible[first + lane] = (unsigned char)((mask >> lane) & 1);
+            visibleCount += visible[first + lane];
+        }
+        return visibleCount;
+    }
+};
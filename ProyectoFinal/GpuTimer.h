@@ -0,0 +1,57 @@
+#pragma once
+
+// GPU time of a stretch of commands per frame
+// GL_TIME_ELAPSED results are read LATENCY frames after their query ended, by which time
+// the GPU has finished them, so the CPU never waits on the timer.
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+class GpuTimer
+{
+public:
+    GpuTimer()
+        : current(0), milliseconds(0.0f)
+    {
+        glGenQueries(LATENCY, this->queries);
+        for (int i = 0; i < LATENCY; i++)
+            this->pending[i] = false;
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(LATENCY, this->queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Not nestable: one GL_TIME_ELAPSED query can be active at a time
+    void Begin()
+    {
+        if (this->pending[this->current]) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(this->queries[this->current], GL_QUERY_RESULT, &elapsed);
+            this->milliseconds = (float)(elapsed / 1e6);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, this->queries[this->current]);
+    }
+
+    void End()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        this->pending[this->current] = true;
+        this->current = (this->current + 1) % LATENCY;
+    }
+
+    // Newest finished measurement
+    float Milliseconds() const { return this->milliseconds; }
+
+private:
+    static const int LATENCY = 3;
+
+    GLuint queries[LATENCY];
+    bool pending[LATENCY];
+    int current;
+    float milliseconds;
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+// Minimal KTX2 container for block-compressed textures
+// Written by Tools/CompressTextures.cpp and read by TextureStreamer. Only what this
+// project produces is supported: one 2D image, no array layers or faces, no
+// supercompression, BC1/BC3 (and BC7 files made by external encoders).
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+#include "FileUtils.h"
+
+// Vulkan format numbers used in the KTX2 header
+const uint32_t VK_FORMAT_BC1_RGBA_UNORM_BLOCK = 133;
+const uint32_t VK_FORMAT_BC1_RGBA_SRGB_BLOCK = 134;
+const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+const uint32_t VK_FORMAT_BC3_SRGB_BLOCK = 138;
+const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+const uint32_t VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+// Key under which the compressor records the hash and size of the source image
+const char* const KTX2_SOURCE_KEY = "ProyectoFinal.source";
+
+// "hash:size" of the source bytes, the value stored under KTX2_SOURCE_KEY
+inline std::string Ktx2SourceRecord(const std::vector<char>& bytes)
+{
+    std::ostringstream record;
+    record << std::hex << HashBytes(bytes.data(), bytes.size()) << ':' << std::dec << bytes.size();
+    return record.str();
+}
+
+struct Ktx2Level
+{
+    uint64_t offset;  // From the start of the level data buffer
+    uint64_t size;
+    int width;
+    int height;
+};
+
+struct Ktx2Image
+{
+    uint32_t vkFormat = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<Ktx2Level> levels;  // Level 0 (largest) first
+    std::string source;             // Value of KTX2_SOURCE_KEY, if present
+};
+
+struct Ktx2Header
+{
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+inline size_t Ktx2BlockBytes(uint32_t vkFormat)
+{
+    return (vkFormat == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || vkFormat == VK_FORMAT_BC1_RGBA_SRGB_BLOCK) ? 8 : 16;
+}
+
+inline size_t Ktx2LevelBytes(uint32_t vkFormat, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * Ktx2BlockBytes(vkFormat);
+}
+
+// GL internal format for a KTX2 vkFormat, 0 if unsupported.
+// The sRGB variants upload as UNORM: shading here works on gamma-encoded colours,
+// matching how the JPEG/PNG path uploads GL_RGBA.
+inline GLenum Ktx2GLFormat(uint32_t vkFormat)
+{
+    switch (vkFormat) {
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default:
+        return 0;
+    }
+}
+
+// Length of a full mip chain: floor(log2(max(width, height))) + 1
+inline uint32_t Ktx2MaxLevels(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = width > height ? width : height; size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+// Parses a KTX2 file and copies its level data, largest level first, into levelData
+inline bool ParseKtx2(const char* bytes, size_t size, Ktx2Image& image, std::vector<unsigned char>& levelData)
+{
+    if (size < sizeof(Ktx2Header))
+        return false;
+
+    Ktx2Header header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0
+        || Ktx2GLFormat(header.vkFormat) == 0 || header.supercompressionScheme != 0
+        || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1
+        || header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > INT32_MAX || header.pixelHeight > INT32_MAX
+        || header.levelCount == 0 || header.levelCount > Ktx2MaxLevels(header.pixelWidth, header.pixelHeight))
+        return false;
+
+    size_t indexEnd = sizeof(Ktx2Header) + header.levelCount * 3 * sizeof(uint64_t);
+    if (indexEnd > size)
+        return false;
+
+    image.vkFormat = header.vkFormat;
+    image.width = (int)header.pixelWidth;
+    image.height = (int)header.pixelHeight;
+    image.levels.clear();
+    levelData.clear();
+
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        uint64_t entry[3];
+        std::memcpy(entry, bytes + sizeof(Ktx2Header) + i * sizeof(entry), sizeof(entry));
+
+        Ktx2Level level;
+        level.width = image.width >> i ? image.width >> i : 1;
+        level.height = image.height >> i ? image.height >> i : 1;
+        level.size = entry[1];
+        level.offset = levelData.size();
+        if (entry[0] > size || entry[1] > size - entry[0] || entry[1] != Ktx2LevelBytes(image.vkFormat, level.width, level.height))
+            return false;
+
+        levelData.insert(levelData.end(), bytes + entry[0], bytes + entry[0] + entry[1]);
+        image.levels.push_back(level);
+    }
+
+    // Key/value data: look for the source record
+    image.source.clear();
+    if (header.kvdByteLength > 0 && (uint64_t)header.kvdByteOffset + header.kvdByteLength <= size) {
+        const char* kvd = bytes + header.kvdByteOffset;
+        uint32_t pos = 0;
+        while (pos + 4 <= header.kvdByteLength) {
+            uint32_t length;
+            std::memcpy(&length, kvd + pos, 4);
+            if (length == 0 || pos + 4 + length > header.kvdByteLength)
+                break;
+            std::string entry(kvd + pos + 4, length);
+            size_t split = entry.find('\0');
+            if (split != std::string::npos && entry.compare(0, split, KTX2_SOURCE_KEY) == 0)
+                image.source = entry.substr(split + 1, entry.find('\0', split + 1) - split - 1);
+            pos += 4 + ((length + 3) & ~3u);
+        }
+    }
+    return true;
+}
+
+// Uploads every level of a parsed image into the bound GL_TEXTURE_2D.
+// data is a client pointer, or a byte offset when a pixel unpack buffer is bound.
+inline void UploadKtx2Levels(const Ktx2Image& image, const unsigned char* data)
+{
+    GLenum format = Ktx2GLFormat(image.vkFormat);
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const Ktx2Level& level = image.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0,
+            (GLsizei)level.size, data + level.offset);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+}
+
+// Appends a little-endian value to a byte vector
+template <typename T>
+inline void Ktx2Put(std::vector<unsigned char>& out, T value)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Serializes a block-compressed mip chain (largest level first) into a KTX2 file image
+inline std::vector<unsigned char> WriteKtx2(uint32_t vkFormat, int width, int height,
+    const std::vector<std::vector<unsigned char> >& levels, const std::string& source)
+{
+    const bool bc1 = Ktx2BlockBytes(vkFormat) == 8;
+    const uint32_t sampleCount = bc1 ? 1 : 2;
+    const uint32_t blockSize = 24 + 16 * sampleCount;
+
+    // Data format descriptor (Khronos basic descriptor block)
+    std::vector<unsigned char> dfd;
+    Ktx2Put<uint32_t>(dfd, 4 + blockSize);
+    Ktx2Put<uint32_t>(dfd, 0);                                 // vendorId 0, descriptorType 0
+    Ktx2Put<uint32_t>(dfd, 2 | (blockSize << 16));             // versionNumber 2, blockSize
+    Ktx2Put<uint8_t>(dfd, bc1 ? 128 : 130);                    // KHR_DF_MODEL_BC1A / BC3
+    Ktx2Put<uint8_t>(dfd, 1);                                  // BT.709 primaries
+    Ktx2Put<uint8_t>(dfd, 2);                                  // sRGB transfer
+    Ktx2Put<uint8_t>(dfd, 0);                                  // Straight alpha
+    Ktx2Put<uint32_t>(dfd, 3 | (3 << 8));                      // 4x4x1x1 texel block
+    Ktx2Put<uint32_t>(dfd, (uint32_t)Ktx2BlockBytes(vkFormat)); // bytesPlane0
+    Ktx2Put<uint32_t>(dfd, 0);
+    if (bc1) {
+        Ktx2Put<uint32_t>(dfd, 0 | (63u << 16) | (1u << 24)); // Colour with alpha, bits 0-63
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0xFFFFFFFFu);
+    }
+    else {
+        Ktx2Put<uint32_t>(dfd, 0 | (63u << 16) | (15u << 24)); // Alpha, bits 0-63
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0xFFFFFFFFu);
+        Ktx2Put<uint32_t>(dfd, 64 | (63u << 16) | (0u << 24)); // Colour, bits 64-127
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0);
+        Ktx2Put<uint32_t>(dfd, 0xFFFFFFFFu);
+    }
+
+    // Key/value data
+    std::vector<unsigned char> kvd;
+    std::string entry = std::string(KTX2_SOURCE_KEY) + '\0' + source + '\0';
+    Ktx2Put<uint32_t>(kvd, (uint32_t)entry.size());
+    kvd.insert(kvd.end(), entry.begin(), entry.end());
+    while (kvd.size() % 4)
+        kvd.push_back(0);
+
+    const uint32_t levelCount = (uint32_t)levels.size();
+    const size_t indexSize = levelCount * 3 * sizeof(uint64_t);
+    const uint32_t dfdOffset = (uint32_t)(sizeof(Ktx2Header) + indexSize);
+    const uint32_t kvdOffset = dfdOffset + (uint32_t)dfd.size();
+    size_t dataStart = kvdOffset + kvd.size();
+
+    // Levels are stored smallest first, each aligned to the block size
+    std::vector<uint64_t> offsets(levelCount);
+    size_t cursor = dataStart;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        size_t align = Ktx2BlockBytes(vkFormat);
+        cursor = (cursor + align - 1) / align * align;
+        offsets[i] = cursor;
+        cursor += levels[i].size();
+    }
+
+    Ktx2Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = (uint32_t)width;
+    header.pixelHeight = (uint32_t)height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = dfdOffset;
+    header.dfdByteLength = (uint32_t)dfd.size();
+    header.kvdByteOffset = kvdOffset;
+    header.kvdByteLength = (uint32_t)kvd.size();
+
+    std::vector<unsigned char> out(cursor, 0);
+    std::memcpy(&out[0], &header, sizeof(header));
+    for (uint32_t i = 0; i < levelCount; i++) {
+        uint64_t entryData[3] = { offsets[i], levels[i].size(), levels[i].size() };
+        std::memcpy(&out[sizeof(header) + i * sizeof(entryData)], entryData, sizeof(entryData));
+    }
+    std::memcpy(&out[dfdOffset], dfd.data(), dfd.size());
+    std::memcpy(&out[kvdOffset], kvd.data(), kvd.size());
+    for (uint32_t i = 0; i < levelCount; i++) {
+        if (!levels[i].empty())
+            std::memcpy(&out[(size_t)offsets[i]], levels[i].data(), levels[i].size());
+    }
+    return out;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+// Compile-time variants of lighting.frag, and of gbuffer.frag for the deferred pipeline
+// Each material draws with a program specialised to its features, so the transparency,
+// alpha-test and specular-map branches are compiled out instead of tested per fragment.
+// The scene's lights are fixed, so their loops are kept or dropped for every variant.
+// Variants that draw opaque materials get a G-buffer twin with the same alpha-test and
+// specular-map defines, which the deferred pipeline switches their packets to.
+// Request() runs before the models load and starts compiling every set a material can
+// produce (eight: the static batch's draws sample a texture array, see TextureLayers.h),
+// so the compiles overlap the load. Count() then tallies meshes per
+// set, and Select() keeps the most used sets, at most `capacity` of them, and releases the
+// variants nothing draws with. Rarer sets share a fallback with the optional features on,
+// which draws them the same: a missing specular map samples texture 0 (black), and the
+// opaque pass does not blend, so the transparent alpha output goes unused. Alpha-test
+// changes coverage and always matches.
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "ShaderUniforms.h"
+#include "CachedModel.h"
+#include "ClusteredLights.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
+#include "TextureStreamer.h"
+#include "UniformBlocks.h"
+
+class LightingPermutations
+{
+public:
+    // Feature bits, one #define each in lighting.frag; the first four vary per material
+    static const unsigned int TRANSPARENT_BLEND = 1;
+    static const unsigned int ALPHA_TEST = 2;
+    static const unsigned int SPECULAR_MAP = 4;
+    static const unsigned int TEXTURE_ARRAY = 8;
+    static const unsigned int POINT_LIGHTS = 16;
+    static const unsigned int SPOT_LIGHT = 32;
+    static const int FEATURE_COUNT = 6;
+    static const unsigned int MATERIAL_SETS = 16;
+
+    // Fallbacks add these; they never change what a material looks like
+    static const unsigned int OPTIONAL_FEATURES = TRANSPARENT_BLEND | SPECULAR_MAP;
+
+    // The ones gbuffer.frag knows; it has no lights and never blends
+    static const unsigned int GEOMETRY_FEATURES = ALPHA_TEST | SPECULAR_MAP | TEXTURE_ARRAY;
+
+    static const size_t DEFAULT_CAPACITY = 4;
+
+    // sceneFeatures: POINT_LIGHTS and SPOT_LIGHT (see SceneFeatures)
+    explicit LightingPermutations(unsigned int sceneFeatures, size_t capacity = DEFAULT_CAPACITY)
+        : sceneFeatures(sceneFeatures), capacity(capacity)
+    {
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++) {
+            this->uses[i] = 0;
+            this->variantOf[i] = -1;
+        }
+    }
+
+    // Lights that contribute anything; they must stay fixed afterwards
+    static unsigned int SceneFeatures(const ClusteredLights& pointLights, const LightBlock& lights)
+    {
+        unsigned int features = 0;
+        if (pointLights.Count() > 0)
+            features |= POINT_LIGHTS;
+        const SpotLightBlock& spot = lights.spotLight;
+        if (spot.ambient + spot.diffuse + spot.specular != glm::vec3(0.0f))
+            features |= SPOT_LIGHT;
+        return features;
+    }
+
+    // Transparent submissions keep discarding texels under 0.1 alpha. layered: the diffuse
+    // map is a layer of the static batch's array.
+    static unsigned int MaterialFeatures(TextureHandle specular, float alpha, bool layered = false)
+    {
+        unsigned int features = 0;
+        if (alpha < 1.0f)
+            features |= TRANSPARENT_BLEND | ALPHA_TEST;
+        if (specular != NO_TEXTURE)
+            features |= SPECULAR_MAP;
+        if (layered)
+            features |= TEXTURE_ARRAY;
+        return features;
+    }
+
+    // Before loading: starts compiling a variant of every set MaterialFeatures can return,
+    // plus their fallbacks when there are more sets than capacity, and the G-buffer variants
+    // of the opaque ones. Ready after cache.Finish().
+    void Request(ProgramCache& cache, const std::string& vertexPath, const std::string& fragmentPath,
+        const std::string& geometryPath)
+    {
+        std::vector<unsigned int> sets;
+        const TextureHandle speculars[] = { NO_TEXTURE, NO_TEXTURE + 1 };
+        const float alphas[] = { 1.0f, 0.0f };
+        for (TextureHandle specular : speculars) {
+            for (float alpha : alphas) {
+                sets.push_back(MaterialFeatures(specular, alpha));
+                sets.push_back(MaterialFeatures(specular, alpha, true));
+            }
+        }
+
+        for (unsigned int set : sets) {
+            std::vector<unsigned int> candidates(1, set);
+            if (sets.size() > this->capacity)
+                candidates.push_back(set | OPTIONAL_FEATURES);
+            for (unsigned int features : candidates) {
+                int index = this->variant(features);
+                if (!(set & TRANSPARENT_BLEND))
+                    this->variants[index].geometry = this->geometryVariant(features & GEOMETRY_FEATURES);
+            }
+        }
+        for (Variant& variant : this->variants)
+            variant.shader = cache.Request(vertexPath, fragmentPath, Defines(variant.features | this->sceneFeatures));
+        for (Variant& variant : this->geometryVariants)
+            variant.shader = cache.Request(vertexPath, geometryPath, Defines(variant.features));
+    }
+
+    // Load time, after the models requested their textures
+    void Count(const CachedModel& model, float alpha = 1.0f)
+    {
+        for (size_t i = 0; i < model.meshes.size(); i++)
+            this->uses[MaterialFeatures(model.SpecularTexture(model.MeshMaterial(i)), alpha)]++;
+    }
+
+    void Count(const StaticBatch& batch)
+    {
+        const std::vector<StaticBatch::Group>& groups = batch.Groups();
+        for (size_t g = 0; g < groups.size(); g++) {
+            const StaticBatch::GroupKey& key = groups[g].key;
+            this->uses[MaterialFeatures(key.specular, key.alpha, key.layered)] += groups[g].ranges.size();
+        }
+    }
+
+    // After Count() and cache.Finish(): maps every used set to a variant and releases the rest
+    void Select(ProgramCache& cache)
+    {
+        std::vector<unsigned int> sets;
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++) {
+            if (this->uses[i] > 0)
+                sets.push_back(i);
+        }
+        std::stable_sort(sets.begin(), sets.end(), [this](unsigned int a, unsigned int b) {
+            return this->uses[a] > this->uses[b];
+        });
+
+        for (size_t i = 0; i < sets.size(); i++) {
+            unsigned int features = sets[i];
+            if (i >= this->capacity)
+                features |= OPTIONAL_FEATURES;
+            this->variantOf[sets[i]] = this->variant(features);
+        }
+
+        // G-buffer variants stay where an opaque set draws with their twin
+        std::vector<int> keptGeometry(this->geometryVariants.size(), -1);
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++) {
+            if (this->variantOf[i] >= 0 && !(i & TRANSPARENT_BLEND) && this->variants[this->variantOf[i]].geometry >= 0)
+                keptGeometry[this->variants[this->variantOf[i]].geometry] = 0;
+        }
+        release(cache, this->geometryVariants, keptGeometry);
+        for (Variant& variant : this->variants) {
+            if (variant.geometry >= 0)
+                variant.geometry = keptGeometry[variant.geometry];
+        }
+
+        std::vector<int> kept(this->variants.size(), -1);
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++) {
+            if (this->variantOf[i] >= 0)
+                kept[this->variantOf[i]] = 0;
+        }
+        release(cache, this->variants, kept);
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++) {
+            if (this->variantOf[i] >= 0)
+                this->variantOf[i] = kept[this->variantOf[i]];
+        }
+    }
+
+    // Once the programs are linked: resolves their uniforms and adds them to the queue
+    void Register(RenderQueue& queue)
+    {
+        for (Variant& variant : this->variants) {
+            ShaderUniforms uniforms(variant.shader.Program);
+            variant.queueProgram = queue.AddProgram(uniforms);
+            this->clusterUniforms.push_back(ClusterUniforms(uniforms));
+
+            variant.shader.Use();
+            ShaderUniforms::Set(uniforms.Get<int>("material.diffuse"), 0);
+            ShaderUniforms::Set(uniforms.Get<int>("material.specular"), 1);
+        }
+        for (Variant& variant : this->geometryVariants) {
+            ShaderUniforms uniforms(variant.shader.Program);
+            variant.queueProgram = queue.AddProgram(uniforms);
+
+            variant.shader.Use();
+            ShaderUniforms::Set(uniforms.Get<int>("material.diffuse"), 0);
+            ShaderUniforms::Set(uniforms.Get<int>("material.specular"), 1);
+        }
+    }
+
+    // For RenderQueue::Flush in the deferred pipeline: the G-buffer twin of every queue
+    // program that draws opaque materials; other ids map to themselves
+    std::vector<unsigned int> GeometryPrograms() const
+    {
+        std::vector<unsigned int> programs;
+        for (const Variant& variant : this->variants) {
+            while (programs.size() <= variant.queueProgram)
+                programs.push_back((unsigned int)programs.size());
+            if (variant.geometry >= 0)
+                programs[variant.queueProgram] = this->geometryVariants[variant.geometry].queueProgram;
+        }
+        return programs;
+    }
+
+    // Queue program of every material, for RenderQueue::Submit. Materials no mesh uses
+    // are never drawn and get the first variant.
+    std::vector<unsigned int> Programs(const CachedModel& model, float alpha = 1.0f) const
+    {
+        std::vector<unsigned int> programs(std::max<size_t>(model.materials.size(), 1), this->queueProgram(-1));
+        for (size_t i = 0; i < model.meshes.size(); i++) {
+            GLuint material = model.MeshMaterial(i);
+            programs[material] = this->queueProgram(this->variantOf[MaterialFeatures(model.SpecularTexture(material), alpha)]);
+        }
+        return programs;
+    }
+
+    // Queue program of every batch group
+    std::vector<unsigned int> Programs(const StaticBatch& batch) const
+    {
+        const std::vector<StaticBatch::Group>& groups = batch.Groups();
+        std::vector<unsigned int> programs(groups.size());
+        for (size_t g = 0; g < groups.size(); g++) {
+            const StaticBatch::GroupKey& key = groups[g].key;
+            programs[g] = this->queueProgram(this->variantOf[MaterialFeatures(key.specular, key.alpha, key.layered)]);
+        }
+        return programs;
+    }
+
+    // Each variant reads the cluster tables through its own uniforms
+    void BindLights(const ClusteredLights& pointLights) const
+    {
+        for (size_t i = 0; i < this->variants.size(); i++) {
+            this->variants[i].shader.Use();
+            pointLights.Bind(this->clusterUniforms[i]);
+        }
+    }
+
+    size_t VariantCount() const { return this->variants.size(); }
+    GLuint Program(size_t variant) const { return this->variants[variant].shader.Program; }
+    size_t GeometryVariantCount() const { return this->geometryVariants.size(); }
+    GLuint GeometryProgram(size_t variant) const { return this->geometryVariants[variant].shader.Program; }
+
+    void PrintStats() const
+    {
+        size_t sets = 0;
+        for (unsigned int i = 0; i < MATERIAL_SETS; i++)
+            sets += this->uses[i] > 0 ? 1 : 0;
+        std::cout << "Lighting: " << this->variants.size() << " variants for " << sets << " material feature sets (capacity "
+            << this->capacity << "), " << this->geometryVariants.size() << " G-buffer variants, point lights " << ((this->sceneFeatures & POINT_LIGHTS) ? "on" : "off")
+            << ", spot light " << ((this->sceneFeatures & SPOT_LIGHT) ? "on" : "off") << std::endl;
+    }
+
+private:
+    struct Variant
+    {
+        unsigned int features;  // Material features only
+        ShaderProgram shader;
+        unsigned int queueProgram;
+        int geometry;           // Index into geometryVariants, -1 if it draws no opaque set
+    };
+
+    unsigned int sceneFeatures;
+    size_t capacity;
+    size_t uses[MATERIAL_SETS];   // Meshes per material feature set
+    int variantOf[MATERIAL_SETS]; // -1 for sets no mesh uses
+    std::vector<Variant> variants;
+    std::vector<Variant> geometryVariants;  // features within GEOMETRY_FEATURES
+    std::vector<ClusterUniforms> clusterUniforms;  // Per variant
+
+    int variant(unsigned int features)
+    {
+        for (size_t i = 0; i < this->variants.size(); i++) {
+            if (this->variants[i].features == features)
+                return (int)i;
+        }
+        Variant added = { features, { 0 }, 0, -1 };
+        this->variants.push_back(added);
+        return (int)this->variants.size() - 1;
+    }
+
+    int geometryVariant(unsigned int features)
+    {
+        for (size_t i = 0; i < this->geometryVariants.size(); i++) {
+            if (this->geometryVariants[i].features == features)
+                return (int)i;
+        }
+        Variant added = { features, { 0 }, 0, -1 };
+        this->geometryVariants.push_back(added);
+        return (int)this->geometryVariants.size() - 1;
+    }
+
+    // Releases the entries whose kept[] is negative; kept[] becomes their new index
+    static void release(ProgramCache& cache, std::vector<Variant>& list, std::vector<int>& kept)
+    {
+        std::vector<Variant> used;
+        for (size_t i = 0; i < list.size(); i++) {
+            if (kept[i] < 0) {
+                cache.Release(list[i].shader);
+                continue;
+            }
+            kept[i] = (int)used.size();
+            used.push_back(list[i]);
+        }
+        list.swap(used);
+    }
+
+    unsigned int queueProgram(int variant) const
+    {
+        if (variant < 0)
+            variant = 0;
+        return this->variants.empty() ? 0 : this->variants[variant].queueProgram;
+    }
+
+    static std::string Defines(unsigned int features)
+    {
+        static const char* const names[FEATURE_COUNT] = { "TRANSPARENT", "ALPHA_TEST", "SPECULAR_MAP", "TEXTURE_ARRAY",
+            "POINT_LIGHTS", "SPOT_LIGHT" };
+        std::string defines;
+        for (int i = 0; i < FEATURE_COUNT; i++) {
+            if (features & (1u << i))
+                defines += std::string("#define ") + names[i] + "\n";
+        }
+        return defines;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+// Screen-space LOD selection
+// A level is good enough while its simplification error, projected at the mesh's
+// distance, stays under PIXEL_ERROR pixels; the coarsest such level is drawn. Moving to
+// a coarser level needs HYSTERESIS times less error, so a mesh sitting right at a
+// threshold does not flip between two levels every frame.
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "ModelCache.h"
+
+class LodSelector
+{
+public:
+    LodSelector()
+        : eye(0.0f), pixelsPerUnit(0.0f)
+    {
+    }
+
+    // projection is the camera's, viewportHeight in pixels
+    void Begin(const glm::vec3& eye, const glm::mat4& projection, int viewportHeight)
+    {
+        this->eye = eye;
+        this->pixelsPerUnit = projection[1][1] * (float)viewportHeight * 0.5f;
+    }
+
+    // errorScale takes the levels' errors to world units; current is the level drawn last
+    // frame, and the box is the mesh's world bounds
+    unsigned int Select(const CacheLod* lods, unsigned int count, float errorScale, unsigned int current,
+        const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+    {
+        glm::vec3 outside = glm::max(glm::max(aabbMin - this->eye, this->eye - aabbMax), glm::vec3(0.0f));
+        float distance = glm::length(outside);
+        if (distance <= 0.0f)
+            return 0;
+
+        float scale = errorScale * this->pixelsPerUnit / distance;
+        unsigned int level = 0;
+        for (unsigned int i = 1; i < count; i++) {
+            float limit = PIXEL_ERROR;
+            if (i > current)
+                limit *= HYSTERESIS;
+            if (lods[i].error * scale > limit)
+                break;
+            level = i;
+        }
+        return level;
+    }
+
+    // Largest axis scale of a transform, the errorScale for meshes drawn with it
+    static float MaxScale(const glm::mat4& transform)
+    {
+        return glm::sqrt(glm::max(glm::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+            glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1]))), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2]))));
+    }
+
+private:
+    static constexpr float PIXEL_ERROR = 1.0f;
+    static constexpr float HYSTERESIS = 0.75f;
+
+    glm::vec3 eye;
+    float pixelsPerUnit;  // Pixels covered by one world unit at distance 1
+};
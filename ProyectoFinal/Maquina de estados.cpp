@@ -1,4 +1,8 @@
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <utility>
 #include <cmath>
 
 // GLEW for OpenGL function loading
@@ -19,16 +23,92 @@
 #include "SOIL2/SOIL2.h"
 
 // Custom classes
-#include "Shader.h"
+#include "ShaderUniforms.h"
+#include "UniformBlocks.h"
 #include "Camera.h"
 #include "Model.h"
+#include "CachedModel.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "Entities.h"
+#include "GpuTimer.h"
+#include "LightingPermutations.h"
+#include "ModelLoader.h"
+#include "OcclusionBuffer.h"
+#include "PortalCells.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "ScenePicker.h"
+#include "StateMachines.h"
+#include "Tweens.h"
 
 // Function prototypes
 void MouseCallback(GLFWwindow* window, double xpos, double ypos);
 void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void Inputs(GLFWwindow* window, float deltaTime);
-void Animation();
+void SetupLights(LightBlock& lights, ClusteredLights& pointLights);
+void CreateEntities(CachedModel models[], Entity rowEntities[]);
+bool SetupStateMachines(const DeferredRenderer& deferred, const Entity rowEntities[]);
+void UpdateSunLight(LightBlock& lights, float factor);
+void ToggleDoors();
+void ToggleChair();
+void ToggleShower();
+void StartSunset();
+void TogglePipeline();
+void CursorRay(GLFWwindow* window, const glm::mat4& viewProjection, glm::vec3& origin, glm::vec3& direction);
+
+// Models, each loaded once however many entities draw it
+enum SceneModel { HOUSE_MODEL, FLOOR_MODEL, GLASS_MODEL, DOOR_MODEL, DOOR2_MODEL, CHAIR_MODEL, SHOWER_MODEL, SCENE_MODEL_COUNT };
+const char* const sceneModelPaths[SCENE_MODEL_COUNT] = {
+    "Models/casa.obj", "Models/piso.obj", "Models/Crystal.obj", "Models/door.obj", "Models/door2.obj",
+    "Models/chair.obj", "Models/shower.obj"
+};
+
+// What a scene row is besides something to draw
+const unsigned int SCENE_STATIC = 1;    // Never moves: baked into the StaticBatch, with a model of its own
+const unsigned int SCENE_OCCLUDER = 2;  // Rasterized into the occlusion buffer
+const unsigned int SCENE_WALLS = 4;     // Its walls split the house into rooms
+const unsigned int SCENE_PORTAL = 8;    // Joins the rooms it touches
+const unsigned int SCENE_ANIMATED = 16; // Its machine's actions turn it and move it
+
+// One entity per row (see CreateEntities); adding an object is adding a row
+struct SceneEntity
+{
+    SceneModel model;
+    unsigned int flags;    // SCENE_*
+    int parent;            // Earlier row this one is placed on and moves with, or -1
+    glm::vec3 position;    // Relative to the parent
+    float yaw;             // Degrees about +Y
+    glm::vec3 scale;
+    float alpha;           // Below 1 draws in the transparent pass
+    const char* machine;   // StateMachines.txt machine that clicks toggle, or nullptr
+    int object;            // Rows with the same machine and object are one interactive object
+    glm::vec3 pivot;       // Yaw, scale and the animated rotation turn about this point
+    glm::vec3 axis;        // Of the animated rotation
+};
+
+const SceneEntity sceneEntities[] = {
+    { HOUSE_MODEL, SCENE_STATIC | SCENE_OCCLUDER | SCENE_WALLS, -1, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 1.0f,
+        nullptr, 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+    { FLOOR_MODEL, SCENE_STATIC, -1, glm::vec3(0.0f, 0.34f, 0.0f), 0.0f, glm::vec3(5.0f, 1.0f, 5.0f), 1.0f,
+        nullptr, 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+    { GLASS_MODEL, SCENE_STATIC | SCENE_PORTAL, -1, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 0.5f,
+        nullptr, 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+    // The door swings about its hinge; it is a glass panel in a frame, so it joins the
+    // rooms even when shut
+    { DOOR_MODEL, SCENE_PORTAL | SCENE_ANIMATED, -1, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 1.0f,
+        "door", 0, glm::vec3(0.185f, 0.0f, 0.3f), glm::vec3(0.0f, -1.0f, 0.0f) },
+    // The chair turns about its front right leg
+    { CHAIR_MODEL, SCENE_ANIMATED, -1, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 1.0f,
+        "chair", 0, glm::vec3(0.3f, 0.0f, -0.4f), glm::vec3(0.0f, 1.0f, 0.0f) },
+    { SHOWER_MODEL, SCENE_ANIMATED, -1, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 1.0f,
+        "shower", 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+    // The second door model rides on the first
+    { DOOR2_MODEL, SCENE_PORTAL, 3, glm::vec3(0.0f), 0.0f, glm::vec3(1.0f), 0.5f,
+        "door", 0, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f) }
+};
+const size_t sceneEntityCount = sizeof(sceneEntities) / sizeof(sceneEntities[0]);
 
 // Window dimensions
 const GLuint WIDTH = 1600, HEIGHT = 1200;
@@ -49,6 +129,8 @@ float fov = 45.0f;               // Field of view
 // Mouse button states
 bool rightMousePressed = false;   // Right mouse button state
 bool leftMousePressed = false;    // Left mouse button state
+bool pickRequested = false;       // Left click waiting for a pick
+bool cursorMoved = false;         // Hover pick needed
 
 // Camera system variables
 glm::vec3 cameraPos = glm::vec3(0.0f, 1.0f, 8.0f);    // Camera position
@@ -57,53 +139,53 @@ glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);     // Camera up vector
 
 // Sunset effect variables
 float sunsetFactor = 0.0f;        // Current sunset progression (0-1)
-float sunsetSpeed = 0.05f;        // Speed of sunset transition
-bool isSunsetActive = false;      // Flag for active sunset transition
-bool keyTPressedLastFrame = false; // Previous frame T key state
 
 // Color definitions
 glm::vec3 dayColor(0.60f, 0.82f, 0.96f);     // Daytime sky color (light blue)
 glm::vec3 sunsetColor(0.96f, 0.64f, 0.38f);  // Sunset color (orange-red)
 
-// Door animation variables
-float doorAngle = 0.0f;          // Current door rotation angle (0-90)
-bool isDoorOpening = false;      // Flag for door opening state
-float doorOpenSpeed = 45.0f;     // Door opening speed (degrees per second)
-glm::vec3 doorPosition(0.0f, 0.0f, 0.0f); // Door position
+// Scene contents; the tweens animate their animators
+Entities entities;
 
-// Second door animation variables
-float door2Angle = 0.0f;          // Current second door rotation angle
-bool isDoor2Opening = false;      // Flag for second door opening state
-float door2OpenSpeed = 45.0f;     // Second door opening speed
-glm::vec3 door2Position(0.0f, 0.0f, 0.0f); // Second door position
+// Interactive objects are state machines defined in StateMachines.txt; their actions
+// start the tweens that move them
+StateMachines machines;
+int doorObject = -1, chairObject = -1, showerObject = -1, skyObject = -1, pipelineObject = -1;
+unsigned int toggleEvent = 0, sunsetEvent = 0;
+TweenEngine tweens;
+
+// Door animation variables
+float doorSwingTime = 2.0f;      // Seconds for a full swing (0-90 degrees)
 
 // Chair animation variables
-float chairRotation = 0.0f;                  // Current chair rotation in Y
-glm::vec3 chairPosition(0.0f, 0.0f, 0.0f);  // Initial chair position
-bool chairAdjusted = false;                 // Chair adjustment state
-float animSpeed = 1.8f;                      // Animation speed
-glm::vec3 chairTargetPosition(-1.8f, 0.0f, 0.0f); // Target position when adjusted
-glm::vec3 pivotOffset(0.3f, 0.0f, -0.4f);  // Pivot point (front right leg)
-float chairTargetRotation = -180.0f;        // Target rotation when adjusted
+float chairMoveTime = 1.0f;                  // Seconds to adjust or put back
+glm::vec3 chairTargetPosition(-1.8f, 0.0f, 0.0f); // Target offset when adjusted
+float chairTargetRotation = -50.0f;         // Target rotation when adjusted
 
 // Shower animation variables
-glm::vec3 showerPosition(0.0f, 0.0f, 0.0f);  // Initial shower position
-glm::vec3 showerTargetPosition(0.21f, 0.0f, -0.4f); // Closed position
-bool showerClosed = false;  // Shower state
-float showerSpeed = 2.0f;   // Movement speed
+glm::vec3 showerTargetPosition(0.21f, 0.0f, -0.4f); // Closed offset
+float showerSlideTime = 0.8f;  // Seconds to open or close
 
-// House position and rotation
-glm::vec3 housePos(0.0f, 0.0f, 0.0f);
-float houseRot = 0.0f;
+// Rendering pipeline: forward lighting.frag or the G-buffer and light volumes (key 5)
+bool deferredShading = false;
 
 // Time variables
 GLfloat deltaTime = 0.0f;    // Time between current frame and last frame
 GLfloat lastFrame = 0.0f;    // Time of last frame
 
+// Initializes GLFW for the lifetime of main. Declared before every GL-owning local, so
+// it is destroyed last: glfwTerminate() destroys the context, which the destructors of
+// the models, batch, streamer, uniform blocks, G-buffer and timers still need.
+struct GlfwSession
+{
+    GlfwSession() { glfwInit(); }
+    ~GlfwSession() { glfwTerminate(); }
+};
+
 int main()
 {
-    // Initialize GLFW
-    glfwInit();
+    // Initialize GLFW (terminated when main returns, on every path)
+    GlfwSession glfw;
 
     // Configure GLFW window hints
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -117,7 +199,6 @@ int main()
     if (nullptr == window)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
         return EXIT_FAILURE;
     }
 
@@ -138,23 +219,86 @@ int main()
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
-    // Create and compile shaders
-    Shader shader("Shader/modelLoading.vs", "Shader/modelLoading.frag");
-    Shader lightingShader("Shader/lighting.vs", "Shader/lighting.frag");
-    Shader lampShader("Shader/lamp.vs", "Shader/lamp.frag");
-
-    // Load 3D models
-    Model House((char*)"Models/casa.obj");
-    Model Floor((char*)"Models/piso.obj");
-    Model Glass((char*)"Models/Crystal.obj");
-    Model Door((char*)"Models/door.obj");
-    Model Door2((char*)"Models/door2.obj");
-    Model Chair((char*)"Models/chair.obj");
-    Model Shower((char*)"Models/shower.obj");
+    // Camera and light blocks are shared by every program
+    UniformBlock<CameraBlock> cameraBlock(CAMERA_BLOCK_BINDING);
+    UniformBlock<LightBlock> lightBlock(LIGHT_BLOCK_BINDING);
+
+    // Point lights are binned per view cluster on the occlusion workers
+    ThreadPool occlusionPool;
+    ClusteredLights pointLights(&occlusionPool);
+    SetupLights(lightBlock.Edit(), pointLights);
+    UpdateSunLight(lightBlock.Edit(), sunsetFactor);
+    float litSunsetFactor = sunsetFactor;
+
+    // Load shader programs from the binary cache, or start compiling them on the driver's
+    // threads while the models load. lighting.frag (and gbuffer.frag, for the deferred path)
+    // is specialised per material feature set for the lights set up above; every set is
+    // requested now and the unused ones dropped once the materials are known.
+    ProgramCache programCache;
+    ShaderProgram shader = programCache.Request("Shader/modelLoading.vs", "Shader/modelLoading.frag");
+    ShaderProgram lampShader = programCache.Request("Shader/lamp.vs", "Shader/lamp.frag");
+    ShaderProgram deferredLightShader = programCache.Request("Shader/deferredLight.vs", "Shader/deferredLight.frag");
+    ShaderProgram layerCopyShader = programCache.Request("Shader/layerCopy.vs", "Shader/layerCopy.frag");
+    LightingPermutations lighting(LightingPermutations::SceneFeatures(pointLights, lightBlock.Data()));
+    lighting.Request(programCache, "Shader/lighting.vs", "Shader/lighting.frag", "Shader/gbuffer.frag");
+
+    // Load 3D models (warm starts read Models/*.mcache instead of parsing the .obj)
+    CachedModel models[SCENE_MODEL_COUNT];
+    Entity rowEntities[sceneEntityCount];
+    CreateEntities(models, rowEntities);
+
+    // Parse on worker threads; GL uploads run here as each piece is ready.
+    // Textures keep streaming in during the main loop, showing placeholders until then.
+    ThreadPool loadPool;
+    TextureStreamer textureStreamer(loadPool);
+    ModelLoader loader(loadPool, textureStreamer);
+
+    // Static rows are baked into one world-space batch; the other models get buffers of
+    // their own and are drawn per entity
+    StaticBatch staticScene;
+    bool modelQueued[SCENE_MODEL_COUNT] = {};
+    for (size_t i = 0; i < sceneEntityCount; i++) {
+        const SceneEntity& row = sceneEntities[i];
+        if (row.flags & SCENE_STATIC)
+            loader.AddStatic(models[row.model], sceneModelPaths[row.model], staticScene,
+                entities.Transform(rowEntities[i]).world, row.alpha);
+        else if (!modelQueued[row.model])
+            loader.Add(models[row.model], sceneModelPaths[row.model]);
+        modelQueued[row.model] = true;
+    }
+    loader.Run();
+    staticScene.Build();
+    entities.UpdateBounds();
+
+    // Picking: static models at their baked transforms, movable ones refit every frame.
+    // From inside the house its walls hide most of the scene: rasterize the largest
+    // house triangles on the CPU each frame and skip whatever they cover.
+    // Rooms are found from the house walls at eye level; window glass and the doorway
+    // join them (at their load-time place, whatever the door angle).
+    ScenePicker picker;
+    OcclusionBuffer occlusion(&occlusionPool);
+    PortalCells cells;
+    for (size_t i = 0; i < sceneEntityCount; i++) {
+        const SceneEntity& row = sceneEntities[i];
+        const TriangleBvh& bvh = models[row.model].bvh;
+        const glm::mat4& world = entities.Transform(rowEntities[i]).world;
+        if (row.flags & SCENE_STATIC)
+            picker.Add(bvh, world);
+        if (row.flags & SCENE_OCCLUDER)
+            occlusion.AddOccluders(bvh, world, 2048);
+        if (row.flags & SCENE_WALLS)
+            cells.AddWalls(bvh, world);
+        if (row.flags & SCENE_PORTAL)
+            cells.AddPortals(bvh, world);
+    }
+    entities.AddToPicker(picker);
+    picker.Build();
+    cells.Build(0.6f, 2.0f);
+    float lastOcclusionMicros = 0.0f;
 
-    // Initialize projection matrix
-    glm::mat4 projection = glm::perspective(glm::radians(fov),
-        (GLfloat)SCREEN_WIDTH / (GLfloat)SCREEN_HEIGHT, 0.1f, 100.0f);
+    GLFWcursor* handCursor = glfwCreateStandardCursor(GLFW_HAND_CURSOR);
+    int hoveredObject = -1;
+    float lastPickMicros = 0.0f;
 
     // Set GLFW callbacks
     glfwSetCursorPosCallback(window, MouseCallback);
@@ -167,14 +311,67 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    // Set texture units for lighting shader
-    lightingShader.Use();
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "Material.difuse"), 0);
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "Material.specular"), 1);
+    // Keep the lighting variants the loaded materials use
+    bool shadersBuilt = programCache.Finish();
+    if (!shadersBuilt)
+    {
+        programCache.PrintStats();
+        return EXIT_FAILURE;
+    }
+    lighting.Count(staticScene);
+    entities.Each(Entities::RENDERABLE, [&lighting](Entities::Chunk& chunk) {
+        for (size_t i = 0; i < chunk.count; i++)
+            lighting.Count(*chunk.renderables[i].model, chunk.renderables[i].alpha);
+    });
+    lighting.Select(programCache);
+    programCache.PrintStats();
+    lighting.PrintStats();
+
+    GLuint programs[] = { shader.Program, lampShader.Program, deferredLightShader.Program };
+    for (GLuint program : programs) {
+        cameraBlock.Attach(program, "Camera");
+        lightBlock.Attach(program, "Lights");
+    }
+    for (size_t i = 0; i < lighting.VariantCount(); i++) {
+        cameraBlock.Attach(lighting.Program(i), "Camera");
+        lightBlock.Attach(lighting.Program(i), "Lights");
+    }
+    for (size_t i = 0; i < lighting.GeometryVariantCount(); i++)
+        cameraBlock.Attach(lighting.GeometryProgram(i), "Camera");
+
+    // Resolve every uniform the loop writes once, up front; each material gets its variant
+    RenderQueue renderQueue(textureStreamer);
+    lighting.Register(renderQueue);
+    std::vector<unsigned int> staticPrograms = lighting.Programs(staticScene);
+    entities.Each(Entities::RENDERABLE, [&lighting](Entities::Chunk& chunk) {
+        for (size_t i = 0; i < chunk.count; i++)
+            chunk.renderables[i].programs = lighting.Programs(*chunk.renderables[i].model, chunk.renderables[i].alpha);
+    });
+    LodSelector lodSelector;
+
+    // The deferred path draws opaque packets with the G-buffer variants instead
+    std::vector<unsigned int> geometryPrograms = lighting.GeometryPrograms();
+    ShaderUniforms deferredLightUniforms(deferredLightShader.Program);
+    DeferredRenderer deferred(deferredLightUniforms, SCREEN_WIDTH, SCREEN_HEIGHT);
+    GpuTimer sceneTimer;
+
+    // Doors, chair, shower, sky and pipeline
+    if (!SetupStateMachines(deferred, rowEntities))
+    {
+        return EXIT_FAILURE;
+    }
+    entities.PrintStats();
+
+    bool texturesReported = false;
+    bool uniformLookupsReported = false;
+    float lastStatsTime = 0.0f;
 
     // Main game loop
     while (!glfwWindowShouldClose(window))
     {
+        // Nothing inside a frame may resolve a uniform by name
+        UniformLookups() = 0;
+
         // Calculate delta time
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -186,136 +383,124 @@ int main()
         // Poll events
         glfwPollEvents();
 
-        // Sunset effect logic
-        if (isSunsetActive) {
-            sunsetFactor += sunsetSpeed * deltaTime;
-
-            // Reset when sunset completes
-            if (sunsetFactor >= 1.0f) {
-                sunsetFactor = 0.0f;
-                isSunsetActive = false;
-            }
+        // Upload any textures that finished decoding, and copy them into the static
+        // batch's array layers
+        textureStreamer.Update();
+        staticScene.UpdateTextures(textureStreamer, layerCopyShader.Program);
+        if (!texturesReported && textureStreamer.Idle()) {
+            textureStreamer.PrintStats();
+            staticScene.PrintStats();
+            texturesReported = true;
         }
 
+        // State changes from input and picking, and timed ones like the sunset's end
+        machines.Update(deltaTime);
+
         // Set clear color based on sunset progression
         glm::vec3 currentColor = glm::mix(dayColor, sunsetColor, sunsetFactor);
         glClearColor(currentColor.r, currentColor.g, currentColor.b, 1.0f);
 
+        // Lights only go back to the GPU when the sunset moved the sun
+        if (sunsetFactor != litSunsetFactor) {
+            UpdateSunLight(lightBlock.Edit(), sunsetFactor);
+            litSunsetFactor = sunsetFactor;
+        }
+        lightBlock.Upload();
+
         // Update animations
-        Animation();
+        tweens.Update(deltaTime);
+
+        // Matrices and boxes of whatever moved, shared by picking and drawing
+        entities.Animate();
+        entities.UpdatePicker(picker);
+        picker.Refit();
 
         // Clear buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Use shader program
-        shader.Use();
-
-        // Update projection matrix if FOV changed
-        projection = glm::perspective(glm::radians(fov),
+        // One buffer update per frame feeds view/projection to every program
+        CameraBlock& cameraData = cameraBlock.Edit();
+        cameraData.view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        cameraData.projection = glm::perspective(glm::radians(fov),
             (GLfloat)SCREEN_WIDTH / (GLfloat)SCREEN_HEIGHT, 0.1f, 100.0f);
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "projection"),
-            1, GL_FALSE, glm::value_ptr(projection));
-
-        // Create view matrix
-        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "view"),
-            1, GL_FALSE, glm::value_ptr(view));
-
-        lightingShader.Use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.GetZoom()),
-            (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "view"),
-            1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "projection"),
-            1, GL_FALSE, glm::value_ptr(projection));
-
-        // Draw FLOOR (opaque)
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.34f, 0.0f));
-        model = glm::scale(model, glm::vec3(5.0f, 1.0f, 5.0f));
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 0);
-        Floor.Draw(lightingShader);
-
-        // Draw DOOR 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, doorPosition);
-
-        const float hingeOffsetX = 0.37f;
-        const float hingeOffsetY = 0.0f;
-        const float hingeOffsetZ = 0.3f;
-
-        model = glm::translate(model, glm::vec3(hingeOffsetX / 2, hingeOffsetY, hingeOffsetZ));
-        model = glm::rotate(model, glm::radians(doorAngle), glm::vec3(0.0f, -1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(-hingeOffsetX / 2, -hingeOffsetY, -hingeOffsetZ));
-
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        Door.Draw(lightingShader);
-
-        // Draw CHAIR with rotation around leg
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, chairPosition);
-        model = glm::translate(model, pivotOffset);
-        model = glm::rotate(model, glm::radians(chairRotation), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, -pivotOffset);
-
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        Chair.Draw(lightingShader);
-
-        // Draw SHOWER (translation only)
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, showerPosition);
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 0);
-        Shower.Draw(lightingShader);
-
-        // Draw HOUSE (opaque)
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, housePos);
-        model = glm::rotate(model, glm::radians(houseRot), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 0);
-        House.Draw(lightingShader);
-
-        // Draw GLASS (transparent)
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        model = glm::mat4(1.0f);
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 1);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "alpha"), 0.5f);
-        Glass.Draw(lightingShader);
-        glDisable(GL_BLEND);
-
-        //// Draw SECOND DOOR (transparent)
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, doorPosition);
-
-        model = glm::translate(model, glm::vec3(hingeOffsetX / 2, hingeOffsetY, hingeOffsetZ));
-        model = glm::rotate(model, glm::radians(doorAngle), glm::vec3(0.0f, -1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(-hingeOffsetX / 2, -hingeOffsetY, -hingeOffsetZ));
-
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program, "model"),
-            1, GL_FALSE, glm::value_ptr(model));
-        glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 1);
-        glUniform1f(glGetUniformLocation(lightingShader.Program, "alpha"), 0.5f);
-        Door2.Draw(lightingShader);
-        glDisable(GL_BLEND);
+        cameraData.viewProjection = cameraData.projection * cameraData.view;
+        cameraData.viewPos = cameraPos;
+        cameraBlock.Upload();
+
+        // Hover and click picking under the cursor
+        if (cursorMoved || pickRequested) {
+            double pickStart = glfwGetTime();
+            glm::vec3 rayOrigin, rayDirection;
+            CursorRay(window, cameraData.viewProjection, rayOrigin, rayDirection);
+
+            int hit = -1;
+            ScenePicker::Hit pick;
+            if (picker.Cast(rayOrigin, rayDirection, pick))
+                hit = entities.PickedObject(pick.object);
+            lastPickMicros = (float)((glfwGetTime() - pickStart) * 1e6);
+
+            if (hit != hoveredObject) {
+                glfwSetCursor(window, hit >= 0 ? handCursor : nullptr);
+                hoveredObject = hit;
+            }
+            if (pickRequested && hit >= 0)
+                machines.Send(hit, toggleEvent);
+            cursorMoved = pickRequested = false;
+        }
+
+        double occlusionStart = glfwGetTime();
+        cells.Update(cameraPos, cameraData.viewProjection);
+        occlusion.Render(cameraData.viewProjection);
+        pointLights.Update(cameraData.view, cameraData.projection, SCREEN_WIDTH, SCREEN_HEIGHT);
+        lastOcclusionMicros = (float)((glfwGetTime() - occlusionStart) * 1e6);
+
+        // Submit the scene; the queue orders the draws and their state changes
+        sceneTimer.Begin();
+        lighting.BindLights(pointLights);
+        lodSelector.Begin(cameraPos, cameraData.projection, SCREEN_HEIGHT);
+        renderQueue.Begin(cameraPos, cameraData.viewProjection, &occlusion, &cells, &lodSelector);
+        renderQueue.Submit(staticScene, staticPrograms);
+        entities.Submit(renderQueue, Frustum(cameraData.viewProjection));
+        bool deferredFrame = deferredShading && deferred.Valid();
+        if (deferredFrame) {
+            // Opaque into the G-buffer, lights as volumes, then glass forward on top
+            deferred.BeginGeometry();
+            renderQueue.Flush(RenderQueue::OPAQUE_PASS, &geometryPrograms);
+            deferred.Shade(pointLights, lightBlock.Data().spotLight, cameraData.viewProjection);
+            renderQueue.Flush(RenderQueue::TRANSPARENT_PASS);
+            deferred.Present();
+        }
+        else {
+            renderQueue.Flush();
+        }
+        sceneTimer.End();
+
+        // Culling and batching counters, refreshed twice a second
+        if (currentFrame - lastStatsTime >= 0.5f) {
+            std::ostringstream title;
+            title << "State Machine Animation | entities " << entities.VisibleEntities() << "/" << entities.DrawnEntities()
+                << " (moved " << entities.MovedEntities() << ")"
+                << " | visible " << renderQueue.VisibleMeshes()
+                << " culled " << renderQueue.CulledMeshes() << " (occluded " << renderQueue.OccludedMeshes()
+                << ") | rooms " << cells.VisibleCells() << "/" << cells.CellCount()
+                << " | draws " << renderQueue.DrawCalls() << " | triangles " << renderQueue.Triangles()
+                << " | lights " << pointLights.Count() << " (max " << pointLights.MaxPerCluster() << "/cluster)"
+                << " | " << (deferredFrame ? "deferred " : "forward ") << sceneTimer.Milliseconds() << " ms GPU"
+                << " | occlusion " << (int)lastOcclusionMicros
+                << " us | pick " << (int)lastPickMicros << " us";
+            glfwSetWindowTitle(window, title.str().c_str());
+            lastStatsTime = currentFrame;
+        }
+
+        if (UniformLookups() != 0 && !uniformLookupsReported) {
+            std::cout << "WARNING::SHADER:: " << UniformLookups() << " uniform lookups in one frame" << std::endl;
+            uniformLookupsReported = true;
+        }
 
         glfwSwapBuffers(window);
     }
 
-    // Clean up
-    glfwTerminate();
+    // GL objects are released in reverse order of declaration, then glfw terminates
     return 0;
 }
 
@@ -344,80 +529,247 @@ void Inputs(GLFWwindow* window, float deltaTime) {
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
         cameraPos += cameraSpeed * cameraUp;
 
-    // Key '1' to open/close door
-    static bool key1PressedLastFrame = false;
-    bool key1PressedThisFrame = (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS);
-
-    if (key1PressedThisFrame && !key1PressedLastFrame) {
-        isDoorOpening = !isDoorOpening;
-        isDoor2Opening = !isDoor2Opening;
+    // Keys 1-5 send their event once per press: door, chair, shower, sunset and the
+    // forward/deferred pipeline
+    static const int actionKeys[] = { GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5 };
+    static void (* const keyActions[])() = { ToggleDoors, ToggleChair, ToggleShower, StartSunset, TogglePipeline };
+    static bool keyPressedLastFrame[5] = {};
+    for (int i = 0; i < 5; i++) {
+        bool keyPressedThisFrame = (glfwGetKey(window, actionKeys[i]) == GLFW_PRESS);
+        if (keyPressedThisFrame && !keyPressedLastFrame[i])
+            keyActions[i]();
+        keyPressedLastFrame[i] = keyPressedThisFrame;
     }
-    key1PressedLastFrame = key1PressedThisFrame;
+}
 
-    // Key '2' to toggle chair adjustment
-    static bool key2PressedLastFrame = false;
-    bool key2PressedThisFrame = (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS);
+// Interactions, bound to keys 1-5 and to clicking the objects; the machines decide.
+// A scene without the object ignores its key.
+void ToggleDoors() {
+    if (doorObject >= 0)
+        machines.Send(doorObject, toggleEvent);
+}
 
-    if (key2PressedThisFrame && !key2PressedLastFrame) {
-        chairAdjusted = !chairAdjusted;
-    }
-    key2PressedLastFrame = key2PressedThisFrame;
+void ToggleChair() {
+    if (chairObject >= 0)
+        machines.Send(chairObject, toggleEvent);
+}
 
-    // Key '3' to open/close shower
-    static bool key3PressedLastFrame = false;
-    bool key3PressedThisFrame = (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS);
+void ToggleShower() {
+    if (showerObject >= 0)
+        machines.Send(showerObject, toggleEvent);
+}
 
-    if (key3PressedThisFrame && !key3PressedLastFrame) {
-        showerClosed = !showerClosed;
-    }
-    key3PressedLastFrame = key3PressedThisFrame;
+void StartSunset() {
+    machines.Send(skyObject, sunsetEvent);
+}
 
-    // Key '4' for sunset effect
-    bool keyTPressedThisFrame = (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS);
-    if (keyTPressedThisFrame && !keyTPressedLastFrame) {
-        isSunsetActive = true;
+void TogglePipeline() {
+    machines.Send(pipelineObject, toggleEvent);
+}
+
+// The animated entities of the object swing (the rest ride on them); reversed halfway, a
+// door takes half a swing to get back
+static void SwingDoors(unsigned int object, float targetAngle) {
+    for (Entity entity : entities.ObjectEntities(object)) {
+        if (!entities.Has(entity, Entities::ANIMATOR))
+            continue;
+        float& angle = entities.Animator(entity).angle;
+        tweens.To(&angle, targetAngle, doorSwingTime * std::abs(targetAngle - angle) / 90.0f, TWEEN_SINE_IN_OUT);
     }
-    keyTPressedLastFrame = keyTPressedThisFrame;
 }
 
-// Animation update function
-void Animation() {
-    // Door animation
-    if (isDoorOpening) {
-        doorAngle += doorOpenSpeed * deltaTime;
-        if (doorAngle >= 90.0f) doorAngle = 90.0f;
+static void MoveObject(unsigned int object, float angle, const glm::vec3& offset, float duration, TweenEasing easing) {
+    for (Entity entity : entities.ObjectEntities(object)) {
+        if (!entities.Has(entity, Entities::ANIMATOR))
+            continue;
+        AnimatorComponent& animator = entities.Animator(entity);
+        tweens.To(&animator.angle, angle, duration, easing);
+        tweens.To(&animator.offset, offset, duration, easing);
     }
-    else {
-        doorAngle -= doorOpenSpeed * deltaTime;
-        if (doorAngle <= 0.0f) doorAngle = 0.0f;
+}
+
+// Binds the actions and guards StateMachines.txt names, then creates the machine objects:
+// the sky, the pipeline and one per interactive group of scene rows
+bool SetupStateMachines(const DeferredRenderer& deferred, const Entity rowEntities[]) {
+    machines.AddAction("openDoor", [](unsigned int object) { SwingDoors(object, 90.0f); });
+    machines.AddAction("closeDoor", [](unsigned int object) { SwingDoors(object, 0.0f); });
+    machines.AddAction("adjustChair", [](unsigned int object) {
+        MoveObject(object, chairTargetRotation, chairTargetPosition, chairMoveTime, TWEEN_CUBIC_IN_OUT);
+    });
+    machines.AddAction("returnChair", [](unsigned int object) {
+        MoveObject(object, 0.0f, glm::vec3(0.0f), chairMoveTime, TWEEN_CUBIC_IN_OUT);
+    });
+    machines.AddAction("closeShower", [](unsigned int object) {
+        MoveObject(object, 0.0f, showerTargetPosition, showerSlideTime, TWEEN_QUADRATIC_IN_OUT);
+    });
+    machines.AddAction("openShower", [](unsigned int object) {
+        MoveObject(object, 0.0f, glm::vec3(0.0f), showerSlideTime, TWEEN_QUADRATIC_IN_OUT);
+    });
+
+    // The sunset lasts as long as the state's timer
+    machines.AddAction("startSunset", [](unsigned int object) {
+        tweens.To(&sunsetFactor, 1.0f, machines.TimeLeft(object), TWEEN_LINEAR);
+    });
+    machines.AddAction("endSunset", [](unsigned int) {
+        tweens.Stop(&sunsetFactor);
+        sunsetFactor = 0.0f;
+    });
+
+    machines.AddAction("useDeferred", [](unsigned int) {
+        deferredShading = true;
+        std::cout << "Pipeline: deferred" << std::endl;
+    });
+    machines.AddAction("useForward", [](unsigned int) {
+        deferredShading = false;
+        std::cout << "Pipeline: forward" << std::endl;
+    });
+    machines.AddGuard("deferredAvailable", [&deferred](unsigned int) { return deferred.Valid(); });
+
+    if (!machines.Load("StateMachines.txt"))
+        return false;
+
+    toggleEvent = machines.Event("toggle");
+    sunsetEvent = machines.Event("sunset");
+    skyObject = machines.Create("sky");
+    pipelineObject = machines.Create("pipeline");
+    if (skyObject < 0 || pipelineObject < 0)
+        return false;
+
+    std::map<std::pair<std::string, int>, int> objects;
+    for (size_t i = 0; i < sceneEntityCount; i++) {
+        const SceneEntity& row = sceneEntities[i];
+        if (!row.machine)
+            continue;
+
+        std::pair<std::string, int> key(row.machine, row.object);
+        std::map<std::pair<std::string, int>, int>::iterator found = objects.find(key);
+        if (found == objects.end()) {
+            int object = machines.Create(row.machine);
+            if (object < 0) {
+                std::cout << "ERROR::SCENE:: No state machine " << row.machine << std::endl;
+                return false;
+            }
+            found = objects.insert(std::make_pair(key, object)).first;
+        }
+        entities.BindObject(rowEntities[i], found->second);
     }
 
-    // Second door animation
-    if (isDoor2Opening) {
-        door2Angle += door2OpenSpeed * deltaTime;
-        if (door2Angle >= 90.0f) door2Angle = 90.0f;
+    // Keys 1-3 work the first door, chair and shower
+    std::map<std::pair<std::string, int>, int>::iterator door = objects.find(std::make_pair(std::string("door"), 0));
+    std::map<std::pair<std::string, int>, int>::iterator chair = objects.find(std::make_pair(std::string("chair"), 0));
+    std::map<std::pair<std::string, int>, int>::iterator shower = objects.find(std::make_pair(std::string("shower"), 0));
+    doorObject = door != objects.end() ? door->second : -1;
+    chairObject = chair != objects.end() ? chair->second : -1;
+    showerObject = shower != objects.end() ? shower->second : -1;
+    return true;
+}
+
+// One entity per scene row, placed; static rows only need the placement and must not
+// ride on moving ones
+void CreateEntities(CachedModel models[], Entity rowEntities[]) {
+    for (size_t i = 0; i < sceneEntityCount; i++) {
+        const SceneEntity& row = sceneEntities[i];
+        unsigned int components = Entities::TRANSFORM;
+        if (!(row.flags & SCENE_STATIC))
+            components |= Entities::RENDERABLE | Entities::BOUNDS;
+        if (row.machine)
+            components |= Entities::INTERACTABLE;
+        if (row.flags & SCENE_ANIMATED)
+            components |= Entities::ANIMATOR;
+
+        Entity entity = entities.Create(components);
+        rowEntities[i] = entity;
+
+        TransformComponent& transform = entities.Transform(entity);
+        transform.position = row.position;
+        transform.rotation = glm::angleAxis(glm::radians(row.yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        transform.scale = row.scale;
+        transform.pivot = row.pivot;
+        if (row.parent >= (int)i)
+            std::cout << "WARNING::SCENE:: Row " << i << " is placed on a later row; placing it in the world" << std::endl;
+        else if (row.parent >= 0)
+            entities.SetParent(entity, rowEntities[row.parent]);
+
+        if (components & Entities::RENDERABLE) {
+            RenderableComponent& renderable = entities.Renderable(entity);
+            renderable.model = &models[row.model];
+            renderable.alpha = row.alpha;
+        }
+        if (components & Entities::ANIMATOR)
+            entities.Animator(entity).axis = row.axis;
     }
-    else {
-        door2Angle -= door2OpenSpeed * deltaTime;
-        if (door2Angle <= 0.0f) door2Angle = 0.0f;
+    entities.Animate();
+}
+
+// World-space ray through the cursor (the screen centre while the cursor is captured)
+void CursorRay(GLFWwindow* window, const glm::mat4& viewProjection, glm::vec3& origin, glm::vec3& direction) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    double x = width * 0.5, y = height * 0.5;
+    if (!rightMousePressed)
+        glfwGetCursorPos(window, &x, &y);
+
+    float ndcX = (float)(2.0 * x / width - 1.0);
+    float ndcY = (float)(1.0 - 2.0 * y / height);
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+}
+
+// Fixed scene lights: four warm interior point lights and a porch spot light
+void SetupLights(LightBlock& lights, ClusteredLights& pointLights) {
+    const glm::vec3 pointLightPositions[] = {
+        glm::vec3(-1.5f, 2.0f, -1.5f),
+        glm::vec3(1.5f, 2.0f, -1.5f),
+        glm::vec3(-1.5f, 2.0f, 1.5f),
+        glm::vec3(1.5f, 2.0f, 1.5f)
+    };
+
+    for (const glm::vec3& position : pointLightPositions) {
+        PointLight light;
+        light.position = position;
+        light.radius = 6.0f;
+        light.constant = 1.0f;
+        light.linear = 0.09f;
+        light.quadratic = 0.032f;
+        light.ambient = glm::vec3(0.02f);
+        light.diffuse = glm::vec3(0.5f, 0.45f, 0.35f);
+        light.specular = glm::vec3(0.3f);
+        pointLights.Add(light);
     }
 
-    // Chair rotation and movement
-    float targetRotation = chairAdjusted ? -50.0f : 0.0f;
-    glm::vec3 targetPosition = chairAdjusted ? chairTargetPosition : glm::vec3(0.0f);
+    SpotLightBlock& spot = lights.spotLight;
+    spot.position = glm::vec3(0.0f, 2.5f, 1.5f);
+    spot.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    spot.cutOff = glm::cos(glm::radians(12.5f));
+    spot.outerCutOff = glm::cos(glm::radians(17.5f));
+    spot.constant = 1.0f;
+    spot.linear = 0.09f;
+    spot.quadratic = 0.032f;
+    spot.ambient = glm::vec3(0.0f);
+    spot.diffuse = glm::vec3(0.8f, 0.75f, 0.6f);
+    spot.specular = glm::vec3(0.5f);
+}
 
-    // Smooth interpolation for both rotation and position
-    chairRotation = glm::mix(chairRotation, targetRotation, animSpeed * deltaTime * 2.0f);
-    chairPosition = glm::mix(chairPosition, targetPosition, animSpeed * deltaTime * 1.5f);
+// Sun colour and height follow the sunset progression (0 = day, 1 = dusk)
+void UpdateSunLight(LightBlock& lights, float factor) {
+    glm::vec3 sunColor = glm::mix(glm::vec3(1.0f, 0.98f, 0.92f), sunsetColor, factor);
+    glm::vec3 skyColor = glm::mix(dayColor, sunsetColor, factor);
 
-    // Shower animation
-    glm::vec3 targetShowerPos = showerClosed ? showerTargetPosition : glm::vec3(0.0f);
-    showerPosition = glm::mix(showerPosition, targetShowerPos, showerSpeed * deltaTime);
+    DirLightBlock& sun = lights.dirLight;
+    sun.direction = glm::normalize(glm::mix(glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(-1.0f, -0.25f, -0.3f), factor));
+    sun.ambient = skyColor * 0.3f;
+    sun.diffuse = sunColor * glm::mix(0.8f, 0.4f, factor);
+    sun.specular = sunColor * 0.5f;
 }
 
 // Mouse movement callback
 void MouseCallback(GLFWwindow* window, double xPos, double yPos)
 {
+    cursorMoved = true;
+
     if (firstMouse)
     {
         lastX = xPos;
@@ -469,8 +821,10 @@ void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 
     // Left mouse button handling
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
-        if (action == GLFW_PRESS)
+        if (action == GLFW_PRESS) {
             leftMousePressed = true;
+            pickRequested = true;
+        }
         else if (action == GLFW_RELEASE)
             leftMousePressed = false;
     }
@@ -0,0 +1,276 @@
+#pragma once
+
+// Import-time index and vertex ordering for the GPU caches
+// - Weld(): assimp gives every face corner its own vertex; identical ones are merged so
+//   the post-transform cache has something to reuse.
+// - OrderTriangles(): Tipsify (Sander, Nehab & Barczak 2007) walks the mesh in fans
+//   around recently used vertices, which keeps them in a FIFO cache of CACHE_SIZE. The
+//   walk breaks into clusters wherever it has to jump; clusters facing away from the
+//   mesh centre are drawn first, since they tend to hide the ones facing in (overdraw).
+// - OrderVertices(): renumbers vertices in first-use order, so fetches stream forward.
+// Simulate() gives the ACMR (cache misses per triangle) and ATVR (misses per vertex)
+// that ModelCache reports for each asset.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+class MeshOptimizer
+{
+public:
+    static const int CACHE_SIZE = 16;
+
+    struct CacheStats
+    {
+        size_t triangles;
+        size_t vertices;  // Distinct vertices referenced
+        size_t misses;
+
+        double Acmr() const { return this->triangles ? (double)this->misses / this->triangles : 0.0; }
+        double Atvr() const { return this->vertices ? (double)this->misses / this->vertices : 0.0; }
+    };
+
+    // FIFO post-transform cache of CACHE_SIZE entries, as on most GPUs
+    static CacheStats Simulate(const uint32_t* indices, size_t indexCount, size_t vertexCount)
+    {
+        CacheStats stats = { indexCount / 3, 0, 0 };
+        std::vector<int> timestamp(vertexCount, -CACHE_SIZE - 1);
+        std::vector<bool> seen(vertexCount, false);
+        int time = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            uint32_t v = indices[i];
+            if (!seen[v]) {
+                seen[v] = true;
+                stats.vertices++;
+            }
+            // A vertex stays cached until CACHE_SIZE misses have come after it
+            if (time - timestamp[v] > CACHE_SIZE) {
+                timestamp[v] = time++;
+                stats.misses++;
+            }
+        }
+        return stats;
+    }
+
+    // Merges bitwise-identical vertices; indices are rewritten to the survivors
+    template <typename Vertex>
+    static void Weld(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        std::vector<uint32_t> order(vertices.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (uint32_t)i;
+        std::sort(order.begin(), order.end(), [&vertices](uint32_t a, uint32_t b) {
+            int compare = std::memcmp(&vertices[a], &vertices[b], sizeof(Vertex));
+            return compare < 0 || (compare == 0 && a < b);
+        });
+
+        // Each vertex maps to the first of its identical run, kept in original order
+        std::vector<uint32_t> remap(vertices.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            bool same = i > 0 && std::memcmp(&vertices[order[i]], &vertices[order[i - 1]], sizeof(Vertex)) == 0;
+            remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+        }
+
+        std::vector<uint32_t> packed(vertices.size());
+        size_t kept = 0;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            if (remap[i] == i) {
+                packed[i] = (uint32_t)kept;
+                vertices[kept++] = vertices[i];
+            }
+        }
+        vertices.resize(kept);
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = packed[remap[indices[i]]];
+    }
+
+    // Reorders the triangles of indices[0, indexCount) for the vertex cache and overdraw
+    static void OrderTriangles(uint32_t* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount)
+    {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount < 2)
+            return;
+
+        std::vector<uint32_t> order;
+        std::vector<size_t> clusterStarts;
+        tipsify(indices, triangleCount, vertexCount, order, clusterStarts);
+        sortClusters(indices, positions, order, clusterStarts);
+
+        std::vector<uint32_t> reordered(triangleCount * 3);
+        for (size_t t = 0; t < triangleCount; t++)
+            std::memcpy(&reordered[t * 3], &indices[order[t] * 3], 3 * sizeof(uint32_t));
+        std::memcpy(indices, reordered.data(), reordered.size() * sizeof(uint32_t));
+    }
+
+    // Renumbers vertices by first use in indices (every LOD, finest first); unreferenced
+    // vertices keep their relative order at the end
+    template <typename Vertex>
+    static void OrderVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        const uint32_t UNUSED = ~0u;
+        std::vector<uint32_t> remap(vertices.size(), UNUSED);
+        uint32_t next = 0;
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (remap[indices[i]] == UNUSED)
+                remap[indices[i]] = next++;
+        }
+        for (size_t v = 0; v < vertices.size(); v++) {
+            if (remap[v] == UNUSED)
+                remap[v] = next++;
+        }
+
+        std::vector<Vertex> reordered(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            reordered[remap[v]] = vertices[v];
+        vertices.swap(reordered);
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+    }
+
+private:
+    // Triangle order plus the positions where the walk had to jump (cluster starts)
+    static void tipsify(const uint32_t* indices, size_t triangleCount, size_t vertexCount,
+        std::vector<uint32_t>& order, std::vector<size_t>& clusterStarts)
+    {
+        // Triangles around each vertex
+        std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            firstTriangle[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            firstTriangle[v + 1] += firstTriangle[v];
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+        std::vector<uint32_t> live(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            live[v] = firstTriangle[v + 1] - firstTriangle[v];
+
+        std::vector<int> timestamp(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnds, candidates;
+        int time = CACHE_SIZE + 1;
+        size_t cursor = 0;
+
+        order.clear();
+        clusterStarts.clear();
+        int fan = nextLive(live, cursor);
+        clusterStarts.push_back(0);
+        while (fan >= 0) {
+            candidates.clear();
+            for (uint32_t a = firstTriangle[fan]; a < firstTriangle[fan + 1]; a++) {
+                uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[t * 3 + k];
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - timestamp[v] > CACHE_SIZE)
+                        timestamp[v] = time++;
+                }
+                emitted[t] = true;
+                order.push_back(t);
+            }
+
+            // Next fan: the candidate that stays cached longest while its fan is emitted
+            int best = -1, bestPriority = -1;
+            for (size_t c = 0; c < candidates.size(); c++) {
+                uint32_t v = candidates[c];
+                if (live[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - timestamp[v] + 2 * (int)live[v] <= CACHE_SIZE)
+                    priority = time - timestamp[v];
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    best = (int)v;
+                }
+            }
+
+            // Dead end: back to a recent vertex with triangles left, else the next one
+            // in index order; either way the cache is cold, so a cluster starts here
+            if (best < 0) {
+                while (!deadEnds.empty() && best < 0) {
+                    uint32_t v = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (live[v] > 0)
+                        best = (int)v;
+                }
+                if (best < 0)
+                    best = nextLive(live, cursor);
+                if (best >= 0 && order.size() < triangleCount)
+                    clusterStarts.push_back(order.size());
+            }
+            fan = best;
+        }
+    }
+
+    static int nextLive(const std::vector<uint32_t>& live, size_t& cursor)
+    {
+        while (cursor < live.size()) {
+            if (live[cursor] > 0)
+                return (int)cursor;
+            cursor++;
+        }
+        return -1;
+    }
+
+    // Clusters facing out of the mesh go first: dot(centroid - mesh centre, normal),
+    // both area-weighted, largest first
+    static void sortClusters(const uint32_t* indices, const glm::vec3* positions, std::vector<uint32_t>& order,
+        const std::vector<size_t>& clusterStarts)
+    {
+        size_t clusterCount = clusterStarts.size();
+        if (clusterCount < 2)
+            return;
+
+        std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f)), normal(clusterCount, glm::vec3(0.0f));
+        std::vector<float> area(clusterCount, 0.0f);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : order.size();
+            for (size_t i = clusterStarts[c]; i < end; i++) {
+                const uint32_t* triangle = &indices[order[i] * 3];
+                glm::vec3 a = positions[triangle[0]], b = positions[triangle[1]], d = positions[triangle[2]];
+                glm::vec3 cross = glm::cross(b - a, d - a);
+                float weight = glm::length(cross);
+                centroid[c] += (a + b + d) * (weight / 3.0f);
+                normal[c] += cross;
+                area[c] += weight;
+            }
+            meshCentroid += centroid[c];
+            meshArea += area[c];
+        }
+        if (meshArea <= 0.0f)
+            return;
+        meshCentroid /= meshArea;
+
+        std::vector<std::pair<float, size_t> > keys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            float facing = 0.0f;
+            float length = glm::length(normal[c]);
+            if (area[c] > 0.0f && length > 0.0f)
+                facing = glm::dot(centroid[c] / area[c] - meshCentroid, normal[c] / length);
+            keys[c] = std::make_pair(-facing, c);
+        }
+        std::stable_sort(keys.begin(), keys.end());
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(order.size());
+        for (size_t k = 0; k < clusterCount; k++) {
+            size_t c = keys[k].second;
+            size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : order.size();
+            sorted.insert(sorted.end(), order.begin() + clusterStarts[c], order.begin() + end);
+        }
+        order.swap(sorted);
+    }
+};
@@ -0,0 +1,379 @@
+#pragma once
+
+// Quadric-error mesh simplification (Garland & Heckbert), for import-time LODs
+// Vertices are welded by position for the topology, and each collapse merges one vertex
+// into a neighbour, so LODs index the original vertices plus a few new corners.
+// - Material borders: a mesh's open edges never move, so neighbouring meshes (one per
+//   material) still meet exactly.
+// - UV seams: SketchUp exports map each face on its own, so most corners are seams. A
+//   face keeps its own mapping through every collapse: a corner moved onto a neighbour
+//   gets the UV that face's mapping gives at the new position (a new vertex if no
+//   existing one matches), and textures never slide across a seam.
+// Simplify() can be called again with a lower target to continue from the last LOD.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+class MeshSimplifier
+{
+public:
+    // Attributes of every vertex; collapses append new corners here
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;
+
+    MeshSimplifier(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+        const std::vector<glm::vec2>& texCoords, const std::vector<uint32_t>& indices)
+        : positions(positions), normals(normals), texCoords(texCoords), corners(indices), liveFaces(0), maxCost(0.0)
+    {
+        this->weld();
+
+        size_t faceCount = this->corners.size() / 3;
+        this->faceRemoved.assign(faceCount, false);
+        this->quadrics.assign(this->points.size(), Quadric());
+        this->pointFaces.resize(this->points.size());
+        for (size_t f = 0; f < faceCount; f++) {
+            uint32_t a = this->point(f, 0), b = this->point(f, 1), c = this->point(f, 2);
+            if (a == b || b == c || a == c) {
+                this->faceRemoved[f] = true;
+                continue;
+            }
+            glm::dvec3 normal = glm::cross(glm::dvec3(this->points[b] - this->points[a]), glm::dvec3(this->points[c] - this->points[a]));
+            double length = glm::length(normal);
+            if (length > 0.0) {
+                normal /= length;
+                Quadric plane(normal, -glm::dot(normal, glm::dvec3(this->points[a])));
+                this->quadrics[a] += plane;
+                this->quadrics[b] += plane;
+                this->quadrics[c] += plane;
+            }
+            for (int k = 0; k < 3; k++)
+                this->pointFaces[this->point(f, k)].push_back((uint32_t)f);
+            this->liveFaces++;
+        }
+
+        this->lockBorders();
+
+        this->version.assign(this->points.size(), 0);
+        this->pointRemoved.assign(this->points.size(), false);
+        for (size_t f = 0; f < faceCount; f++) {
+            if (this->faceRemoved[f])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                this->push(this->point(f, k), this->point(f, (k + 1) % 3));
+                this->push(this->point(f, (k + 1) % 3), this->point(f, k));
+            }
+        }
+    }
+
+    size_t TriangleCount() const { return this->liveFaces; }
+
+    // Collapses until at most targetTriangles remain or the cheapest collapse would move
+    // the surface further than maxError; returns the error reached so far (model units)
+    float Simplify(size_t targetTriangles, float maxError)
+    {
+        double costLimit = (double)maxError * maxError;
+        while (this->liveFaces > targetTriangles && !this->heap.empty()) {
+            Candidate candidate = this->heap.top();
+            if (candidate.cost > costLimit)
+                break;
+            this->heap.pop();
+
+            if (this->pointRemoved[candidate.from] || this->pointRemoved[candidate.to]
+                || candidate.fromVersion != this->version[candidate.from] || candidate.toVersion != this->version[candidate.to])
+                continue;
+            if (!this->canCollapse(candidate.from, candidate.to))
+                continue;
+
+            this->collapse(candidate.from, candidate.to);
+            this->maxCost = std::max(this->maxCost, candidate.cost);
+        }
+        return (float)std::sqrt(this->maxCost);
+    }
+
+    // The current triangles, as indices into the attribute arrays
+    void Indices(std::vector<uint32_t>& indices) const
+    {
+        indices.clear();
+        for (size_t f = 0; f < this->faceRemoved.size(); f++) {
+            if (this->faceRemoved[f])
+                continue;
+            indices.push_back(this->corners[f * 3]);
+            indices.push_back(this->corners[f * 3 + 1]);
+            indices.push_back(this->corners[f * 3 + 2]);
+        }
+    }
+
+private:
+    // Symmetric 4x4 error matrix of a set of planes
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+        Quadric()
+            : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0)
+        {
+        }
+
+        Quadric(const glm::dvec3& n, double d)
+            : a2(n.x * n.x), ab(n.x * n.y), ac(n.x * n.z), ad(n.x * d), b2(n.y * n.y), bc(n.y * n.z), bd(n.y * d),
+            c2(n.z * n.z), cd(n.z * d), d2(d * d)
+        {
+        }
+
+        Quadric& operator+=(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+            bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+            return *this;
+        }
+
+        // Sum of squared distances from p to the planes
+        double Error(const glm::dvec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                + c2 * z * z + 2 * cd * z + d2;
+        }
+    };
+
+    struct Candidate
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t fromVersion, toVersion;
+
+        bool operator>(const Candidate& other) const { return this->cost > other.cost; }
+    };
+
+    std::vector<uint32_t> corners;          // Vertex per face corner
+    std::vector<uint32_t> pointOf;          // Welded point per vertex
+    std::vector<glm::vec3> points;          // Per welded point
+    std::vector<std::vector<uint32_t> > pointVertices;  // Vertices sharing each point
+    std::vector<std::vector<uint32_t> > pointFaces;     // May list removed faces
+    std::vector<Quadric> quadrics;
+    std::vector<bool> faceRemoved, pointRemoved, pointLocked;
+    std::vector<uint32_t> version;          // Bumped when a point's quadric changes
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > heap;
+    size_t liveFaces;
+    double maxCost;
+
+    uint32_t point(size_t face, int k) const { return this->pointOf[this->corners[face * 3 + k]]; }
+
+    bool hasPoint(size_t face, uint32_t p) const
+    {
+        return this->point(face, 0) == p || this->point(face, 1) == p || this->point(face, 2) == p;
+    }
+
+    // Bitwise-equal positions become one point
+    void weld()
+    {
+        std::vector<uint32_t> order(this->positions.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (uint32_t)i;
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return std::memcmp(&this->positions[a], &this->positions[b], sizeof(glm::vec3)) < 0;
+        });
+
+        this->pointOf.assign(this->positions.size(), 0);
+        for (size_t i = 0; i < order.size(); i++) {
+            if (i == 0 || std::memcmp(&this->positions[order[i]], &this->positions[order[i - 1]], sizeof(glm::vec3)) != 0) {
+                this->points.push_back(this->positions[order[i]]);
+                this->pointVertices.push_back(std::vector<uint32_t>());
+            }
+            this->pointOf[order[i]] = (uint32_t)this->points.size() - 1;
+            this->pointVertices.back().push_back(order[i]);
+        }
+    }
+
+    // Points on open or non-manifold edges stay where they are
+    void lockBorders()
+    {
+        std::unordered_map<uint64_t, int> edgeFaces;
+        for (size_t f = 0; f < this->faceRemoved.size(); f++) {
+            if (this->faceRemoved[f])
+                continue;
+            for (int k = 0; k < 3; k++)
+                edgeFaces[this->edgeKey(this->point(f, k), this->point(f, (k + 1) % 3))]++;
+        }
+
+        this->pointLocked.assign(this->points.size(), false);
+        for (std::unordered_map<uint64_t, int>::const_iterator it = edgeFaces.begin(); it != edgeFaces.end(); ++it) {
+            if (it->second != 2) {
+                this->pointLocked[(uint32_t)(it->first >> 32)] = true;
+                this->pointLocked[(uint32_t)(it->first & 0xFFFFFFFFu)] = true;
+            }
+        }
+    }
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    void push(uint32_t from, uint32_t to)
+    {
+        if (this->pointLocked[from])
+            return;
+        Quadric q = this->quadrics[from];
+        q += this->quadrics[to];
+        Candidate candidate;
+        candidate.cost = std::max(q.Error(glm::dvec3(this->points[to])), 0.0);
+        candidate.from = from;
+        candidate.to = to;
+        candidate.fromVersion = this->version[from];
+        candidate.toVersion = this->version[to];
+        this->heap.push(candidate);
+    }
+
+    void neighbours(uint32_t p, std::vector<uint32_t>& result) const
+    {
+        result.clear();
+        for (size_t i = 0; i < this->pointFaces[p].size(); i++) {
+            uint32_t f = this->pointFaces[p][i];
+            if (this->faceRemoved[f])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                if (this->point(f, k) != p)
+                    result.push_back(this->point(f, k));
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+    // Keeps the surface manifold and refuses to fold any face over
+    bool canCollapse(uint32_t from, uint32_t to)
+    {
+        size_t shared = 0;
+        for (size_t i = 0; i < this->pointFaces[from].size(); i++) {
+            uint32_t f = this->pointFaces[from][i];
+            if (this->faceRemoved[f])
+                continue;
+            if (this->hasPoint(f, to)) {
+                shared++;
+                continue;
+            }
+
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = this->points[this->point(f, k)];
+                q[k] = this->point(f, k) == from ? this->points[to] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            float beforeLength = glm::length(before), afterLength = glm::length(after);
+            if (afterLength <= beforeLength * 1e-3f || glm::dot(before, after) < 0.3f * beforeLength * afterLength)
+                return false;
+        }
+        if (shared == 0)
+            return false;
+
+        // Link condition: the two points may only share the neighbours across the edge
+        this->neighbours(from, this->scratchFrom);
+        this->neighbours(to, this->scratchTo);
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < this->scratchFrom.size() && j < this->scratchTo.size();) {
+            if (this->scratchFrom[i] < this->scratchTo[j])
+                i++;
+            else if (this->scratchFrom[i] > this->scratchTo[j])
+                j++;
+            else {
+                common++;
+                i++;
+                j++;
+            }
+        }
+        return common == shared;
+    }
+
+    void collapse(uint32_t from, uint32_t to)
+    {
+        std::vector<uint32_t> faces(this->pointFaces[from]);
+        for (size_t i = 0; i < faces.size(); i++) {
+            uint32_t f = faces[i];
+            if (this->faceRemoved[f])
+                continue;
+            if (this->hasPoint(f, to)) {
+                this->faceRemoved[f] = true;
+                this->liveFaces--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (this->point(f, k) == from)
+                    this->corners[f * 3 + k] = this->moveCorner(f, k, to);
+            }
+            this->pointFaces[to].push_back(f);
+        }
+
+        this->pointRemoved[from] = true;
+        std::vector<uint32_t>().swap(this->pointFaces[from]);
+        this->quadrics[to] += this->quadrics[from];
+        this->version[to]++;
+
+        std::vector<uint32_t> around;
+        this->neighbours(to, around);
+        for (size_t i = 0; i < around.size(); i++) {
+            this->push(around[i], to);
+            this->push(to, around[i]);
+        }
+    }
+
+    // Vertex for corner k of face f once it sits on point `to`: the face's own UV mapping
+    // extended to the new position, and the normal of `to` that best matches the old one
+    uint32_t moveCorner(size_t f, int k, uint32_t to)
+    {
+        uint32_t vertex = this->corners[f * 3 + k];
+        uint32_t other1 = this->corners[f * 3 + (k + 1) % 3], other2 = this->corners[f * 3 + (k + 2) % 3];
+        glm::vec3 target = this->points[to];
+
+        glm::vec2 uv = this->texCoords[vertex];
+        glm::vec3 e1 = this->positions[other1] - this->positions[vertex];
+        glm::vec3 e2 = this->positions[other2] - this->positions[vertex];
+        glm::vec3 d = target - this->positions[vertex];
+        float d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+        float denominator = d11 * d22 - d12 * d12;
+        if (denominator > 1e-12f * d11 * d22) {
+            float s = (d22 * glm::dot(d, e1) - d12 * glm::dot(d, e2)) / denominator;
+            float t = (d11 * glm::dot(d, e2) - d12 * glm::dot(d, e1)) / denominator;
+            uv += s * (this->texCoords[other1] - uv) + t * (this->texCoords[other2] - uv);
+        }
+
+        glm::vec3 normal = this->normals[vertex];
+        float bestDot = 0.5f;
+        const std::vector<uint32_t>& candidates = this->pointVertices[to];
+        for (size_t i = 0; i < candidates.size(); i++) {
+            float dot = glm::dot(this->normals[candidates[i]], this->normals[vertex]);
+            if (dot > bestDot) {
+                bestDot = dot;
+                normal = this->normals[candidates[i]];
+            }
+        }
+
+        for (size_t i = 0; i < candidates.size(); i++) {
+            uint32_t c = candidates[i];
+            if (glm::length(this->texCoords[c] - uv) < 1e-5f && glm::dot(this->normals[c], normal) > 0.9999f)
+                return c;
+        }
+
+        uint32_t added = (uint32_t)this->positions.size();
+        this->positions.push_back(target);
+        this->normals.push_back(normal);
+        this->texCoords.push_back(uv);
+        this->pointOf.push_back(to);
+        this->pointVertices[to].push_back(added);
+        return added;
+    }
+
+    std::vector<uint32_t> scratchFrom, scratchTo;
+};
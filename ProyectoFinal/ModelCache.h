@@ -0,0 +1,601 @@
+#pragma once
+
+// Binary mesh cache
+// Each source model (e.g. Models/casa.obj) gets a sibling "<file>.mcache" holding
+// interleaved float vertices and indices (picking, occlusion and batching read them),
+// the same geometry packed for the GPU (VertexPacking.h) with its decode ranges,
+// per-mesh material references and bounds. Warm starts memory-map the cache and upload
+// the packed copy as-is; the cache is rebuilt through assimp, and the packing checked
+// for precision, whenever the hash of the .obj/.mtl sources changes.
+// Import also simplifies every mesh into a few coarser LODs (MeshSimplifier.h); their
+// indices follow the mesh's own, so LOD selection is just a different draw range. Every
+// level is then ordered for the vertex cache and vertex fetch (MeshOptimizer.h).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cfloat>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "FileUtils.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "VertexPacking.h"
+
+// Assimp for the cold (uncached) import path
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// Bump whenever the layout below or the import post-processing changes
+const uint32_t MODEL_CACHE_VERSION = 4;
+const size_t MODEL_CACHE_PATH_LENGTH = 128;
+const uint32_t MODEL_CACHE_MAX_LODS = 4;
+
+// Interleaved vertex, same layout as the Mesh class (32 bytes)
+struct CacheVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+// Index range of one level of detail; error is how far (model units) it may stray
+// from the full mesh
+struct CacheLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// One draw range inside the model-wide vertex/index arrays
+// lods[0] is the full mesh (firstIndex/indexCount); later levels get coarser and
+// share the mesh's vertex range
+struct CacheMesh
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t material;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+    uint32_t lodCount;
+    CacheLod lods[MODEL_CACHE_MAX_LODS];
+};
+
+// Material reference; texture paths are relative to the model directory
+struct CacheMaterial
+{
+    char diffusePath[MODEL_CACHE_PATH_LENGTH];
+    char specularPath[MODEL_CACHE_PATH_LENGTH];
+    glm::vec3 diffuseColor;
+    float shininess;
+};
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint64_t meshOffset;
+    uint64_t materialOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t packedVertexOffset;
+    uint64_t shortIndexOffset;  // 0 when some mesh needs 32-bit indices
+    uint64_t totalSize;
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+    glm::vec3 positionOffset;   // Decode ranges of the packed vertices (VertexPacking)
+    glm::vec3 positionScale;
+    glm::vec4 texCoordDecode;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+    {
+    }
+
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            Close();
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            Close();
+            return false;
+        }
+
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view != MAP_FAILED) {
+            data = view;
+            size = (size_t)info.st_size;
+        }
+#endif
+        if (data == nullptr) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap(data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const void* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    void* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// CPU-side model contents, backed either by a mapped cache file or by a freshly built blob
+class ModelData
+{
+public:
+    const CacheHeader* header = nullptr;
+    const CacheMesh* meshes = nullptr;
+    const CacheMaterial* materials = nullptr;
+    const CacheVertex* vertices = nullptr;
+    const uint32_t* indices = nullptr;
+    const PackedVertex* packedVertices = nullptr;
+    const uint16_t* shortIndices = nullptr;    // Null when the model needs 32-bit indices
+    std::string directory;
+    bool fromCache = false;
+
+    ModelData() = default;
+    ModelData(const ModelData&) = delete;
+    ModelData& operator=(const ModelData&) = delete;
+
+    // Loads a model through its cache, rebuilding the cache if it is missing or stale
+    bool Load(const std::string& path)
+    {
+        directory = path.substr(0, path.find_last_of("/\\"));
+        std::string cachePath = path + ".mcache";
+
+        uint64_t sourceHash = HashSources(path);
+        if (sourceHash == 0) {
+            std::cout << "ERROR::MODELCACHE:: Cannot read " << path << std::endl;
+            return false;
+        }
+
+        if (mapped.Open(cachePath) && Bind(mapped.Data(), mapped.Size(), sourceHash)) {
+            fromCache = true;
+            return true;
+        }
+        mapped.Close();
+
+        if (!Import(path, sourceHash))
+            return false;
+
+        WriteCache(cachePath);
+        fromCache = false;
+        return Bind(owned.data(), owned.size(), sourceHash);
+    }
+
+    // Drops the mapping/blob once the GPU owns a copy of the data
+    void Release()
+    {
+        mapped.Close();
+        std::vector<char>().swap(owned);
+        header = nullptr;
+        meshes = nullptr;
+        materials = nullptr;
+        vertices = nullptr;
+        indices = nullptr;
+        packedVertices = nullptr;
+        shortIndices = nullptr;
+    }
+
+    // Hashes the .obj file plus every .mtl it references
+    static uint64_t HashSources(const std::string& path)
+    {
+        std::vector<char> source;
+        if (!ReadWholeFile(path, source))
+            return 0;
+
+        uint64_t hash = HashBytes(source.data(), source.size());
+        std::string dir = path.substr(0, path.find_last_of("/\\") + 1);
+
+        size_t pos = 0;
+        const std::string keyword = "mtllib ";
+        std::string text(source.begin(), source.end());
+        while ((pos = text.find(keyword, pos)) != std::string::npos) {
+            size_t end = text.find_first_of("\r\n", pos);
+            std::string mtl = text.substr(pos + keyword.size(), end - pos - keyword.size());
+            std::vector<char> library;
+            if (ReadWholeFile(dir + mtl, library))
+                hash = HashBytes(library.data(), library.size(), hash);
+            pos += keyword.size();
+        }
+        return hash;
+    }
+
+private:
+    MappedFile mapped;
+    std::vector<char> owned;
+
+    static uint64_t AlignUp(uint64_t value) { return (value + 15) & ~uint64_t(15); }
+
+    // Validates a cache image and points the accessors into it
+    bool Bind(const void* data, size_t size, uint64_t sourceHash)
+    {
+        if (size < sizeof(CacheHeader))
+            return false;
+
+        const char* base = static_cast<const char*>(data);
+        const CacheHeader* h = reinterpret_cast<const CacheHeader*>(base);
+        if (std::memcmp(h->magic, "MCHE", 4) != 0 || h->version != MODEL_CACHE_VERSION
+            || h->sourceHash != sourceHash || h->totalSize != size)
+            return false;
+
+        if (h->meshOffset + h->meshCount * sizeof(CacheMesh) > size
+            || h->materialOffset + h->materialCount * sizeof(CacheMaterial) > size
+            || h->vertexOffset + h->vertexCount * sizeof(CacheVertex) > size
+            || h->indexOffset + h->indexCount * sizeof(uint32_t) > size
+            || h->packedVertexOffset + h->vertexCount * sizeof(PackedVertex) > size
+            || h->shortIndexOffset + h->indexCount * sizeof(uint16_t) > size)
+            return false;
+
+        const CacheMesh* meshList = reinterpret_cast<const CacheMesh*>(base + h->meshOffset);
+        for (uint32_t i = 0; i < h->meshCount; i++) {
+            if (meshList[i].lodCount == 0 || meshList[i].lodCount > MODEL_CACHE_MAX_LODS)
+                return false;
+        }
+
+        header = h;
+        meshes = meshList;
+        materials = reinterpret_cast<const CacheMaterial*>(base + h->materialOffset);
+        vertices = reinterpret_cast<const CacheVertex*>(base + h->vertexOffset);
+        indices = reinterpret_cast<const uint32_t*>(base + h->indexOffset);
+        packedVertices = reinterpret_cast<const PackedVertex*>(base + h->packedVertexOffset);
+        shortIndices = h->shortIndexOffset != 0 ? reinterpret_cast<const uint16_t*>(base + h->shortIndexOffset) : nullptr;
+        return true;
+    }
+
+    static void CopyPath(char* dst, const aiString& src)
+    {
+        std::strncpy(dst, src.C_Str(), MODEL_CACHE_PATH_LENGTH - 1);
+        dst[MODEL_CACHE_PATH_LENGTH - 1] = '\0';
+    }
+
+    // Walks the node tree in the same order as Model::processNode
+    static void CollectMeshes(const aiNode* node, std::vector<unsigned int>& order)
+    {
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            order.push_back(node->mMeshes[i]);
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            CollectMeshes(node->mChildren[i], order);
+    }
+
+    // Cold path: parse the source with assimp and flatten it into a cache image
+    bool Import(const std::string& path, uint64_t sourceHash)
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+        if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
+            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        std::vector<unsigned int> order;
+        CollectMeshes(scene->mRootNode, order);
+
+        std::vector<CacheMesh> meshList;
+        std::vector<CacheVertex> vertexList;
+        std::vector<uint32_t> indexList;
+        glm::vec3 modelMin(FLT_MAX), modelMax(-FLT_MAX);
+        size_t fullTriangles = 0, lodTriangles = 0;
+        MeshOptimizer::CacheStats before = { 0, 0, 0 }, after = { 0, 0, 0 };
+
+        // Meshes are processed in their own index space, then appended
+        std::vector<CacheVertex> meshVertices;
+        std::vector<uint32_t> meshIndices;
+        for (size_t m = 0; m < order.size(); m++) {
+            const aiMesh* mesh = scene->mMeshes[order[m]];
+            CacheMesh range;
+            range.firstIndex = 0;
+            range.baseVertex = 0;
+            range.material = mesh->mMaterialIndex;
+            range.aabbMin = glm::vec3(FLT_MAX);
+            range.aabbMax = glm::vec3(-FLT_MAX);
+
+            for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+                CacheVertex vertex;
+                vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+                vertex.Normal = mesh->mNormals
+                    ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z)
+                    : glm::vec3(0.0f, 1.0f, 0.0f);
+                vertex.TexCoords = mesh->mTextureCoords[0]
+                    ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y)
+                    : glm::vec2(0.0f);
+                range.aabbMin = glm::min(range.aabbMin, vertex.Position);
+                range.aabbMax = glm::max(range.aabbMax, vertex.Position);
+                meshVertices.push_back(vertex);
+            }
+
+            for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+                const aiFace& face = mesh->mFaces[i];
+                for (unsigned int j = 0; j < face.mNumIndices; j++)
+                    meshIndices.push_back(face.mIndices[j]);
+            }
+
+            Accumulate(before, MeshOptimizer::Simulate(meshIndices.data(), meshIndices.size(), meshVertices.size()));
+            MeshOptimizer::Weld(meshVertices, meshIndices);
+            range.indexCount = (uint32_t)meshIndices.size();
+            range.vertexCount = (uint32_t)meshVertices.size();
+            BuildLods(range, meshVertices, meshIndices);
+            OptimizeOrder(range, meshVertices, meshIndices);
+            Accumulate(after, MeshOptimizer::Simulate(meshIndices.data(), range.indexCount, meshVertices.size()));
+
+            range.firstIndex = (uint32_t)indexList.size();
+            range.baseVertex = (uint32_t)vertexList.size();
+            for (uint32_t l = 0; l < range.lodCount; l++)
+                range.lods[l].firstIndex += range.firstIndex;
+            vertexList.insert(vertexList.end(), meshVertices.begin(), meshVertices.end());
+            indexList.insert(indexList.end(), meshIndices.begin(), meshIndices.end());
+            meshVertices.clear();
+            meshIndices.clear();
+
+            fullTriangles += range.indexCount / 3;
+            lodTriangles += range.lods[range.lodCount - 1].indexCount / 3;
+            modelMin = glm::min(modelMin, range.aabbMin);
+            modelMax = glm::max(modelMax, range.aabbMax);
+            meshList.push_back(range);
+        }
+
+        std::vector<CacheMaterial> materialList(scene->mNumMaterials);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+            const aiMaterial* material = scene->mMaterials[i];
+            CacheMaterial& entry = materialList[i];
+            std::memset(&entry, 0, sizeof(entry));
+
+            aiString texturePath;
+            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) == AI_SUCCESS)
+                CopyPath(entry.diffusePath, texturePath);
+            if (material->GetTexture(aiTextureType_SPECULAR, 0, &texturePath) == AI_SUCCESS)
+                CopyPath(entry.specularPath, texturePath);
+
+            aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+            material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+            entry.diffuseColor = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+
+            float shininess = 0.0f;
+            material->Get(AI_MATKEY_SHININESS, shininess);
+            entry.shininess = shininess > 0.0f ? shininess : 16.0f;
+        }
+
+        if (meshList.empty()) {
+            modelMin = glm::vec3(0.0f);
+            modelMax = glm::vec3(0.0f);
+        }
+        std::cout << "LOD: " << path << " " << fullTriangles << " -> " << lodTriangles << " triangles at the coarsest level" << std::endl;
+        std::cout << std::fixed << std::setprecision(2) << "Vertex cache: " << path << " ACMR " << before.Acmr() << " -> " << after.Acmr()
+            << ", ATVR " << before.Atvr() << " -> " << after.Atvr() << " (" << before.vertices << " -> " << after.vertices
+            << " vertices)" << std::defaultfloat << std::endl;
+
+        // Packed once here, so warm starts upload straight from the mapping; indices are
+        // local to their mesh, so 16 bits hold them unless a mesh is larger than that
+        VertexPacking packing;
+        packing.Fit(vertexList.data(), vertexList.size());
+        std::vector<PackedVertex> packedList(vertexList.size());
+        for (size_t i = 0; i < vertexList.size(); i++)
+            packedList[i] = packing.Pack(vertexList[i]);
+        packing.Report(vertexList.data(), packedList.data(), vertexList.size(), path);
+
+        uint32_t largestIndex = 0;
+        for (size_t i = 0; i < indexList.size(); i++)
+            largestIndex = std::max(largestIndex, indexList[i]);
+        std::vector<uint16_t> shortList;
+        if (largestIndex <= 0xFFFF)
+            shortList.assign(indexList.begin(), indexList.end());
+
+        CacheHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, "MCHE", 4);
+        h.version = MODEL_CACHE_VERSION;
+        h.sourceHash = sourceHash;
+        h.meshCount = (uint32_t)meshList.size();
+        h.materialCount = (uint32_t)materialList.size();
+        h.vertexCount = (uint32_t)vertexList.size();
+        h.indexCount = (uint32_t)indexList.size();
+        h.meshOffset = AlignUp(sizeof(CacheHeader));
+        h.materialOffset = AlignUp(h.meshOffset + meshList.size() * sizeof(CacheMesh));
+        h.vertexOffset = AlignUp(h.materialOffset + materialList.size() * sizeof(CacheMaterial));
+        h.indexOffset = AlignUp(h.vertexOffset + vertexList.size() * sizeof(CacheVertex));
+        h.packedVertexOffset = AlignUp(h.indexOffset + indexList.size() * sizeof(uint32_t));
+        h.shortIndexOffset = AlignUp(h.packedVertexOffset + packedList.size() * sizeof(PackedVertex));
+        h.totalSize = AlignUp(h.shortIndexOffset + shortList.size() * sizeof(uint16_t));
+        if (indexList.empty() || shortList.empty())
+            h.shortIndexOffset = 0;
+        h.aabbMin = modelMin;
+        h.aabbMax = modelMax;
+        h.positionOffset = packing.positionOffset;
+        h.positionScale = packing.positionScale;
+        h.texCoordDecode = packing.texCoordDecode;
+
+        owned.assign((size_t)h.totalSize, 0);
+        std::memcpy(&owned[0], &h, sizeof(h));
+        if (!meshList.empty())
+            std::memcpy(&owned[(size_t)h.meshOffset], meshList.data(), meshList.size() * sizeof(CacheMesh));
+        if (!materialList.empty())
+            std::memcpy(&owned[(size_t)h.materialOffset], materialList.data(), materialList.size() * sizeof(CacheMaterial));
+        if (!vertexList.empty())
+            std::memcpy(&owned[(size_t)h.vertexOffset], vertexList.data(), vertexList.size() * sizeof(CacheVertex));
+        if (!indexList.empty())
+            std::memcpy(&owned[(size_t)h.indexOffset], indexList.data(), indexList.size() * sizeof(uint32_t));
+        if (!packedList.empty())
+            std::memcpy(&owned[(size_t)h.packedVertexOffset], packedList.data(), packedList.size() * sizeof(PackedVertex));
+        if (!shortList.empty())
+            std::memcpy(&owned[(size_t)h.shortIndexOffset], shortList.data(), shortList.size() * sizeof(uint16_t));
+        return true;
+    }
+
+    // Appends the coarser levels of a mesh whose LOD0 is all of indexList. Each level
+    // halves the previous one, as long as the surface stays within LOD_MAX_ERROR of the
+    // mesh size; new corners from the simplifier join the mesh's vertices.
+    static void BuildLods(CacheMesh& range, std::vector<CacheVertex>& vertexList, std::vector<uint32_t>& indexList)
+    {
+        const size_t LOD_MIN_TRIANGLES = 32;
+        const float LOD_MAX_ERROR = 0.02f;
+
+        range.lodCount = 1;
+        std::memset(range.lods, 0, sizeof(range.lods));
+        range.lods[0].firstIndex = range.firstIndex;
+        range.lods[0].indexCount = range.indexCount;
+        range.lods[0].error = 0.0f;
+        if (range.indexCount / 3 < LOD_MIN_TRIANGLES)
+            return;
+
+        std::vector<glm::vec3> positions(range.vertexCount), normals(range.vertexCount);
+        std::vector<glm::vec2> texCoords(range.vertexCount);
+        for (uint32_t i = 0; i < range.vertexCount; i++) {
+            const CacheVertex& vertex = vertexList[i];
+            positions[i] = vertex.Position;
+            normals[i] = vertex.Normal;
+            texCoords[i] = vertex.TexCoords;
+        }
+        std::vector<uint32_t> local(indexList);
+
+        MeshSimplifier simplifier(positions, normals, texCoords, local);
+        float maxError = LOD_MAX_ERROR * glm::length(range.aabbMax - range.aabbMin);
+        size_t previous = simplifier.TriangleCount();
+        size_t usedVertices = range.vertexCount;
+        while (range.lodCount < MODEL_CACHE_MAX_LODS) {
+            float error = simplifier.Simplify(previous / 2, maxError);
+            size_t triangles = simplifier.TriangleCount();
+            // Not worth a level when the surface will not give up a quarter of it
+            if (triangles * 4 > previous * 3)
+                break;
+
+            simplifier.Indices(local);
+            CacheLod& lod = range.lods[range.lodCount++];
+            lod.firstIndex = (uint32_t)indexList.size();
+            lod.indexCount = (uint32_t)local.size();
+            lod.error = error;
+            indexList.insert(indexList.end(), local.begin(), local.end());
+            previous = triangles;
+            usedVertices = simplifier.positions.size();
+        }
+
+        for (size_t i = range.vertexCount; i < usedVertices; i++) {
+            CacheVertex vertex;
+            vertex.Position = simplifier.positions[i];
+            vertex.Normal = simplifier.normals[i];
+            vertex.TexCoords = simplifier.texCoords[i];
+            vertexList.push_back(vertex);
+        }
+        range.vertexCount = (uint32_t)usedVertices;
+    }
+
+    // Triangle order of every level, then one vertex order for all of them (the finest
+    // level's first uses come first, since it is the one drawn up close)
+    static void OptimizeOrder(const CacheMesh& range, std::vector<CacheVertex>& vertexList, std::vector<uint32_t>& indexList)
+    {
+        std::vector<glm::vec3> positions(vertexList.size());
+        for (size_t i = 0; i < vertexList.size(); i++)
+            positions[i] = vertexList[i].Position;
+        for (uint32_t l = 0; l < range.lodCount; l++)
+            MeshOptimizer::OrderTriangles(&indexList[range.lods[l].firstIndex], range.lods[l].indexCount, positions.data(), positions.size());
+        MeshOptimizer::OrderVertices(vertexList, indexList);
+    }
+
+    static void Accumulate(MeshOptimizer::CacheStats& total, const MeshOptimizer::CacheStats& mesh)
+    {
+        total.triangles += mesh.triangles;
+        total.vertices += mesh.vertices;
+        total.misses += mesh.misses;
+    }
+
+    void WriteCache(const std::string& cachePath) const
+    {
+        if (!WriteWholeFile(cachePath, owned.data(), owned.size()))
+            std::cout << "WARNING::MODELCACHE:: Cannot write " << cachePath << std::endl;
+    }
+};
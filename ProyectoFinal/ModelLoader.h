@@ -0,0 +1,136 @@
+#pragma once
+
+// Parallel startup loader
+// File reads and parsing/cache mapping run on the ThreadPool; only buffer creation
+// is queued back to the GL context thread, which drains that queue inside Run()
+// while the workers keep going. Textures are handed to the TextureStreamer, so
+// Run() returns as soon as the geometry is on the GPU.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "CachedModel.h"
+#include "StaticBatch.h"
+#include "TextureStreamer.h"
+
+class ModelLoader
+{
+public:
+    ModelLoader(ThreadPool& pool, TextureStreamer& streamer)
+        : pool(pool), streamer(streamer), outstanding(0)
+    {
+    }
+
+    void Add(CachedModel& model, const std::string& path)
+    {
+        Entry entry;
+        entry.model = &model;
+        entry.path = path;
+        entry.batch = nullptr;
+        entry.world = glm::mat4(1.0f);
+        entry.alpha = 1.0f;
+        this->entries.push_back(entry);
+    }
+
+    // Static model: its geometry is baked into the batch on the worker instead of getting
+    // its own buffers; call batch.Build() after Run()
+    void AddStatic(CachedModel& model, const std::string& path, StaticBatch& batch, const glm::mat4& world, float alpha = 1.0f)
+    {
+        Entry entry;
+        entry.model = &model;
+        entry.path = path;
+        entry.batch = &batch;
+        entry.world = world;
+        entry.alpha = alpha;
+        this->entries.push_back(entry);
+    }
+
+    // Must be called on the thread that owns the GL context; returns when every model is uploaded
+    void Run()
+    {
+        for (size_t i = 0; i < this->entries.size(); i++) {
+            Entry entry = this->entries[i];
+            this->submit([this, entry] { this->prepareModel(entry); });
+        }
+
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->ready.wait(lock, [this] { return !this->glTasks.empty() || this->outstanding == 0; });
+                if (this->glTasks.empty())
+                    break;
+                task = std::move(this->glTasks.front());
+                this->glTasks.pop_front();
+            }
+            task();
+        }
+
+        this->entries.clear();
+    }
+
+private:
+    struct Entry
+    {
+        CachedModel* model;
+        std::string path;
+        StaticBatch* batch;  // Null for models drawn on their own
+        glm::mat4 world;
+        float alpha;
+    };
+
+    ThreadPool& pool;
+    TextureStreamer& streamer;
+    std::vector<Entry> entries;
+    std::deque<std::function<void()>> glTasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    unsigned int outstanding;  // Worker jobs not yet finished
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->outstanding++;
+        }
+        this->pool.Submit([this, job] {
+            job();
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->outstanding--;
+            this->ready.notify_one();
+        });
+    }
+
+    // Queue work for the context thread
+    void postToGL(std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->glTasks.push_back(std::move(task));
+        this->ready.notify_one();
+    }
+
+    void prepareModel(const Entry& entry)
+    {
+        CachedModel* model = entry.model;
+        if (!model->Prepare(entry.path.c_str()))
+            return;
+
+        TextureStreamer* textureStreamer = &this->streamer;
+        if (entry.batch) {
+            entry.batch->Append(*model, entry.world, entry.alpha);
+            model->ReleaseCpuData();
+            this->postToGL([model, textureStreamer] { model->RequestTextures(*textureStreamer); });
+            return;
+        }
+
+        this->postToGL([model, textureStreamer] {
+            model->UploadGeometry();
+            model->RequestTextures(*textureStreamer);
+        });
+    }
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+// Normal matrices for a batch of model matrices
+// With a, b, c the columns of mat3(model), transpose(inverse(mat3(model))) is the
+// cofactor matrix [b x c, c x a, a x b] divided by det = a . (b x c): three cross
+// products instead of a general inverse. Matrices go four at a time through SSE lanes.
+// The RenderQueue computes one per transform per frame instead of lighting.vs doing it
+// per vertex; Tools/NormalMatrixBench.cpp measures both.
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+#if defined(__AVX__) || defined(FRUSTUM_SSE)
+#define NORMAL_MATRIX_SSE
+#endif
+
+// One matrix; singular ones keep the cofactors, which still point normals the right way
+inline glm::mat3 NormalMatrix(const glm::mat4& model)
+{
+    glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+    glm::mat3 cofactor(glm::cross(b, c), glm::cross(c, a), glm::cross(a, b));
+    float det = glm::dot(a, cofactor[0]);
+    return det != 0.0f ? cofactor * (1.0f / det) : cofactor;
+}
+
+#if defined(NORMAL_MATRIX_SSE)
+inline void NormalMatrixLoad(const glm::mat4* models, int column, __m128* lanes)
+{
+    lanes[0] = _mm_loadu_ps(&models[0][column][0]);
+    lanes[1] = _mm_loadu_ps(&models[1][column][0]);
+    lanes[2] = _mm_loadu_ps(&models[2][column][0]);
+    lanes[3] = _mm_loadu_ps(&models[3][column][0]);
+    _MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+}
+
+inline void NormalMatrixCross(const __m128* u, const __m128* v, __m128* result)
+{
+    result[0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+    result[1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+    result[2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+    result[3] = _mm_setzero_ps();
+}
+
+// Scaled column back to one register per matrix, at columns[k][offset]
+inline void NormalMatrixStore(__m128* lanes, __m128 scale, float (*columns)[12], int offset)
+{
+    lanes[0] = _mm_mul_ps(lanes[0], scale);
+    lanes[1] = _mm_mul_ps(lanes[1], scale);
+    lanes[2] = _mm_mul_ps(lanes[2], scale);
+    _MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+    _mm_storeu_ps(&columns[0][offset], lanes[0]);
+    _mm_storeu_ps(&columns[1][offset], lanes[1]);
+    _mm_storeu_ps(&columns[2][offset], lanes[2]);
+    _mm_storeu_ps(&columns[3][offset], lanes[3]);
+}
+#endif
+
+inline void NormalMatrices(const glm::mat4* models, size_t count, glm::mat3* normals)
+{
+    size_t i = 0;
+#if defined(NORMAL_MATRIX_SSE)
+    for (; i + 4 <= count; i += 4) {
+        // Columns of the four matrices, transposed so each register holds one element
+        // of all four: a[0] is the x of column 0, lane k from matrix i + k
+        __m128 a[4], b[4], c[4];
+        NormalMatrixLoad(models + i, 0, a);
+        NormalMatrixLoad(models + i, 1, b);
+        NormalMatrixLoad(models + i, 2, c);
+
+        __m128 n0[4], n1[4], n2[4];
+        NormalMatrixCross(b, c, n0);
+        NormalMatrixCross(c, a, n1);
+        NormalMatrixCross(a, b, n2);
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], n0[0]), _mm_mul_ps(a[1], n0[1])), _mm_mul_ps(a[2], n0[2]));
+        __m128 singular = _mm_cmpeq_ps(det, _mm_setzero_ps());
+        __m128 scale = _mm_or_ps(_mm_andnot_ps(singular, _mm_div_ps(_mm_set1_ps(1.0f), det)), _mm_and_ps(singular, _mm_set1_ps(1.0f)));
+
+        // A mat3 is 9 packed floats, so the columns go through a scratch block instead
+        // of overlapping 4-float stores
+        float columns[4][12];
+        NormalMatrixStore(n0, scale, columns, 0);
+        NormalMatrixStore(n1, scale, columns, 3);
+        NormalMatrixStore(n2, scale, columns, 6);
+        for (int k = 0; k < 4; k++)
+            std::memcpy(&normals[i + k][0][0], columns[k], 9 * sizeof(float));
+    }
+#endif
+    for (; i < count; i++)
+        normals[i] = NormalMatrix(models[i]);
+}
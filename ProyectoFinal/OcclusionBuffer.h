@@ -0,0 +1,365 @@
+#pragma once
+
+// Software occlusion culling
+// The largest triangles of the house are kept as occluders and rasterized every frame
+// into a small CPU depth buffer, split into horizontal bands that the worker threads
+// fill in parallel (4 pixels per SSE step). The buffer stores 1/w, so larger is nearer
+// and clear (0) is infinitely far; 1/w is affine in screen space, which keeps the
+// per-pixel interpolation exact. A depth pyramid whose texels keep the farthest value
+// beneath them lets IsVisible() test a box against at most 2x2 texels. Nothing is
+// read back from the GPU, so the result only depends on the camera.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+#if defined(__AVX__) || defined(FRUSTUM_SSE)
+#define OCCLUSION_SSE
+#endif
+
+class OcclusionBuffer
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int BAND_HEIGHT = 16;  // One raster task per band
+
+    // pool = nullptr rasterizes on the calling thread; bands never overlap, so the
+    // result is the same either way
+    explicit OcclusionBuffer(ThreadPool* pool = nullptr)
+        : pool(pool), viewProjection(1.0f), rendered(false)
+    {
+        // Pyramid levels down to one texel row
+        int width = WIDTH, height = HEIGHT;
+        size_t offset = 0;
+        while (height >= 1) {
+            Level level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            this->levels.push_back(level);
+            offset += (size_t)width * height;
+            if (height == 1)
+                break;
+            width /= 2;
+            height /= 2;
+        }
+        this->depth.assign(offset, 0.0f);
+    }
+
+    // Keeps the maxTriangles largest triangles of a static model as occluders. The model
+    // must be opaque: every pixel an occluder covers is treated as solid.
+    void AddOccluders(const TriangleBvh& bvh, const glm::mat4& world, size_t maxTriangles)
+    {
+        std::vector<std::pair<float, size_t> > areas;
+        areas.reserve(bvh.TriangleCount());
+        for (size_t i = 0; i < bvh.TriangleCount(); i++) {
+            glm::vec3 v0, v1, v2;
+            bvh.Corners(i, v0, v1, v2);
+            glm::vec3 w0 = glm::vec3(world * glm::vec4(v0, 1.0f));
+            glm::vec3 w1 = glm::vec3(world * glm::vec4(v1, 1.0f));
+            glm::vec3 w2 = glm::vec3(world * glm::vec4(v2, 1.0f));
+            float area = glm::length(glm::cross(w1 - w0, w2 - w0)) * 0.5f;
+            if (area > 0.0f)
+                areas.push_back(std::make_pair(area, i));
+        }
+
+        size_t kept = std::min(maxTriangles, areas.size());
+        std::partial_sort(areas.begin(), areas.begin() + kept, areas.end(),
+            [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+
+        float total = 0.0f, covered = 0.0f;
+        for (size_t i = 0; i < areas.size(); i++)
+            total += areas[i].first;
+        for (size_t i = 0; i < kept; i++) {
+            glm::vec3 v0, v1, v2;
+            bvh.Corners(areas[i].second, v0, v1, v2);
+            this->occluders.push_back(glm::vec3(world * glm::vec4(v0, 1.0f)));
+            this->occluders.push_back(glm::vec3(world * glm::vec4(v1, 1.0f)));
+            this->occluders.push_back(glm::vec3(world * glm::vec4(v2, 1.0f)));
+            covered += areas[i].first;
+        }
+
+        std::cout << "Occlusion: " << kept << " of " << bvh.TriangleCount() << " triangles kept as occluders ("
+            << (total > 0.0f ? (int)(covered * 100.0f / total) : 0) << "% of the surface)" << std::endl;
+    }
+
+    size_t OccluderCount() const { return this->occluders.size() / 3; }
+
+    // Rasterizes every occluder for this camera and rebuilds the pyramid
+    void Render(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        this->rendered = true;
+
+        this->setup();
+
+        int bands = HEIGHT / BAND_HEIGHT;
+        if (this->pool) {
+            for (int band = 0; band < bands; band++)
+                this->pool->Submit([this, band] { this->rasterBand(band); });
+            this->pool->Wait();
+        }
+        else {
+            for (int band = 0; band < bands; band++)
+                this->rasterBand(band);
+        }
+
+        this->buildPyramid();
+    }
+
+    // False only when the box is certainly behind the occluders; boxes crossing the
+    // camera plane or leaving the buffer are left to the frustum test
+    bool IsVisible(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+    {
+        if (!this->rendered || this->occluders.empty())
+            return true;
+
+        // Corners as base + any sum of the three scaled axes: 4 transforms instead of 8
+        const glm::mat4& m = this->viewProjection;
+        glm::vec4 base = m * glm::vec4(aabbMin, 1.0f);
+        glm::vec3 size = aabbMax - aabbMin;
+        glm::vec4 axes[3] = { m[0] * size.x, m[1] * size.y, m[2] * size.z };
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearest = 0.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 clip = base;
+            for (int axis = 0; axis < 3; axis++) {
+                if (corner & (1 << axis))
+                    clip += axes[axis];
+            }
+            if (clip.w <= 1e-5f)
+                return true;
+
+            float invW = 1.0f / clip.w;
+            float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::max(nearest, invW);
+        }
+
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)WIDTH || minY >= (float)HEIGHT)
+            return true;
+
+        // Every texel the rectangle touches, on the first level where that is at most 2x2
+        int x0 = (int)std::max(minX, 0.0f), x1 = (int)std::min(maxX, WIDTH - 1.0f);
+        int y0 = (int)std::max(minY, 0.0f), y1 = (int)std::min(maxY, HEIGHT - 1.0f);
+        size_t l = 0;
+        while ((x1 - x0 > 1 || y1 - y0 > 1) && l + 1 < this->levels.size()) {
+            x0 >>= 1;
+            x1 >>= 1;
+            y0 >>= 1;
+            y1 >>= 1;
+            l++;
+        }
+
+        const Level& level = this->levels[l];
+        x1 = std::min(x1, level.width - 1);
+        y1 = std::min(y1, level.height - 1);
+        float farthest = FLT_MAX;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++)
+                farthest = std::min(farthest, this->depth[level.offset + (size_t)y * level.width + x]);
+        }
+
+        // Relative bias so a surface never hides its own bounding box
+        return nearest * (1.0f + DEPTH_BIAS) >= farthest;
+    }
+
+    // Level 0, WIDTH x HEIGHT, row 0 at the bottom of the screen
+    const float* Depth() const { return this->depth.data(); }
+
+private:
+    static constexpr float DEPTH_BIAS = 1e-3f;
+
+    struct Level
+    {
+        int width, height;
+        size_t offset;
+    };
+
+    // Screen-space triangle, counter-clockwise; edge and depth values are taken at the
+    // centre of the bounding box's first pixel and stepped from there
+    struct Triangle
+    {
+        int minX, maxX, minY, maxY;
+        float edge[3], edgeX[3], edgeY[3];
+        float depth, depthX, depthY;
+    };
+
+    ThreadPool* pool;
+    std::vector<glm::vec3> occluders;  // World space, three per triangle
+    std::vector<Triangle> triangles;   // This frame's setup
+    std::vector<Level> levels;
+    std::vector<float> depth;          // Every level, level 0 first
+    glm::mat4 viewProjection;
+    bool rendered;
+
+    // Projects, clips against the near plane and sets up every occluder
+    void setup()
+    {
+        this->triangles.clear();
+        for (size_t i = 0; i + 2 < this->occluders.size(); i += 3) {
+            glm::vec4 clip[3];
+            for (int k = 0; k < 3; k++)
+                clip[k] = this->viewProjection * glm::vec4(this->occluders[i + k], 1.0f);
+
+            // Sutherland-Hodgman against z >= -w: a triangle becomes at most a quad
+            glm::vec4 polygon[4];
+            int count = 0;
+            for (int k = 0; k < 3; k++) {
+                const glm::vec4& a = clip[k];
+                const glm::vec4& b = clip[(k + 1) % 3];
+                float da = a.z + a.w, db = b.z + b.w;
+                if (da >= 0.0f)
+                    polygon[count++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    polygon[count++] = a + (b - a) * (da / (da - db));
+            }
+
+            for (int k = 1; k + 1 < count; k++)
+                this->addTriangle(polygon[0], polygon[k], polygon[k + 1]);
+        }
+    }
+
+    void addTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2)
+    {
+        const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+        glm::vec3 v[3];  // Pixel x, pixel y, 1/w
+        for (int k = 0; k < 3; k++) {
+            if (clip[k]->w <= 0.0f)
+                return;
+            float invW = 1.0f / clip[k]->w;
+            v[k] = glm::vec3((clip[k]->x * invW * 0.5f + 0.5f) * WIDTH, (clip[k]->y * invW * 0.5f + 0.5f) * HEIGHT, invW);
+        }
+
+        // Both faces are solid: flip clockwise triangles
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        // Pixels whose centres may be covered (clamped as floats: clipped vertices can
+        // land far outside the buffer)
+        float minX = std::min(v[0].x, std::min(v[1].x, v[2].x)), maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+        float minY = std::min(v[0].y, std::min(v[1].y, v[2].y)), maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+        if (maxX < 0.5f || maxY < 0.5f || minX > WIDTH - 0.5f || minY > HEIGHT - 0.5f)
+            return;
+
+        Triangle triangle;
+        triangle.minX = (int)std::ceil(std::max(minX, 0.5f) - 0.5f);
+        triangle.maxX = (int)std::floor(std::min(maxX, WIDTH - 0.5f) - 0.5f);
+        triangle.minY = (int)std::ceil(std::max(minY, 0.5f) - 0.5f);
+        triangle.maxY = (int)std::floor(std::min(maxY, HEIGHT - 0.5f) - 0.5f);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        // Edge k is positive on the inner side of v[k] -> v[k + 1]
+        float px = triangle.minX + 0.5f, py = triangle.minY + 0.5f;
+        for (int k = 0; k < 3; k++) {
+            const glm::vec3& a = v[k];
+            const glm::vec3& b = v[(k + 1) % 3];
+            triangle.edgeX[k] = a.y - b.y;
+            triangle.edgeY[k] = b.x - a.x;
+            triangle.edge[k] = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+        }
+
+        // 1/w as a plane over the screen
+        glm::vec3 e1 = v[1] - v[0], e2 = v[2] - v[0];
+        triangle.depthX = (e1.z * e2.y - e2.z * e1.y) / area;
+        triangle.depthY = (e2.z * e1.x - e1.z * e2.x) / area;
+        triangle.depth = v[0].z + triangle.depthX * (px - v[0].x) + triangle.depthY * (py - v[0].y);
+        this->triangles.push_back(triangle);
+    }
+
+    void rasterBand(int band)
+    {
+        int bandMin = band * BAND_HEIGHT, bandMax = bandMin + BAND_HEIGHT - 1;
+        std::fill(this->depth.begin() + (size_t)bandMin * WIDTH, this->depth.begin() + (size_t)(bandMax + 1) * WIDTH, 0.0f);
+
+        for (size_t t = 0; t < this->triangles.size(); t++) {
+            const Triangle& triangle = this->triangles[t];
+            int y0 = std::max(triangle.minY, bandMin), y1 = std::min(triangle.maxY, bandMax);
+            if (y0 > y1)
+                continue;
+
+            // Rows start on a 4-pixel boundary; the edge tests reject the extra pixels
+            int x0 = triangle.minX & ~3;
+            float dx = (float)(x0 - triangle.minX);
+            for (int y = y0; y <= y1; y++) {
+                float dy = (float)(y - triangle.minY);
+                float edge[3];
+                for (int k = 0; k < 3; k++)
+                    edge[k] = triangle.edge[k] + triangle.edgeX[k] * dx + triangle.edgeY[k] * dy;
+                float rowDepth = triangle.depth + triangle.depthX * dx + triangle.depthY * dy;
+                float* row = this->depth.data() + (size_t)y * WIDTH;
+
+#if defined(OCCLUSION_SSE)
+                __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+                __m128 e0 = _mm_add_ps(_mm_set1_ps(edge[0]), _mm_mul_ps(lanes, _mm_set1_ps(triangle.edgeX[0])));
+                __m128 e1 = _mm_add_ps(_mm_set1_ps(edge[1]), _mm_mul_ps(lanes, _mm_set1_ps(triangle.edgeX[1])));
+                __m128 e2 = _mm_add_ps(_mm_set1_ps(edge[2]), _mm_mul_ps(lanes, _mm_set1_ps(triangle.edgeX[2])));
+                __m128 z = _mm_add_ps(_mm_set1_ps(rowDepth), _mm_mul_ps(lanes, _mm_set1_ps(triangle.depthX)));
+                __m128 step0 = _mm_set1_ps(triangle.edgeX[0] * 4.0f), step1 = _mm_set1_ps(triangle.edgeX[1] * 4.0f);
+                __m128 step2 = _mm_set1_ps(triangle.edgeX[2] * 4.0f), stepZ = _mm_set1_ps(triangle.depthX * 4.0f);
+                __m128 zero = _mm_setzero_ps();
+                for (int x = x0; x <= triangle.maxX; x += 4) {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                    if (_mm_movemask_ps(inside)) {
+                        __m128 current = _mm_loadu_ps(row + x);
+                        __m128 nearer = _mm_max_ps(current, z);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+                    }
+                    e0 = _mm_add_ps(e0, step0);
+                    e1 = _mm_add_ps(e1, step1);
+                    e2 = _mm_add_ps(e2, step2);
+                    z = _mm_add_ps(z, stepZ);
+                }
+#else
+                for (int x = x0; x <= triangle.maxX; x++) {
+                    float i = (float)(x - x0);
+                    if (edge[0] + triangle.edgeX[0] * i >= 0.0f && edge[1] + triangle.edgeX[1] * i >= 0.0f
+                        && edge[2] + triangle.edgeX[2] * i >= 0.0f)
+                        row[x] = std::max(row[x], rowDepth + triangle.depthX * i);
+                }
+#endif
+            }
+        }
+    }
+
+    // Each texel keeps the farthest (smallest) 1/w of the four below it
+    void buildPyramid()
+    {
+        for (size_t l = 1; l < this->levels.size(); l++) {
+            const Level& source = this->levels[l - 1];
+            const Level& target = this->levels[l];
+            const float* below = this->depth.data() + source.offset;
+            float* above = this->depth.data() + target.offset;
+            for (int y = 0; y < target.height; y++) {
+                const float* row0 = below + (size_t)(2 * y) * source.width;
+                const float* row1 = row0 + source.width;
+                for (int x = 0; x < target.width; x++)
+                    above[(size_t)y * target.width + x] = std::min(std::min(row0[2 * x], row0[2 * x + 1]),
+                        std::min(row1[2 * x], row1[2 * x + 1]));
+            }
+        }
+    }
+};
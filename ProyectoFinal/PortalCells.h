@@ -0,0 +1,536 @@
+#pragma once
+
+// Cell-and-portal visibility
+// Cells are detected from the geometry instead of being authored: the walls are drawn
+// into a 2D grid over the floor plan, one layer per height band of an eye-level slab,
+// and a grid cell blocks only when every layer has a wall in it (so anything low enough
+// to look over stays open). Windows and doorways are drawn as portal cells. Flood-filling
+// the open grid cells then gives the rooms plus the outside, and each run of portal
+// cells becomes a portal joining the two rooms on its sides.
+// Every frame, Update() walks the portals from the camera's room, narrowing the view
+// frustum through each portal it passes; rooms never reached are hidden. Portals of a
+// door close while its angle is 0. Objects are matched to rooms by their footprint on
+// the grid, as a bit mask.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "Frustum.h"
+
+class PortalCells
+{
+public:
+    static const int MAX_CELLS = 31;
+    static const uint32_t ALWAYS = 1u << 31;  // Set on every visible mask
+
+    PortalCells()
+        : slabMin(0.0f), slabMax(0.0f), origin(0.0f), width(0), height(0), outside(-1), cameraCell(-1), visible(~0u)
+    {
+    }
+
+    // Triangles that block sight: a static model at its world transform
+    void AddWalls(const TriangleBvh& bvh, const glm::mat4& world)
+    {
+        this->appendTriangles(bvh, world, this->walls);
+    }
+
+    // Triangles filling openings (window glass, door panels). doorAngle, when given,
+    // closes these portals while it is 0; leave it null for openings that stay see-through.
+    void AddPortals(const TriangleBvh& bvh, const glm::mat4& world, const float* doorAngle = nullptr)
+    {
+        this->appendTriangles(bvh, world, this->openings);
+        this->openingDoors.resize(this->openings.size() / 3, doorAngle);
+    }
+
+    // Detects the cells over the slab [bottom, top]; the camera must stay inside the slab
+    // for the cells to apply (anywhere else Update() shows everything)
+    void Build(float bottom, float top)
+    {
+        this->slabMin = bottom;
+        this->slabMax = top;
+        this->cells.clear();
+        this->portals.clear();
+
+        // Grid over every wall and opening that reaches the slab
+        glm::vec2 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        this->slabBounds(this->walls, boundsMin, boundsMax);
+        this->slabBounds(this->openings, boundsMin, boundsMax);
+        if (boundsMin.x > boundsMax.x) {
+            std::cout << "WARNING::PORTALS:: no walls reach the slab, portal culling disabled" << std::endl;
+            return;
+        }
+        this->origin = boundsMin - glm::vec2(MARGIN * CELL_SIZE);
+        this->width = (int)std::ceil((boundsMax.x - boundsMin.x) / CELL_SIZE) + 2 * MARGIN;
+        this->height = (int)std::ceil((boundsMax.y - boundsMin.y) / CELL_SIZE) + 2 * MARGIN;
+        size_t gridSize = (size_t)this->width * this->height;
+
+        // Walls: one bit per layer; openings: the triangle that marked the grid cell
+        std::vector<unsigned char> wallLayers(gridSize, 0);
+        std::vector<int> opening(gridSize, -1);
+        for (int layer = 0; layer < LAYERS; layer++) {
+            float layerMin = bottom + (top - bottom) * layer / LAYERS;
+            float layerMax = bottom + (top - bottom) * (layer + 1) / LAYERS;
+            for (size_t t = 0; t + 2 < this->walls.size(); t += 3) {
+                this->markTriangle(&this->walls[t], layerMin, layerMax, [&](size_t g) {
+                    wallLayers[g] |= (unsigned char)(1 << layer);
+                });
+            }
+            for (size_t t = 0; t + 2 < this->openings.size(); t += 3) {
+                this->markTriangle(&this->openings[t], layerMin, layerMax, [&](size_t g) {
+                    if (opening[g] < 0)
+                        opening[g] = (int)(t / 3);
+                });
+            }
+        }
+
+        const unsigned char allLayers = (unsigned char)((1 << LAYERS) - 1);
+        std::vector<unsigned char> blocked(gridSize);
+        for (size_t g = 0; g < gridSize; g++)
+            blocked[g] = (wallLayers[g] == allLayers || opening[g] >= 0) ? 1 : 0;
+
+        this->labelRooms(blocked);
+        this->buildPortals(opening);
+
+        std::cout << "Portal cells: " << this->cells.size() << " cells, " << this->portals.size() << " portals ("
+            << this->width << "x" << this->height << " grid)" << std::endl;
+    }
+
+    // Rooms a world box stands in; ALWAYS when it is in none of them (inside a wall, or
+    // in space too narrow to be a room), so it is never hidden by mistake
+    uint32_t CellMask(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+    {
+        if (this->cells.empty())
+            return ALWAYS;
+
+        // One grid cell of slack catches the rooms on both sides of a wall
+        int x0 = (int)std::floor((aabbMin.x - this->origin.x) / CELL_SIZE) - 1;
+        int x1 = (int)std::floor((aabbMax.x - this->origin.x) / CELL_SIZE) + 1;
+        int y0 = (int)std::floor((aabbMin.z - this->origin.y) / CELL_SIZE) - 1;
+        int y1 = (int)std::floor((aabbMax.z - this->origin.y) / CELL_SIZE) + 1;
+
+        uint32_t mask = 0;
+        if (x0 < 0 || y0 < 0 || x1 >= this->width || y1 >= this->height)
+            mask |= this->cellBit(this->outside);
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, this->width - 1);
+        y1 = std::min(y1, this->height - 1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++)
+                mask |= this->cellBit(this->gridCell[(size_t)y * this->width + x]);
+        }
+        return mask != 0 ? mask : ALWAYS;
+    }
+
+    // Finds the rooms visible from the camera this frame
+    void Update(const glm::vec3& eye, const glm::mat4& viewProjection)
+    {
+        this->visible = ~0u;
+        this->cameraCell = this->cellAt(eye);
+        if (this->cameraCell < 0)
+            return;
+
+        Frustum frustum(viewProjection);
+        std::vector<glm::vec4> planes(frustum.planes, frustum.planes + 6);
+        this->visible = ALWAYS;
+        this->visit(this->cameraCell, eye, planes, 1u << this->cameraCell, 0);
+    }
+
+    bool IsVisible(uint32_t mask) const { return (mask & this->visible) != 0; }
+
+    size_t CellCount() const { return this->cells.size(); }
+    size_t PortalCount() const { return this->portals.size(); }
+
+    // Rooms reached by the last Update(); every room when the camera is in none
+    unsigned int VisibleCells() const
+    {
+        unsigned int count = 0;
+        for (size_t c = 0; c < this->cells.size(); c++)
+            count += (this->visible >> c) & 1;
+        return count;
+    }
+
+private:
+    static constexpr float CELL_SIZE = 0.05f;      // Metres per grid cell
+    static constexpr float ROOM_CLEARANCE = 0.25f; // Narrower spaces (inside thick walls) are not rooms
+    static const int LAYERS = 4;
+    static const int MARGIN = 4;                   // Free grid cells around the house
+    static const int MAX_DEPTH = 8;                // Portals passed in a row
+
+    struct Portal
+    {
+        glm::vec3 corners[4];  // Vertical quad around the opening
+        int cells[2];
+        const float* doorAngle;
+    };
+
+    struct Cell
+    {
+        std::vector<size_t> portals;
+    };
+
+    std::vector<glm::vec3> walls, openings;  // World space, three per triangle
+    std::vector<const float*> openingDoors;  // Per opening triangle
+    float slabMin, slabMax;
+    glm::vec2 origin;  // World x/z of grid cell (0, 0)
+    int width, height;
+    std::vector<int> gridCell;  // Room per grid cell, -1 for walls, openings and non-rooms
+    int outside;
+    std::vector<Cell> cells;
+    std::vector<Portal> portals;
+    int cameraCell;
+    uint32_t visible;
+
+    void appendTriangles(const TriangleBvh& bvh, const glm::mat4& world, std::vector<glm::vec3>& triangles)
+    {
+        for (size_t i = 0; i < bvh.TriangleCount(); i++) {
+            glm::vec3 v[3];
+            bvh.Corners(i, v[0], v[1], v[2]);
+            for (int k = 0; k < 3; k++)
+                triangles.push_back(glm::vec3(world * glm::vec4(v[k], 1.0f)));
+        }
+    }
+
+    void slabBounds(const std::vector<glm::vec3>& triangles, glm::vec2& boundsMin, glm::vec2& boundsMax) const
+    {
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+            float low = std::min(triangles[t].y, std::min(triangles[t + 1].y, triangles[t + 2].y));
+            float high = std::max(triangles[t].y, std::max(triangles[t + 1].y, triangles[t + 2].y));
+            if (high < this->slabMin || low > this->slabMax)
+                continue;
+            for (int k = 0; k < 3; k++) {
+                boundsMin = glm::min(boundsMin, glm::vec2(triangles[t + k].x, triangles[t + k].z));
+                boundsMax = glm::max(boundsMax, glm::vec2(triangles[t + k].x, triangles[t + k].z));
+            }
+        }
+    }
+
+    // Marks the outline of the triangle's part between two heights. The outline is
+    // enough: it already closes off whatever it surrounds.
+    template<typename Mark>
+    void markTriangle(const glm::vec3* triangle, float low, float high, Mark mark) const
+    {
+        glm::vec3 polygon[5], clipped[5];
+        int count = 3;
+        for (int k = 0; k < 3; k++)
+            polygon[k] = triangle[k];
+
+        count = clipHeight(polygon, count, clipped, low, 1.0f);
+        count = clipHeight(clipped, count, polygon, high, -1.0f);
+
+        // Samples a quarter grid cell apart: gaps between marked cells are at most
+        // diagonal, which the 4-connected flood fill cannot cross
+        for (int k = 0; k < count; k++) {
+            glm::vec2 a(polygon[k].x, polygon[k].z);
+            glm::vec2 b(polygon[(k + 1) % count].x, polygon[(k + 1) % count].z);
+            int steps = (int)std::ceil(glm::length(b - a) / (CELL_SIZE * 0.25f));
+            for (int s = 0; s <= steps; s++) {
+                glm::vec2 p = steps > 0 ? a + (b - a) * ((float)s / steps) : a;
+                int x = (int)std::floor((p.x - this->origin.x) / CELL_SIZE);
+                int y = (int)std::floor((p.y - this->origin.y) / CELL_SIZE);
+                if (x >= 0 && y >= 0 && x < this->width && y < this->height)
+                    mark((size_t)y * this->width + x);
+            }
+        }
+    }
+
+    // Keeps the part with side * (y - height) >= 0
+    static int clipHeight(const glm::vec3* input, int count, glm::vec3* output, float level, float side)
+    {
+        int result = 0;
+        for (int k = 0; k < count; k++) {
+            const glm::vec3& a = input[k];
+            const glm::vec3& b = input[(k + 1) % count];
+            float da = side * (a.y - level), db = side * (b.y - level);
+            if (da >= 0.0f)
+                output[result++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                output[result++] = a + (b - a) * (da / (da - db));
+        }
+        return result;
+    }
+
+    // Flood-fills the open grid cells; regions wide enough to stand in become rooms
+    void labelRooms(const std::vector<unsigned char>& blocked)
+    {
+        size_t gridSize = blocked.size();
+
+        // Chamfer distance to the nearest blocked grid cell, in grid cells
+        std::vector<float> clearance(gridSize);
+        for (size_t g = 0; g < gridSize; g++)
+            clearance[g] = blocked[g] ? 0.0f : FLT_MAX;
+        for (int pass = 0; pass < 2; pass++) {
+            int step = pass == 0 ? 1 : -1;
+            int yStart = pass == 0 ? 0 : this->height - 1, xStart = pass == 0 ? 0 : this->width - 1;
+            for (int y = yStart; y >= 0 && y < this->height; y += step) {
+                for (int x = xStart; x >= 0 && x < this->width; x += step) {
+                    float& d = clearance[(size_t)y * this->width + x];
+                    int ny = y - step;
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx;
+                        if (nx >= 0 && nx < this->width && ny >= 0 && ny < this->height)
+                            d = std::min(d, clearance[(size_t)ny * this->width + nx] + (dx != 0 ? 1.414f : 1.0f));
+                    }
+                    int nx = x - step;
+                    if (nx >= 0 && nx < this->width)
+                        d = std::min(d, clearance[(size_t)y * this->width + nx] + 1.0f);
+                }
+            }
+        }
+
+        std::vector<int> region(gridSize, -1);
+        std::vector<float> regionClearance;
+        std::vector<bool> regionOutside;
+        std::deque<size_t> queue;
+        for (size_t seed = 0; seed < gridSize; seed++) {
+            if (blocked[seed] || region[seed] >= 0)
+                continue;
+
+            int label = (int)regionClearance.size();
+            regionClearance.push_back(0.0f);
+            regionOutside.push_back(false);
+            region[seed] = label;
+            queue.push_back(seed);
+            while (!queue.empty()) {
+                size_t g = queue.front();
+                queue.pop_front();
+                int x = (int)(g % this->width), y = (int)(g / this->width);
+                regionClearance[label] = std::max(regionClearance[label], clearance[g]);
+                if (x == 0 || y == 0 || x == this->width - 1 || y == this->height - 1)
+                    regionOutside[label] = true;
+
+                const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+                for (int n = 0; n < 4; n++) {
+                    int nx = x + offsets[n][0], ny = y + offsets[n][1];
+                    if (nx < 0 || ny < 0 || nx >= this->width || ny >= this->height)
+                        continue;
+                    size_t neighbour = (size_t)ny * this->width + nx;
+                    if (!blocked[neighbour] && region[neighbour] < 0) {
+                        region[neighbour] = label;
+                        queue.push_back(neighbour);
+                    }
+                }
+            }
+        }
+
+        // Rooms in flood order; past MAX_CELLS the rest share ALWAYS
+        std::vector<int> room(regionClearance.size(), -1);
+        this->outside = -1;
+        for (size_t r = 0; r < regionClearance.size(); r++) {
+            if (!regionOutside[r] && regionClearance[r] * CELL_SIZE < ROOM_CLEARANCE)
+                continue;
+            if (this->cells.size() >= (size_t)MAX_CELLS) {
+                room[r] = MAX_CELLS;
+                continue;
+            }
+            room[r] = (int)this->cells.size();
+            this->cells.push_back(Cell());
+            if (regionOutside[r] && this->outside < 0)
+                this->outside = room[r];
+        }
+        if (this->cells.size() >= (size_t)MAX_CELLS)
+            std::cout << "WARNING::PORTALS:: more than " << MAX_CELLS << " rooms, the rest are always drawn" << std::endl;
+
+        this->gridCell.assign(gridSize, -1);
+        for (size_t g = 0; g < gridSize; g++) {
+            if (region[g] >= 0)
+                this->gridCell[g] = room[region[g]];
+        }
+    }
+
+    // Each 8-connected run of opening grid cells becomes a portal between the two rooms
+    // that touch it most
+    void buildPortals(const std::vector<int>& opening)
+    {
+        size_t gridSize = opening.size();
+        std::vector<bool> seen(gridSize, false);
+        std::vector<size_t> run;
+        for (size_t seed = 0; seed < gridSize; seed++) {
+            if (opening[seed] < 0 || seen[seed])
+                continue;
+
+            run.clear();
+            run.push_back(seed);
+            seen[seed] = true;
+            for (size_t i = 0; i < run.size(); i++) {
+                int x = (int)(run[i] % this->width), y = (int)(run[i] / this->width);
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= this->width || ny >= this->height)
+                            continue;
+                        size_t neighbour = (size_t)ny * this->width + nx;
+                        if (opening[neighbour] >= 0 && !seen[neighbour]) {
+                            seen[neighbour] = true;
+                            run.push_back(neighbour);
+                        }
+                    }
+                }
+            }
+
+            // Rooms on either side
+            std::vector<int> touches(this->cells.size(), 0);
+            std::vector<bool> triangles(this->openings.size() / 3, false);
+            for (size_t i = 0; i < run.size(); i++) {
+                triangles[opening[run[i]]] = true;
+                int x = (int)(run[i] % this->width), y = (int)(run[i] / this->width);
+                const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+                for (int n = 0; n < 4; n++) {
+                    int nx = x + offsets[n][0], ny = y + offsets[n][1];
+                    if (nx < 0 || ny < 0 || nx >= this->width || ny >= this->height)
+                        continue;
+                    int cell = this->gridCell[(size_t)ny * this->width + nx];
+                    if (cell >= 0 && cell < MAX_CELLS)
+                        touches[cell]++;
+                }
+            }
+
+            Portal portal;
+            portal.cells[0] = portal.cells[1] = -1;
+            for (size_t c = 0; c < touches.size(); c++) {
+                if (touches[c] == 0)
+                    continue;
+                if (portal.cells[0] < 0 || touches[c] > touches[portal.cells[0]]) {
+                    portal.cells[1] = portal.cells[0];
+                    portal.cells[0] = (int)c;
+                }
+                else if (portal.cells[1] < 0 || touches[c] > touches[portal.cells[1]]) {
+                    portal.cells[1] = (int)c;
+                }
+            }
+            if (portal.cells[1] < 0)
+                continue;
+
+            portal.doorAngle = nullptr;
+            for (size_t t = 0; t < triangles.size(); t++) {
+                if (triangles[t] && this->openingDoors[t])
+                    portal.doorAngle = this->openingDoors[t];
+            }
+            this->fitQuad(triangles, portal);
+
+            size_t index = this->portals.size();
+            this->portals.push_back(portal);
+            this->cells[portal.cells[0]].portals.push_back(index);
+            this->cells[portal.cells[1]].portals.push_back(index);
+        }
+    }
+
+    // Vertical quad in the triangles' mean plane, spanning all of their corners
+    void fitQuad(const std::vector<bool>& triangles, Portal& portal) const
+    {
+        glm::vec3 normal(0.0f);
+        for (size_t t = 0; t < triangles.size(); t++) {
+            if (!triangles[t])
+                continue;
+            const glm::vec3* v = &this->openings[t * 3];
+            glm::vec3 n = glm::cross(v[1] - v[0], v[2] - v[0]);
+            n.y = 0.0f;
+            normal += glm::dot(n, normal) < 0.0f ? -n : n;
+        }
+        if (glm::length(normal) < 1e-6f)
+            normal = glm::vec3(1.0f, 0.0f, 0.0f);
+        normal = glm::normalize(normal);
+        glm::vec3 along = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), normal));
+
+        float alongMin = FLT_MAX, alongMax = -FLT_MAX, low = FLT_MAX, high = -FLT_MAX, depth = 0.0f;
+        int corners = 0;
+        for (size_t t = 0; t < triangles.size(); t++) {
+            if (!triangles[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                const glm::vec3& v = this->openings[t * 3 + k];
+                alongMin = std::min(alongMin, glm::dot(v, along));
+                alongMax = std::max(alongMax, glm::dot(v, along));
+                low = std::min(low, v.y);
+                high = std::max(high, v.y);
+                depth += glm::dot(v, normal);
+                corners++;
+            }
+        }
+        depth /= corners;
+
+        glm::vec3 base = normal * depth;
+        portal.corners[0] = base + along * alongMin + glm::vec3(0.0f, low, 0.0f);
+        portal.corners[1] = base + along * alongMax + glm::vec3(0.0f, low, 0.0f);
+        portal.corners[2] = base + along * alongMax + glm::vec3(0.0f, high, 0.0f);
+        portal.corners[3] = base + along * alongMin + glm::vec3(0.0f, high, 0.0f);
+    }
+
+    uint32_t cellBit(int cell) const
+    {
+        if (cell < 0)
+            return 0;
+        return cell >= MAX_CELLS ? ALWAYS : 1u << cell;
+    }
+
+    // Room the eye stands in, or -1 when it is outside the slab, in a wall or in a gap
+    int cellAt(const glm::vec3& eye) const
+    {
+        if (this->cells.empty() || eye.y < this->slabMin || eye.y > this->slabMax)
+            return -1;
+
+        int x = (int)std::floor((eye.x - this->origin.x) / CELL_SIZE);
+        int y = (int)std::floor((eye.z - this->origin.y) / CELL_SIZE);
+        if (x < 0 || y < 0 || x >= this->width || y >= this->height)
+            return this->outside;
+        int cell = this->gridCell[(size_t)y * this->width + x];
+        return cell < MAX_CELLS ? cell : -1;
+    }
+
+    void visit(int cell, const glm::vec3& eye, const std::vector<glm::vec4>& planes, uint32_t path, int depth)
+    {
+        this->visible |= 1u << cell;
+        if (depth >= MAX_DEPTH)
+            return;
+
+        for (size_t i = 0; i < this->cells[cell].portals.size(); i++) {
+            const Portal& portal = this->portals[this->cells[cell].portals[i]];
+            if (portal.doorAngle && *portal.doorAngle == 0.0f)
+                continue;
+            int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+            if (path & (1u << next))
+                continue;
+            if (!quadInside(portal.corners, planes))
+                continue;
+
+            // Narrow the frustum to the portal's edges, unless the eye is right at it
+            std::vector<glm::vec4> narrowed(planes);
+            glm::vec3 center = (portal.corners[0] + portal.corners[2]) * 0.5f;
+            glm::vec3 normal = glm::cross(portal.corners[1] - portal.corners[0], portal.corners[3] - portal.corners[0]);
+            if (std::fabs(glm::dot(glm::normalize(normal), eye - center)) > 0.05f) {
+                for (int k = 0; k < 4; k++) {
+                    glm::vec3 edgeNormal = glm::cross(portal.corners[k] - eye, portal.corners[(k + 1) % 4] - eye);
+                    if (glm::length(edgeNormal) < 1e-8f)
+                        continue;
+                    edgeNormal = glm::normalize(edgeNormal);
+                    if (glm::dot(edgeNormal, center - eye) < 0.0f)
+                        edgeNormal = -edgeNormal;
+                    narrowed.push_back(glm::vec4(edgeNormal, -glm::dot(edgeNormal, eye)));
+                }
+            }
+            this->visit(next, eye, narrowed, path | (1u << next), depth + 1);
+        }
+    }
+
+    // False only when every corner is behind one plane
+    static bool quadInside(const glm::vec3* corners, const std::vector<glm::vec4>& planes)
+    {
+        for (size_t p = 0; p < planes.size(); p++) {
+            int behind = 0;
+            for (int k = 0; k < 4; k++)
+                behind += glm::dot(glm::vec3(planes[p]), corners[k]) + planes[p].w < 0.0f ? 1 : 0;
+            if (behind == 4)
+                return false;
+        }
+        return true;
+    }
+};
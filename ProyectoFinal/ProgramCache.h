@@ -0,0 +1,327 @@
+#pragma once
+
+// Shader programs with a driver-side binary cache
+// Each vertex/fragment pair gets a "<vs>.<fs file>.pbin" beside the vertex shader holding
+// the linked program from glGetProgramBinary. The cache is keyed on both sources plus the
+// GL vendor, renderer and version strings, so editing a shader or updating the driver
+// falls back to compiling from source, which rewrites the file.
+// Cold compiles are issued from Request without querying any status: with
+// GL_KHR_parallel_shader_compile (or a driver that defers compilation anyway) they run on
+// the driver's threads while the caller goes on loading assets, and Finish collects them.
+// Variants of one pair (see LightingPermutations.h) pass #defines, which go right after the
+// #version line of both stages; they are part of the key and name their own file. Variants
+// requested on speculation and never used are given back with Release.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+#include "FileUtils.h"
+
+// Bump whenever the file layout below changes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+const uint32_t PROGRAM_CACHE_MAGIC = 0x4E494250;  // "PBIN" little-endian
+
+// File header, followed by the program binary
+struct ProgramCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;    // Sources and driver (ProgramCache::Key)
+    uint32_t format; // glGetProgramBinary's binaryFormat
+    uint32_t size;
+};
+
+// Handle with the same surface as Shader: Program and Use()
+struct ShaderProgram
+{
+    GLuint Program;
+
+    void Use() const { glUseProgram(this->Program); }
+};
+
+class ProgramCache
+{
+public:
+    // Needs a current context
+    ProgramCache()
+        : binaries(false), loaded(0), compiled(0), released(0), failed(false), milliseconds(0.0f)
+    {
+        GLint formats = 0;
+        if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        this->binaries = formats > 0;
+
+        // Let the driver use as many compiler threads as it likes
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+
+        const char* strings[] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER),
+            (const char*)glGetString(GL_VERSION) };
+        this->driverHash = HashBytes(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+        for (const char* text : strings)
+            if (text)
+                this->driverHash = HashBytes(text, std::strlen(text) + 1, this->driverHash);
+    }
+
+    ~ProgramCache()
+    {
+        for (GLuint program : this->programs)
+            glDeleteProgram(program);
+    }
+
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // Returns at once: the program comes from the cache or is still compiling.
+    // Do not use it (or query it) before Finish. defines is GLSL source, e.g. "#define X\n".
+    ShaderProgram Request(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = "")
+    {
+        Stopwatch stopwatch(this->milliseconds);
+        ShaderProgram result = { 0 };
+
+        std::vector<char> vertexSource, fragmentSource;
+        if (!ReadWholeFile(vertexPath, vertexSource) || !ReadWholeFile(fragmentPath, fragmentSource)) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << vertexPath << " " << fragmentPath << std::endl;
+            this->failed = true;
+            return result;
+        }
+
+        InsertDefines(vertexSource, defines);
+        InsertDefines(fragmentSource, defines);
+
+        Pending pending;
+        pending.name = vertexPath + " + " + fragmentPath;
+        pending.cachePath = vertexPath + "." + fragmentPath.substr(fragmentPath.find_last_of("/\\") + 1);
+        if (!defines.empty()) {
+            char variant[16];
+            std::snprintf(variant, sizeof(variant), ".%08x", (unsigned int)HashBytes(defines.data(), defines.size()));
+            pending.cachePath += variant;
+            std::string flags = defines.substr(0, defines.find_last_not_of('\n') + 1);
+            std::replace(flags.begin(), flags.end(), '\n', ' ');
+            pending.name += " [" + flags + "]";
+        }
+        pending.cachePath += ".pbin";
+        pending.key = Key(vertexSource, fragmentSource);
+
+        result.Program = this->LoadBinary(pending.cachePath, pending.key);
+        if (result.Program != 0) {
+            this->programs.push_back(result.Program);
+            this->loaded++;
+            return result;
+        }
+
+        pending.program = glCreateProgram();
+        pending.vertex = Compile(GL_VERTEX_SHADER, vertexSource);
+        pending.fragment = Compile(GL_FRAGMENT_SHADER, fragmentSource);
+        glAttachShader(pending.program, pending.vertex);
+        glAttachShader(pending.program, pending.fragment);
+        if (this->binaries)
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(pending.program);
+
+        this->pending.push_back(pending);
+        this->programs.push_back(pending.program);
+        result.Program = pending.program;
+        return result;
+    }
+
+    // Waits for the compiles still in flight, reports errors and stores the new binaries.
+    // False if any program failed to build.
+    bool Finish()
+    {
+        Stopwatch stopwatch(this->milliseconds);
+        for (const Pending& pending : this->pending) {
+            bool ok = CheckShader(pending.vertex, "VERTEX", pending.name) &&
+                CheckShader(pending.fragment, "FRAGMENT", pending.name);
+
+            GLint linked = GL_FALSE;
+            glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+            if (ok && !linked) {
+                GLchar infoLog[512];
+                glGetProgramInfoLog(pending.program, sizeof(infoLog), nullptr, infoLog);
+                std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << pending.name << "\n" << infoLog << std::endl;
+            }
+            ok = ok && linked;
+
+            glDetachShader(pending.program, pending.vertex);
+            glDetachShader(pending.program, pending.fragment);
+            glDeleteShader(pending.vertex);
+            glDeleteShader(pending.fragment);
+
+            if (!ok) {
+                this->failed = true;
+                continue;
+            }
+            this->compiled++;
+            if (this->binaries)
+                this->SaveBinary(pending.program, pending.cachePath, pending.key);
+        }
+        this->pending.clear();
+        return !this->failed;
+    }
+
+    // Deletes a program nothing will draw with, after Finish
+    void Release(ShaderProgram& program)
+    {
+        std::vector<GLuint>::iterator found = std::find(this->programs.begin(), this->programs.end(), program.Program);
+        if (found != this->programs.end()) {
+            glDeleteProgram(program.Program);
+            this->programs.erase(found);
+            this->released++;
+        }
+        program.Program = 0;
+    }
+
+    // Time spent inside Request and Finish, i.e. startup time the cache and the
+    // driver's compiler threads did not hide
+    void PrintStats() const
+    {
+        std::cout << "Shaders: " << this->programs.size() << " programs, "
+            << this->loaded << " from binary cache, "
+            << this->compiled << " compiled, "
+            << this->released << " unused released, "
+            << this->milliseconds << " ms blocked" << std::endl;
+    }
+
+private:
+    struct Pending
+    {
+        GLuint program;
+        GLuint vertex;
+        GLuint fragment;
+        uint64_t key;
+        std::string name;
+        std::string cachePath;
+    };
+
+    // Adds the lifetime of the scope to a total
+    struct Stopwatch
+    {
+        explicit Stopwatch(float& total)
+            : total(total), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Stopwatch()
+        {
+            this->total += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+        }
+
+        float& total;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    uint64_t Key(const std::vector<char>& vertexSource, const std::vector<char>& fragmentSource) const
+    {
+        uint64_t sizes[2] = { vertexSource.size(), fragmentSource.size() };
+        uint64_t hash = HashBytes(sizes, sizeof(sizes), this->driverHash);
+        hash = HashBytes(vertexSource.data(), vertexSource.size(), hash);
+        return HashBytes(fragmentSource.data(), fragmentSource.size(), hash);
+    }
+
+    // 0 if there is no usable binary; the driver may still reject a matching one
+    GLuint LoadBinary(const std::string& cachePath, uint64_t key) const
+    {
+        std::vector<char> file;
+        if (!this->binaries || !ReadWholeFile(cachePath, file) || file.size() < sizeof(ProgramCacheHeader))
+            return 0;
+
+        ProgramCacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key ||
+            header.size != file.size() - sizeof(header))
+            return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, file.data() + sizeof(header), (GLsizei)header.size);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void SaveBinary(GLuint program, const std::string& cachePath, uint64_t key) const
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> file(sizeof(ProgramCacheHeader) + (size_t)length);
+        ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, 0, 0 };
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, file.data() + sizeof(header));
+        header.format = format;
+        header.size = (uint32_t)written;
+        std::memcpy(file.data(), &header, sizeof(header));
+
+        if (written <= 0 || !WriteWholeFile(cachePath, file.data(), sizeof(header) + (size_t)written))
+            std::cout << "WARNING::PROGRAMCACHE:: Cannot write " << cachePath << std::endl;
+    }
+
+    // After the #version line, with a #line so compiler messages keep the file's numbering
+    static void InsertDefines(std::vector<char>& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return;
+
+        std::string text(source.begin(), source.end());
+        size_t version = text.find("#version");
+        size_t line = version == std::string::npos ? std::string::npos : text.find('\n', version);
+        if (line == std::string::npos) {
+            text = defines + "#line 1\n" + text;
+        }
+        else {
+            int next = 2 + (int)std::count(text.begin(), text.begin() + version, '\n');
+            text.insert(line + 1, defines + "#line " + std::to_string(next) + "\n");
+        }
+        source.assign(text.begin(), text.end());
+    }
+
+    static GLuint Compile(GLenum type, const std::vector<char>& source)
+    {
+        GLuint shader = glCreateShader(type);
+        const GLchar* text = source.data();
+        GLint length = (GLint)source.size();
+        glShaderSource(shader, 1, &text, &length);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    static bool CheckShader(GLuint shader, const char* stage, const std::string& name)
+    {
+        GLint success = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[512];
+            glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+            std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED " << name << "\n" << infoLog << std::endl;
+        }
+        return success == GL_TRUE;
+    }
+
+    std::vector<GLuint> programs;
+    std::vector<Pending> pending;
+    uint64_t driverHash;
+    bool binaries;
+    size_t loaded;
+    size_t compiled;
+    size_t released;
+    bool failed;
+    float milliseconds;
+};
@@ -0,0 +1,444 @@
+#pragma once
+
+// Sorted render queue
+// Every frame objects submit one packet per draw; Flush() sorts the packets by a 64-bit
+// key and walks them in order, touching GL state only where it differs from the previous
+// packet. Key layout, most significant bits first:
+//   opaque:      [pass:2][program:6][material:24][depth:32]  front to back within a material
+//   transparent: [pass:2][~depth:32][program:6][material:24] back to front over everything
+// Depth is the camera distance to the packet's world bounding-box centre; non-negative
+// floats keep their order when compared as integers. Meshes outside the view frustum,
+// in rooms the portals do not reach or behind the occlusion buffer's occluders never
+// become packets. With a LodSelector, each visible mesh draws the level its screen size
+// calls for. Flush() computes the normal matrix of every transform in one batch and
+// sets it next to the model matrix, so lighting.vs does not invert per vertex.
+// Flush() can draw one pass at a time, with the opaque packets going through other
+// programs: the deferred pipeline fills its G-buffer with the opaque pass, each packet
+// switched to the G-buffer variant of its program, and draws the transparent one forward
+// afterwards.
+// Packets take their program from a per-material table (see LightingPermutations.h), so
+// each material draws with the shader variant built for its features.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "ShaderUniforms.h"
+#include "CachedModel.h"
+#include "Frustum.h"
+#include "LodSelector.h"
+#include "NormalMatrix.h"
+#include "OcclusionBuffer.h"
+#include "PortalCells.h"
+#include "StaticBatch.h"
+#include "TextureStreamer.h"
+
+// Uniforms a program needs to draw queue packets, resolved once
+struct RenderProgram
+{
+    GLuint program;
+    Uniform<glm::mat4> model;
+    Uniform<glm::mat3> normalMatrix;
+    Uniform<float> alpha;
+    MaterialUniforms material;
+    VertexFormatUniforms vertexFormat;
+
+    explicit RenderProgram(const ShaderUniforms& uniforms)
+        : program(uniforms.Program()),
+        model(uniforms.Get<glm::mat4>("model")),
+        normalMatrix(uniforms.Get<glm::mat3>("normalMatrix")),
+        alpha(uniforms.Get<float>("alpha")),
+        material(uniforms),
+        vertexFormat(uniforms)
+    {
+    }
+};
+
+class RenderQueue
+{
+public:
+    // Flush() pass masks
+    static const unsigned int OPAQUE_PASS = 1;
+    static const unsigned int TRANSPARENT_PASS = 2;
+    static const unsigned int ALL_PASSES = OPAQUE_PASS | TRANSPARENT_PASS;
+
+    explicit RenderQueue(TextureStreamer& streamer)
+        : streamer(streamer), cameraPos(0.0f), frustum(glm::mat4(1.0f)), occlusion(nullptr), cells(nullptr), lods(nullptr),
+        sorted(false), visibleMeshes(0), culledMeshes(0), occludedMeshes(0), drawCalls(0), stateChanges(0), triangles(0)
+    {
+    }
+
+    // Programs are referenced by the returned id (at most 64)
+    unsigned int AddProgram(const ShaderUniforms& uniforms)
+    {
+        this->programs.push_back(RenderProgram(uniforms));
+        return (unsigned int)this->programs.size() - 1;
+    }
+
+    // occlusion, cells and lods, when given, must already be updated for the same camera
+    void Begin(const glm::vec3& viewPos, const glm::mat4& viewProjection, const OcclusionBuffer* occlusion = nullptr,
+        const PortalCells* cells = nullptr, const LodSelector* lods = nullptr)
+    {
+        this->cameraPos = viewPos;
+        this->frustum = Frustum(viewProjection);
+        this->occlusion = occlusion;
+        this->cells = cells;
+        this->lods = lods;
+        this->visibleMeshes = 0;
+        this->culledMeshes = 0;
+        this->occludedMeshes = 0;
+        this->drawCalls = 0;
+        this->stateChanges = 0;
+        this->triangles = 0;
+        this->packets.clear();
+        this->order.clear();
+        this->sorted = false;
+        this->transforms.clear();
+        this->transforms.push_back(glm::mat4(1.0f));  // Index 0: static geometry is already in world space
+    }
+
+    // One packet per visible mesh; alpha below 1 puts the model in the transparent pass.
+    // programs holds a queue program per material. lodState keeps each mesh's level between
+    // frames, for the selector's hysteresis; it belongs to the object, since two instances
+    // of a model sit at different distances
+    void Submit(const CachedModel& model, const std::vector<unsigned int>& programs, const glm::mat4& transform,
+        float alpha = 1.0f, std::vector<unsigned char>* lodState = nullptr)
+    {
+        if (model.VertexArray() == 0)
+            return;
+
+        // Mesh boxes follow the transform, so they are rebuilt for each submission
+        this->meshBounds.Clear();
+        this->meshMin.resize(model.meshes.size());
+        this->meshMax.resize(model.meshes.size());
+        for (size_t i = 0; i < model.meshes.size(); i++) {
+            TransformAabb(transform, model.meshes[i].aabbMin, model.meshes[i].aabbMax, this->meshMin[i], this->meshMax[i]);
+            this->meshBounds.Add(this->meshMin[i], this->meshMax[i]);
+        }
+
+        size_t visibleCount = this->meshBounds.Cull(this->frustum, this->meshVisible);
+        if (this->occlusion || this->cells) {
+            for (size_t i = 0; i < model.meshes.size(); i++) {
+                if (!this->meshVisible[i])
+                    continue;
+                if ((this->cells && !this->cells->IsVisible(this->cells->CellMask(this->meshMin[i], this->meshMax[i])))
+                    || (this->occlusion && !this->occlusion->IsVisible(this->meshMin[i], this->meshMax[i]))) {
+                    this->meshVisible[i] = 0;
+                    this->occludedMeshes++;
+                    visibleCount--;
+                }
+            }
+        }
+        this->visibleMeshes += (unsigned int)visibleCount;
+        this->culledMeshes += (unsigned int)(model.meshes.size() - visibleCount);
+        if (visibleCount == 0)
+            return;
+
+        float errorScale = this->lods ? LodSelector::MaxScale(transform) : 0.0f;
+        if (lodState)
+            lodState->resize(model.meshes.size(), 0);
+
+        this->transforms.push_back(transform);
+        for (size_t i = 0; i < model.meshes.size(); i++) {
+            if (!this->meshVisible[i])
+                continue;
+
+            const CacheMesh& mesh = model.meshes[i];
+            GLuint material = model.MeshMaterial(i);
+            unsigned int level = 0;
+            if (this->lods) {
+                level = this->lods->Select(mesh.lods, mesh.lodCount, errorScale, lodState ? (*lodState)[i] : 0,
+                    this->meshMin[i], this->meshMax[i]);
+                if (lodState)
+                    (*lodState)[i] = (unsigned char)level;
+            }
+
+            Packet packet;
+            packet.program = programs[material];
+            packet.transform = this->transforms.size() - 1;
+            packet.VAO = model.VertexArray();
+            packet.format = &model.Format();
+            packet.diffuse = model.DiffuseTexture(material);
+            packet.diffuseArray = 0;
+            packet.specular = model.SpecularTexture(material);
+            packet.shininess = model.Shininess(material);
+            packet.alpha = alpha;
+            packet.batch = nullptr;
+            packet.group = 0;
+            packet.count = (GLsizei)mesh.lods[level].indexCount;
+            packet.firstIndex = mesh.lods[level].firstIndex;
+            packet.baseVertex = (GLint)mesh.baseVertex;
+            this->push(packet, (this->meshMin[i] + this->meshMax[i]) * 0.5f);
+        }
+    }
+
+    // One packet per material group with at least one visible mesh; programs holds a queue
+    // program per group
+    void Submit(StaticBatch& batch, const std::vector<unsigned int>& programs)
+    {
+        size_t visibleCount = batch.Cull(this->frustum, this->occlusion, this->cells, this->lods);
+        this->visibleMeshes += (unsigned int)visibleCount;
+        this->culledMeshes += (unsigned int)(batch.RangeCount() - visibleCount);
+        this->occludedMeshes += (unsigned int)batch.OccludedCount();
+
+        const std::vector<StaticBatch::Group>& groups = batch.Groups();
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (groups[g].counts.empty())
+                continue;
+
+            Packet packet;
+            packet.program = programs[g];
+            packet.transform = 0;
+            packet.VAO = batch.VertexArray();
+            packet.format = &batch.Format();
+            packet.diffuse = groups[g].key.diffuse;
+            packet.diffuseArray = groups[g].key.layered ? batch.DiffuseArray() : 0;
+            packet.specular = groups[g].key.specular;
+            packet.shininess = groups[g].key.shininess;
+            packet.alpha = groups[g].key.alpha;
+            packet.batch = &batch;
+            packet.group = g;
+            packet.count = 0;
+            packet.firstIndex = 0;
+            packet.baseVertex = 0;
+            this->push(packet, (groups[g].aabbMin + groups[g].aabbMax) * 0.5f);
+        }
+    }
+
+    // Draws the packets of the given passes submitted since Begin, sorted. opaquePrograms,
+    // when given, maps a program id to the one its opaque packets use instead.
+    void Flush(unsigned int passes = ALL_PASSES, const std::vector<unsigned int>* opaquePrograms = nullptr)
+    {
+        if (!this->sorted) {
+            std::sort(this->order.begin(), this->order.end());
+            this->normals.resize(this->transforms.size());
+            NormalMatrices(this->transforms.data(), this->transforms.size(), this->normals.data());
+            this->sorted = true;
+        }
+
+        // Sentinels force the first packet to set everything
+        const unsigned int NONE = ~0u;
+        unsigned int program = NONE;
+        size_t transform = NONE;
+        GLuint VAO = NONE, diffuse = NONE, diffuseArray = NONE, specular = NONE;
+        const VertexFormat* format = nullptr;
+        float shininess = -1.0f, alpha = -1.0f;
+        bool blending = false;
+
+        for (size_t i = 0; i < this->order.size(); i++) {
+            const Packet& packet = this->packets[this->order[i].second];
+            bool transparent = packet.alpha < 1.0f;
+            unsigned int pass = OPAQUE_PASS;
+            if (transparent)
+                pass = TRANSPARENT_PASS;
+            if (!(passes & pass))
+                continue;
+            unsigned int packetProgram = packet.program;
+            if (!transparent && opaquePrograms && packetProgram < opaquePrograms->size())
+                packetProgram = (*opaquePrograms)[packetProgram];
+            const RenderProgram& target = this->programs[packetProgram];
+
+            if (transparent != blending) {
+                if (transparent) {
+                    glEnable(GL_BLEND);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                else {
+                    glDisable(GL_BLEND);
+                }
+                blending = transparent;
+                this->stateChanges++;
+            }
+
+            // Uniform values belong to the program, so a switch invalidates them
+            if (packetProgram != program) {
+                glUseProgram(target.program);
+                program = packetProgram;
+                transform = NONE;
+                format = nullptr;
+                shininess = alpha = -1.0f;
+                this->stateChanges++;
+            }
+
+            if (packet.transform != transform) {
+                ShaderUniforms::Set(target.model, this->transforms[packet.transform]);
+                ShaderUniforms::Set(target.normalMatrix, this->normals[packet.transform]);
+                transform = packet.transform;
+            }
+
+            if (packet.alpha != alpha) {
+                ShaderUniforms::Set(target.alpha, packet.alpha);
+                alpha = packet.alpha;
+            }
+
+            if (packet.VAO != VAO) {
+                glBindVertexArray(packet.VAO);
+                VAO = packet.VAO;
+                this->stateChanges++;
+            }
+            if (packet.format != format) {
+                target.vertexFormat.Set(*packet.format);
+                format = packet.format;
+            }
+
+            // Handles resolve every frame: streamed textures replace their placeholders.
+            // Layered packets sample the batch's array instead, bound to the same unit.
+            if (packet.diffuseArray) {
+                if (packet.diffuseArray != diffuseArray) {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, packet.diffuseArray);
+                    diffuseArray = packet.diffuseArray;
+                    this->stateChanges++;
+                }
+            }
+            else {
+                GLuint diffuseName = this->streamer.Texture(packet.diffuse);
+                if (diffuseName != diffuse) {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, diffuseName);
+                    diffuse = diffuseName;
+                    this->stateChanges++;
+                }
+            }
+            GLuint specularName = this->streamer.Texture(packet.specular);
+            if (specularName != specular) {
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, specularName);
+                specular = specularName;
+                this->stateChanges++;
+            }
+
+            if (packet.shininess != shininess) {
+                ShaderUniforms::Set(target.material.shininess, packet.shininess);
+                shininess = packet.shininess;
+            }
+
+            if (packet.batch) {
+                packet.batch->DrawGroup(packet.group);
+                this->triangles += packet.batch->Groups()[packet.group].indexCount / 3;
+            }
+            else {
+                glDrawElementsBaseVertex(GL_TRIANGLES, packet.count, packet.format->indexType,
+                    (GLvoid*)(size_t)(packet.firstIndex * packet.format->indexSize), packet.baseVertex);
+                this->triangles += (unsigned int)packet.count / 3;
+            }
+            this->drawCalls++;
+        }
+
+        if (blending)
+            glDisable(GL_BLEND);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Meshes submitted since Begin; culled also counts the occluded ones, which the portal
+    // cells or the occlusion buffer hid
+    unsigned int VisibleMeshes() const { return this->visibleMeshes; }
+    unsigned int CulledMeshes() const { return this->culledMeshes; }
+    unsigned int OccludedMeshes() const { return this->occludedMeshes; }
+
+    // Flushes since Begin
+    unsigned int DrawCalls() const { return this->drawCalls; }
+    unsigned int StateChanges() const { return this->stateChanges; }
+    unsigned int Triangles() const { return this->triangles; }
+
+private:
+    struct Packet
+    {
+        unsigned int program;
+        size_t transform;        // Index into transforms
+        GLuint VAO;
+        const VertexFormat* format;  // Of the VAO's buffers
+        TextureHandle diffuse;
+        GLuint diffuseArray;     // Batch groups with layered diffuse maps, else 0
+        TextureHandle specular;
+        float shininess;
+        float alpha;
+        const StaticBatch* batch;  // Set for batch groups, which draw through the batch
+        size_t group;
+        GLsizei count;
+        GLuint firstIndex;
+        GLint baseVertex;
+    };
+
+    struct MaterialKey
+    {
+        TextureHandle diffuse;
+        TextureHandle specular;
+        float shininess;
+
+        bool operator<(const MaterialKey& other) const
+        {
+            if (this->diffuse != other.diffuse)
+                return this->diffuse < other.diffuse;
+            if (this->specular != other.specular)
+                return this->specular < other.specular;
+            return this->shininess < other.shininess;
+        }
+    };
+
+    TextureStreamer& streamer;
+    std::vector<RenderProgram> programs;
+    glm::vec3 cameraPos;
+    Frustum frustum;
+    const OcclusionBuffer* occlusion;  // Optional, this frame only
+    const PortalCells* cells;          // Optional, this frame only
+    const LodSelector* lods;           // Optional, this frame only
+    bool sorted;                       // order and normals are ready for Flush()
+    std::vector<glm::mat4> transforms;
+    std::vector<glm::mat3> normals;                    // Of transforms, filled by Flush()
+    std::vector<Packet> packets;
+    std::vector<std::pair<uint64_t, uint32_t> > order;  // Sort key, packet index
+    std::map<MaterialKey, uint32_t> materialIds;       // Stable across frames
+    AabbList meshBounds;                               // Scratch for Submit(CachedModel)
+    std::vector<glm::vec3> meshMin, meshMax;
+    std::vector<unsigned char> meshVisible;
+    unsigned int visibleMeshes;
+    unsigned int culledMeshes;
+    unsigned int occludedMeshes;
+    unsigned int drawCalls;
+    unsigned int stateChanges;
+    unsigned int triangles;
+
+    void push(const Packet& packet, const glm::vec3& center)
+    {
+        float distance = glm::length(center - this->cameraPos);
+        uint32_t depth;
+        std::memcpy(&depth, &distance, sizeof(depth));
+
+        uint64_t material = this->materialId(packet.diffuse, packet.specular, packet.shininess) & 0xFFFFFF;
+        uint64_t program = packet.program & 0x3F;
+        uint64_t key;
+        if (packet.alpha < 1.0f)
+            key = (1ull << 62) | ((uint64_t)(~depth) << 30) | (program << 24) | material;
+        else
+            key = (program << 56) | (material << 32) | depth;
+
+        this->order.push_back(std::make_pair(key, (uint32_t)this->packets.size()));
+        this->packets.push_back(packet);
+    }
+
+    uint32_t materialId(TextureHandle diffuse, TextureHandle specular, float shininess)
+    {
+        MaterialKey key;
+        key.diffuse = diffuse;
+        key.specular = specular;
+        key.shininess = shininess;
+        std::map<MaterialKey, uint32_t>::iterator found = this->materialIds.find(key);
+        if (found != this->materialIds.end())
+            return found->second;
+
+        uint32_t id = (uint32_t)this->materialIds.size();
+        this->materialIds.insert(std::make_pair(key, id));
+        return id;
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+// Ray picking over the whole scene
+// Two levels: every object's TriangleBvh is built once in model space, and a small SAH
+// tree over the objects' world boxes sits on top. Moving an object only changes its
+// instance transform; Refit() then updates the top-level boxes without touching any
+// triangle. Rays are carried into each object's space by its inverse transform, so hit
+// distances stay in world units.
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "Frustum.h"
+
+class ScenePicker
+{
+public:
+    struct Hit
+    {
+        int object;      // Id returned by Add
+        float distance;  // Along the ray direction passed to Cast
+        uint32_t mesh;   // Mesh index inside the object's model
+    };
+
+    ScenePicker()
+        : dirty(false)
+    {
+    }
+
+    // The TriangleBvh must outlive the picker; returns the object's id, or -1 for a
+    // model without triangles (which can never be hit)
+    int Add(const TriangleBvh& bvh, const glm::mat4& world)
+    {
+        if (bvh.Empty())
+            return -1;
+
+        Instance instance;
+        instance.bvh = &bvh;
+        this->instances.push_back(instance);
+        this->boundsMin.push_back(glm::vec3(0.0f));
+        this->boundsMax.push_back(glm::vec3(0.0f));
+        int id = (int)this->instances.size() - 1;
+        this->SetTransform(id, world);
+        return id;
+    }
+
+    // Builds the top level; call once after every Add
+    void Build()
+    {
+        this->top.Build(this->boundsMin, this->boundsMax);
+        this->dirty = false;
+    }
+
+    void SetTransform(int id, const glm::mat4& world)
+    {
+        if (id < 0)
+            return;
+
+        Instance& instance = this->instances[id];
+        if (instance.world == world)
+            return;
+
+        instance.world = world;
+        instance.inverse = glm::inverse(world);
+        TransformAabb(world, instance.bvh->aabbMin, instance.bvh->aabbMax, this->boundsMin[id], this->boundsMax[id]);
+        this->dirty = true;
+    }
+
+    // Cheap: O(objects), only when a transform changed since the last call
+    void Refit()
+    {
+        if (!this->dirty)
+            return;
+        this->top.Refit(this->boundsMin, this->boundsMax);
+        this->dirty = false;
+    }
+
+    // Closest hit along origin + t * direction, t > 0
+    bool Cast(const glm::vec3& origin, const glm::vec3& direction, Hit& hit) const
+    {
+        float closest = FLT_MAX;
+        hit.object = -1;
+        this->top.Traverse(origin, direction, closest, [&](uint32_t object, float& tMax) {
+            const Instance& instance = this->instances[object];
+            glm::vec3 localOrigin = glm::vec3(instance.inverse * glm::vec4(origin, 1.0f));
+            glm::vec3 localDirection = glm::mat3(instance.inverse) * direction;
+
+            uint32_t mesh;
+            if (!instance.bvh->Intersect(localOrigin, localDirection, tMax, mesh))
+                return false;
+            hit.object = (int)object;
+            hit.mesh = mesh;
+            return true;
+        });
+        hit.distance = closest;
+        return hit.object >= 0;
+    }
+
+private:
+    struct Instance
+    {
+        const TriangleBvh* bvh;
+        glm::mat4 world;
+        glm::mat4 inverse;
+
+        Instance()
+            : bvh(nullptr), world(0.0f), inverse(0.0f)
+        {
+        }
+    };
+
+    std::vector<Instance> instances;
+    std::vector<glm::vec3> boundsMin, boundsMax;  // World space, per instance
+    Bvh top;
+    bool dirty;
+};
@@ -4,14 +4,20 @@ layout (location = 0) in vec3 position;
 
 out vec3 ourColor;
 
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 uniform mat4 transform;
 uniform vec3 color;
 
 void main()
 {
-    gl_Position =projection*view*model*vec4(position, 1.0f);
+    gl_Position = viewProjection * model * vec4(position, 1.0f);
     ourColor = color;
 }
\ No newline at end of file
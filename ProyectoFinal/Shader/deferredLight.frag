@@ -0,0 +1,209 @@
+#version 330 core
+// Deferred shading: one light per pass over the G-buffer (gbuffer.frag), added up with
+// blending. The Calc* functions are lighting.frag's, with the material read back from
+// the G-buffer.
+
+struct DirLight
+{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight
+{
+    vec3 position;
+    float radius;
+
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+flat in int LightIndex;
+
+out vec4 color;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    DirLight dirLight;
+    SpotLight spotLight;
+};
+
+uniform int lightType;  // 0 directional, 1 point, 2 spot
+uniform samplerBuffer pointLightData;
+
+// G-buffer
+uniform sampler2D albedoSpecularMap;
+uniform sampler2D normalMap;
+uniform sampler2D shininessMap;
+uniform sampler2D depthMap;
+uniform mat4 inverseViewProjection;
+uniform vec2 inverseScreenSize;
+
+// Function prototypes
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess );
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess );
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess );
+PointLight FetchPointLight( int index );
+vec3 DecodeNormal( vec2 p );
+
+void main( )
+{
+    ivec2 pixel = ivec2( gl_FragCoord.xy );
+    float depth = texelFetch( depthMap, pixel, 0 ).r;
+    if ( depth >= 1.0f )
+        discard;  // Sky: keeps the clear colour
+
+    // World position from depth
+    vec4 clip = vec4( gl_FragCoord.xy * inverseScreenSize * 2.0f - 1.0f, depth * 2.0f - 1.0f, 1.0f );
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 albedoSpecular = texelFetch( albedoSpecularMap, pixel, 0 );
+    vec3 norm = DecodeNormal( texelFetch( normalMap, pixel, 0 ).xy );
+    float shininess = texelFetch( shininessMap, pixel, 0 ).r;
+    vec3 viewDir = normalize( viewPos - fragPos );
+    vec3 diffuseColor = albedoSpecular.rgb;
+    vec3 specularColor = vec3( albedoSpecular.a );
+
+    vec3 result;
+    if ( lightType == 0 )
+        result = CalcDirLight( dirLight, norm, viewDir, diffuseColor, specularColor, shininess );
+    else if ( lightType == 1 )
+        result = CalcPointLight( FetchPointLight( LightIndex ), norm, fragPos, viewDir, diffuseColor, specularColor, shininess );
+    else
+        result = CalcSpotLight( spotLight, norm, fragPos, viewDir, diffuseColor, specularColor, shininess );
+
+    color = vec4( result, 1.0 );
+}
+
+// Same as decodeNormal in lighting.vs
+vec3 DecodeNormal( vec2 p )
+{
+    vec3 n = vec3( p, 1.0f - abs( p.x ) - abs( p.y ) );
+    float t = max( -n.z, 0.0f );
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize( n );
+}
+
+PointLight FetchPointLight( int index )
+{
+    vec4 t0 = texelFetch( pointLightData, index * 4 );
+    vec4 t1 = texelFetch( pointLightData, index * 4 + 1 );
+    vec4 t2 = texelFetch( pointLightData, index * 4 + 2 );
+    vec4 t3 = texelFetch( pointLightData, index * 4 + 3 );
+    return PointLight( t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w );
+}
+
+// Calculates the color when using a directional light.
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess )
+{
+    vec3 lightDir = normalize( -light.direction );
+
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+
+    // Combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    return ( ambient + diffuse + specular );
+}
+
+// Calculates the color when using a point light.
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess )
+{
+    vec3 lightDir = normalize( light.position - fragPos );
+
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+
+    // Attenuation, faded out to zero at the light's radius
+    float distance = length( light.position - fragPos );
+    float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
+    float window = clamp( 1.0f - pow( distance / light.radius, 4.0f ), 0.0f, 1.0f );
+    attenuation *= window * window;
+
+    // Combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    return ( ambient + diffuse + specular );
+}
+
+// Calculates the color when using a spot light.
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess )
+{
+    vec3 lightDir = normalize( light.position - fragPos );
+
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+
+    // Attenuation
+    float distance = length( light.position - fragPos );
+    float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
+
+    // Spotlight intensity
+    float theta = dot( lightDir, normalize( -light.direction ) );
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp( ( theta - light.outerCutOff ) / epsilon, 0.0, 1.0 );
+
+    // Combine results
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+
+    return ( ambient + diffuse + specular );
+}
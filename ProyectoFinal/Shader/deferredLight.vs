@@ -0,0 +1,38 @@
+#version 330 core
+// Deferred light passes (DeferredRenderer.h): a full-screen triangle, one instance of
+// the unit sphere per point light, or the spot light's cone
+layout (location = 0) in vec3 position;
+
+flat out int LightIndex;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
+
+uniform bool fullscreen;
+uniform int lightType;                 // 0 directional, 1 point, 2 spot
+uniform samplerBuffer pointLightData;  // 4 texels per light, position and radius first
+uniform mat4 volumeTransform;          // Spot cone
+
+void main()
+{
+    LightIndex = gl_InstanceID;
+    if (fullscreen) {
+        gl_Position = vec4(gl_VertexID == 1 ? 3.0f : -1.0f, gl_VertexID == 2 ? 3.0f : -1.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    vec3 worldPosition;
+    if (lightType == 1) {
+        vec4 sphere = texelFetch(pointLightData, gl_InstanceID * 4);
+        worldPosition = sphere.xyz + position * sphere.w;
+    }
+    else {
+        worldPosition = vec3(volumeTransform * vec4(position, 1.0f));
+    }
+    gl_Position = viewProjection * vec4(worldPosition, 1.0f);
+}
@@ -0,0 +1,61 @@
+#version 330 core
+// Deferred geometry pass, after lighting.vs: surface properties for deferredLight.frag
+// (layout in DeferredRenderer.h)
+// Compiled per opaque material by LightingPermutations.h, with lighting.frag's defines:
+//   ALPHA_TEST    discards texels under 0.1 alpha
+//   SPECULAR_MAP  samples material.specular; without one the specular channel is 0
+//   TEXTURE_ARRAY material.diffuse is the static batch's array, layer per vertex
+
+struct Material
+{
+#ifdef TEXTURE_ARRAY
+    sampler2DArray diffuse;
+#else
+    sampler2D diffuse;
+#endif
+    sampler2D specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+#ifdef TEXTURE_ARRAY
+flat in float Layer;
+#define DIFFUSE_COORDS vec3( TexCoords, Layer )
+#else
+#define DIFFUSE_COORDS TexCoords
+#endif
+
+layout (location = 0) out vec4 albedoSpecular;  // RGBA8: diffuse map, specular map as one intensity
+layout (location = 1) out vec2 normalOctahedral;  // RG16F: world-space normal
+layout (location = 2) out float shininess;        // R16F
+
+uniform Material material;
+
+// Inverse of decodeNormal in lighting.vs
+vec2 encodeNormal( vec3 n )
+{
+    vec2 p = n.xy / ( abs( n.x ) + abs( n.y ) + abs( n.z ) );
+    if ( n.z < 0.0f )
+        p = ( 1.0f - abs( p.yx ) ) * vec2( p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f );
+    return p;
+}
+
+void main( )
+{
+    vec4 diffuseSample = texture( material.diffuse, DIFFUSE_COORDS );
+#ifdef ALPHA_TEST
+    if ( diffuseSample.a < 0.1 )
+        discard;
+#endif
+
+#ifdef SPECULAR_MAP
+    float specularIntensity = dot( vec3( texture( material.specular, TexCoords ) ), vec3( 1.0f / 3.0f ) );
+#else
+    float specularIntensity = 0.0f;
+#endif
+    albedoSpecular = vec4( diffuseSample.rgb, specularIntensity );
+    normalOctahedral = encodeNormal( normalize( Normal ) );
+    shininess = material.shininess;
+}
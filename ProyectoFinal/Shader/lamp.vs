@@ -3,12 +3,18 @@ layout (location = 0) in vec3 position;
 
 
 
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    gl_Position = viewProjection * model * vec4(position, 1.0f);
     
 }
\ No newline at end of file
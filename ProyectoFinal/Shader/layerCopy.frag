@@ -0,0 +1,13 @@
+#version 330 core
+// Scales a streamed texture into an array layer (TextureLayers.h). The derivatives pick
+// the source mip that matches the level being drawn.
+in vec2 TexCoords;
+
+out vec4 color;
+
+uniform sampler2D source;  // Unit 0
+
+void main()
+{
+    color = texture(source, TexCoords);
+}
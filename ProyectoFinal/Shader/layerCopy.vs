@@ -0,0 +1,11 @@
+#version 330 core
+// Full-screen triangle for TextureLayers.h: every texel of the layer level being drawn
+// samples the source texture at its centre
+out vec2 TexCoords;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID == 1 ? 3.0f : -1.0f, gl_VertexID == 2 ? 3.0f : -1.0f);
+    TexCoords = corner * 0.5f + 0.5f;
+    gl_Position = vec4(corner, 0.0f, 1.0f);
+}
@@ -1,14 +1,30 @@
 #version 330 core
 
-#define NUMBER_OF_POINT_LIGHTS 4
+// Compiled per material by LightingPermutations.h, which defines:
+//   TRANSPARENT   blended pass: alpha is the diffuse map's alpha times the alpha uniform
+//   ALPHA_TEST    discards texels under 0.1 alpha
+//   SPECULAR_MAP  samples material.specular; without one the material has no highlight
+//   TEXTURE_ARRAY material.diffuse is the static batch's array, layer per vertex
+//   POINT_LIGHTS  walks the light clusters
+//   SPOT_LIGHT
+
+// Cluster grid, as in ClusteredLights.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
 
 struct Material
 {
+#ifdef TEXTURE_ARRAY
+    sampler2DArray diffuse;
+#else
     sampler2D diffuse;
+#endif
     sampler2D specular;
     float shininess;
 };
 
+// Light structs are packed for std140: every vec3 shares its 16 bytes with a float
 struct DirLight
 {
     vec3 direction;
@@ -18,79 +34,135 @@ struct DirLight
     vec3 specular;
 };
 
+// Point lights come from the cluster tables: 4 texels each (ClusteredLights.h)
 struct PointLight
 {
     vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;
+    float radius;
     
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 struct SpotLight
 {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
     
-    float constant;
-    float linear;
-    float quadratic;
-    
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#ifdef TEXTURE_ARRAY
+flat in float Layer;
+#define DIFFUSE_COORDS vec3( TexCoords, Layer )
+#else
+#define DIFFUSE_COORDS TexCoords
+#endif
 
 out vec4 color;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NUMBER_OF_POINT_LIGHTS];
-uniform SpotLight spotLight;
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    DirLight dirLight;
+    SpotLight spotLight;
+};
+
 uniform Material material;
-uniform int transparency;
+uniform float alpha;
+
+// Cluster tables
+uniform samplerBuffer pointLightData;  // 4 texels per light
+uniform usamplerBuffer clusterLights;  // First index, count
+uniform usamplerBuffer lightIndices;
+uniform vec4 clusterGrid;              // xy clusters per pixel, z/w depth slice scale/bias
 
 // Function prototypes
-vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir );
-vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
-vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor );
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor );
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor );
+PointLight FetchPointLight( int index );
 
 void main( )
 {
-    // Properties
+    // Properties; the maps are sampled once and shared by every light
     vec3 norm = normalize( Normal );
     vec3 viewDir = normalize( viewPos - FragPos );
+    vec4 diffuseSample = texture( material.diffuse, DIFFUSE_COORDS );
+#ifdef SPECULAR_MAP
+    vec3 specularColor = vec3( texture( material.specular, TexCoords ) );
+#else
+    vec3 specularColor = vec3( 0.0f );
+#endif
+    
+    float texAlpha = diffuseSample.a;
+#ifdef ALPHA_TEST
+    if ( texAlpha < 0.1 )
+        discard;
+#endif
     
     // Directional lighting
-    vec3 result = CalcDirLight( dirLight, norm, viewDir );
+    vec3 result = CalcDirLight( dirLight, norm, viewDir, diffuseSample.rgb, specularColor );
     
-    // Point lights
-    for ( int i = 0; i < NUMBER_OF_POINT_LIGHTS; i++ )
+#ifdef POINT_LIGHTS
+    // Point lights touching this fragment's cluster
+    float viewDepth = -( view * vec4( FragPos, 1.0f ) ).z;
+    ivec3 cluster = ivec3( gl_FragCoord.xy * clusterGrid.xy, log( viewDepth ) * clusterGrid.z + clusterGrid.w );
+    cluster = clamp( cluster, ivec3( 0 ), ivec3( CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1 ) );
+    uvec2 range = texelFetch( clusterLights, ( cluster.z * CLUSTER_Y + cluster.y ) * CLUSTER_X + cluster.x ).xy;
+    for ( uint i = 0u; i < range.y; i++ )
     {
-        result += CalcPointLight( pointLights[i], norm, FragPos, viewDir );
+        int index = int( texelFetch( lightIndices, int( range.x + i ) ).x );
+        result += CalcPointLight( FetchPointLight( index ), norm, FragPos, viewDir, diffuseSample.rgb, specularColor );
     }
     
+#endif
+    
+#ifdef SPOT_LIGHT
     // Spot light
-    result += CalcSpotLight( spotLight, norm, FragPos, viewDir );
- 	
-    color = vec4( result,texture(material.diffuse, TexCoords).rgb );
-	  if(color.a < 0.1 && transparency==1)
-        discard;
+    result += CalcSpotLight( spotLight, norm, FragPos, viewDir, diffuseSample.rgb, specularColor );
+#endif
+    
+#ifdef TRANSPARENT
+    color = vec4( result, texAlpha * alpha );
+#else
+    color = vec4( result, 1.0 );
+#endif
 
 }
 
+PointLight FetchPointLight( int index )
+{
+    vec4 t0 = texelFetch( pointLightData, index * 4 );
+    vec4 t1 = texelFetch( pointLightData, index * 4 + 1 );
+    vec4 t2 = texelFetch( pointLightData, index * 4 + 2 );
+    vec4 t3 = texelFetch( pointLightData, index * 4 + 3 );
+    return PointLight( t0.xyz, t0.w, t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w );
+}
+
 // Calculates the color when using a directional light.
-vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir )
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor )
 {
     vec3 lightDir = normalize( -light.direction );
     
@@ -98,19 +170,23 @@ vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#ifdef SPECULAR_MAP
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#else
+    float spec = 0.0f;
+#endif
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     
     return ( ambient + diffuse + specular );
 }
 
 // Calculates the color when using a point light.
-vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor )
 {
     vec3 lightDir = normalize( light.position - fragPos );
     
@@ -118,17 +194,23 @@ vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#ifdef SPECULAR_MAP
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#else
+    float spec = 0.0f;
+#endif
     
-    // Attenuation
+    // Attenuation, faded out to zero at the light's radius
     float distance = length( light.position - fragPos );
     float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
+    float window = clamp( 1.0f - pow( distance / light.radius, 4.0f ), 0.0f, 1.0f );
+    attenuation *= window * window;
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -138,7 +220,7 @@ vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
 }
 
 // Calculates the color when using a spot light.
-vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor )
 {
     vec3 lightDir = normalize( light.position - fragPos );
     
@@ -146,8 +228,12 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float diff = max( dot( normal, lightDir ), 0.0 );
     
     // Specular shading
+#ifdef SPECULAR_MAP
     vec3 reflectDir = reflect( -lightDir, normal );
     float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material.shininess );
+#else
+    float spec = 0.0f;
+#endif
     
     // Attenuation
     float distance = length( light.position - fragPos );
@@ -159,9 +245,9 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float intensity = clamp( ( theta - light.outerCutOff ) / epsilon, 0.0, 1.0 );
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material.diffuse, TexCoords ) );
-    vec3 specular = light.specular * spec * vec3( texture( material.specular, TexCoords ) );
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -1,20 +1,57 @@
 #version 330 core
+// Packed vertices (VertexFormat.h) arrive normalized: position and texCoords in [0, 1]
+// over their buffer's range, normal as octahedral xy. With TEXTURE_ARRAY (the static
+// batch) each vertex also carries its diffuse layer.
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoords;
+#ifdef TEXTURE_ARRAY
+layout (location = 3) in float layer;
+#endif
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+#ifdef TEXTURE_ARRAY
+flat out float Layer;
+#endif
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 viewPos;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;  // transpose(inverse(mat3(model))), from the CPU
+
+// Identity (0, 1, false) for float vertices
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec4 texCoordDecode;
+uniform bool octahedralNormals;
+
+vec3 decodeNormal(vec3 n)
+{
+    if (!octahedralNormals)
+        return n;
+    vec3 v = vec3(n.xy, 1.0f - abs(n.x) - abs(n.y));
+    float t = max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -t : t;
+    v.y += v.y >= 0.0f ? -t : t;
+    return normalize(v);
+}
 
 void main()
 {
-    gl_Position = projection * view *  model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;
-    TexCoords = texCoords;
+    vec3 localPosition = positionOffset + position * positionScale;
+    gl_Position = viewProjection * model * vec4(localPosition, 1.0f);
+    FragPos = vec3(model * vec4(localPosition, 1.0f));
+    Normal = normalMatrix * decodeNormal(normal);
+    TexCoords = texCoordDecode.xy + texCoords * texCoordDecode.zw;
+#ifdef TEXTURE_ARRAY
+    Layer = layer;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+// Uniform reflection for a linked program
+// All active uniforms are enumerated once with glGetActiveUniform; callers resolve
+// typed handles at setup time and the render loop only calls the setters, so drawing
+// never hashes a string or asks the driver for a location. Every name resolution is
+// counted in UniformLookups(), which main() checks stays at zero inside a frame.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Pre-resolved location; T is the C++ type the setter accepts
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+};
+
+// Name resolutions since the last reset (the per-frame count must stay at zero)
+inline unsigned int& UniformLookups()
+{
+    static unsigned int count = 0;
+    return count;
+}
+
+template <typename T> struct UniformType;
+template <> struct UniformType<int>
+{
+    static bool Matches(GLenum type)
+    {
+        return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_BUFFER
+            || type == GL_UNSIGNED_INT_SAMPLER_BUFFER;
+    }
+};
+template <> struct UniformType<float> { static bool Matches(GLenum type) { return type == GL_FLOAT; } };
+template <> struct UniformType<glm::vec2> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static bool Matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat3> { static bool Matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static bool Matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
+
+class ShaderUniforms
+{
+public:
+    explicit ShaderUniforms(GLuint program)
+        : program(program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+
+            Entry entry;
+            entry.name.assign(buffer.data(), length);
+            entry.location = glGetUniformLocation(program, entry.name.c_str());
+            entry.type = type;
+            if (entry.location < 0)
+                continue;  // Lives in a uniform block
+
+            // "lights[0]" is reported for arrays; register the bare name and every element
+            size_t bracket = entry.name.find("[0]");
+            if (bracket != std::string::npos && bracket + 3 == entry.name.size()) {
+                std::string base = entry.name.substr(0, bracket);
+                for (GLint e = 0; e < size; e++) {
+                    Entry element = entry;
+                    element.name = base + "[" + std::to_string(e) + "]";
+                    element.location = entry.location + e;
+                    this->entries.push_back(element);
+                }
+                entry.name = base;
+            }
+            this->entries.push_back(entry);
+        }
+
+        std::sort(this->entries.begin(), this->entries.end());
+    }
+
+    GLuint Program() const { return this->program; }
+
+    // Setup-time resolution; inactive names give a handle the setters ignore
+    template <typename T>
+    Uniform<T> Get(const std::string& name) const
+    {
+        UniformLookups()++;
+
+        Uniform<T> handle;
+        Entry key;
+        key.name = name;
+        std::vector<Entry>::const_iterator it = std::lower_bound(this->entries.begin(), this->entries.end(), key);
+        if (it == this->entries.end() || it->name != name)
+            return handle;
+
+        if (!UniformType<T>::Matches(it->type))
+            std::cout << "WARNING::SHADER:: uniform " << name << " has a different type" << std::endl;
+        handle.location = it->location;
+        return handle;
+    }
+
+    // Setters apply to the currently bound program, like glUniform*
+    static void Set(Uniform<int> u, int value) { glUniform1i(u.location, value); }
+    static void Set(Uniform<float> u, float value) { glUniform1f(u.location, value); }
+    static void Set(Uniform<glm::vec2> u, const glm::vec2& value) { glUniform2fv(u.location, 1, glm::value_ptr(value)); }
+    static void Set(Uniform<glm::vec3> u, const glm::vec3& value) { glUniform3fv(u.location, 1, glm::value_ptr(value)); }
+    static void Set(Uniform<glm::vec4> u, const glm::vec4& value) { glUniform4fv(u.location, 1, glm::value_ptr(value)); }
+    static void Set(Uniform<glm::mat3> u, const glm::mat3& value) { glUniformMatrix3fv(u.location, 1, GL_FALSE, glm::value_ptr(value)); }
+    static void Set(Uniform<glm::mat4> u, const glm::mat4& value) { glUniformMatrix4fv(u.location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+private:
+    struct Entry
+    {
+        std::string name;
+        GLint location = -1;
+        GLenum type = 0;
+
+        bool operator<(const Entry& other) const { return this->name < other.name; }
+    };
+
+    GLuint program;
+    std::vector<Entry> entries;
+};
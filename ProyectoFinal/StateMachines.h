@@ -0,0 +1,381 @@
+#pragma once
+
+// Table-driven state machines for interactive objects
+// Machines are data, read from a text file; one line per declaration, '#' starts a comment:
+//   machine <name>
+//   state <name> [enter <action>] [exit <action>] [after <seconds> <state>]
+//   on <state> <event> -> <state> [if [!]<guard>] [do <action>]
+// The first state of a machine is where its objects start (without running its enter
+// action). A transition runs the old state's exit action, its own action, then the new
+// state's enter action; of several transitions for one event, the first whose guard holds
+// wins. "after" leaves the state by itself once the time is up.
+// Actions and guards are C++ callbacks registered by name before Load() and receive the
+// object. Objects are rows in flat arrays; Update() only touches the events sent since the
+// last update and the objects in timed states, so idle objects cost nothing.
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "FileUtils.h"
+
+class StateMachines
+{
+public:
+    typedef std::function<void(unsigned int)> Action;  // Gets the object
+    typedef std::function<bool(unsigned int)> Guard;
+
+    StateMachines()
+        : time(0.0)
+    {
+    }
+
+    StateMachines(const StateMachines&) = delete;
+    StateMachines& operator=(const StateMachines&) = delete;
+
+    void AddAction(const std::string& name, const Action& action)
+    {
+        this->actionIds[name] = (int)this->actions.size();
+        this->actions.push_back(action);
+    }
+
+    void AddGuard(const std::string& name, const Guard& guard)
+    {
+        this->guardIds[name] = (int)this->guards.size();
+        this->guards.push_back(guard);
+    }
+
+    // Adds the machines in the file; false (with an error printed) on any mistake
+    bool Load(const std::string& path)
+    {
+        std::vector<char> file;
+        if (!ReadWholeFile(path, file)) {
+            std::cout << "ERROR::STATEMACHINE:: Cannot read " << path << std::endl;
+            return false;
+        }
+
+        std::istringstream stream(std::string(file.begin(), file.end()));
+        std::string line;
+        int lineNumber = 0;
+        bool ok = true;
+        PendingMachine machine;
+        while (std::getline(stream, line)) {
+            lineNumber++;
+            std::string error = this->parseLine(line.substr(0, line.find('#')), machine);
+            if (!error.empty()) {
+                std::cout << "ERROR::STATEMACHINE:: " << path << ":" << lineNumber << ": " << error << std::endl;
+                ok = false;
+            }
+        }
+        std::string error = this->finishMachine(machine);
+        if (!error.empty()) {
+            std::cout << "ERROR::STATEMACHINE:: " << path << ": " << error << std::endl;
+            ok = false;
+        }
+        return ok;
+    }
+
+    // Id of an event name, made on first use
+    unsigned int Event(const std::string& name)
+    {
+        std::map<std::string, unsigned int>::iterator found = this->eventIds.find(name);
+        if (found != this->eventIds.end())
+            return found->second;
+
+        unsigned int id = (unsigned int)this->eventIds.size();
+        this->eventIds[name] = id;
+        return id;
+    }
+
+    // New object of a loaded machine; -1 if there is no such machine
+    int Create(const std::string& machine)
+    {
+        std::map<std::string, unsigned int>::iterator found = this->machineIds.find(machine);
+        if (found == this->machineIds.end()) {
+            std::cout << "ERROR::STATEMACHINE:: No machine named " << machine << std::endl;
+            return -1;
+        }
+
+        unsigned int object = (unsigned int)this->objectState.size();
+        this->objectState.push_back(this->machines[found->second].firstState);
+        this->timerSlot.push_back(-1);
+        this->deadline.push_back(0.0);
+        return (int)object;
+    }
+
+    // Queued; takes effect in the next Update()
+    void Send(unsigned int object, unsigned int event)
+    {
+        this->queue.push_back(QueuedEvent{ object, event });
+    }
+
+    // Fires the timers that ran out, then the events sent before this call. Events that
+    // actions send wait for the next update, so machines cannot loop within one.
+    void Update(float deltaTime)
+    {
+        this->time += deltaTime;
+
+        // Backwards, so the swap-removal of a fired timer only moves visited ones
+        for (size_t i = this->timed.size(); i-- > 0;) {
+            unsigned int object = this->timed[i];
+            if (this->deadline[object] <= this->time)
+                this->transition(object, this->states[this->objectState[object]].timeoutState, -1);
+        }
+
+        this->processing.swap(this->queue);
+        for (const QueuedEvent& queued : this->processing) {
+            const State& state = this->states[this->objectState[queued.object]];
+            for (unsigned int t = state.firstTransition; t < state.firstTransition + state.transitionCount; t++) {
+                const Transition& candidate = this->transitions[t];
+                if (candidate.event != queued.event)
+                    continue;
+                if (candidate.guard >= 0 && this->guards[candidate.guard](queued.object) == candidate.negate)
+                    continue;
+                this->transition(queued.object, candidate.target, candidate.action);
+                break;
+            }
+        }
+        this->processing.clear();
+    }
+
+    const std::string& StateName(unsigned int object) const { return this->states[this->objectState[object]].name; }
+
+    // Time until the current state's "after" fires; 0 for untimed states
+    float TimeLeft(unsigned int object) const
+    {
+        return this->timerSlot[object] >= 0 ? (float)(this->deadline[object] - this->time) : 0.0f;
+    }
+
+    size_t ObjectCount() const { return this->objectState.size(); }
+    size_t TimedObjects() const { return this->timed.size(); }
+
+private:
+    struct Transition
+    {
+        unsigned int state;  // Source, only used while loading
+        unsigned int event;
+        unsigned int target;
+        int guard;           // -1 for none
+        bool negate;
+        int action;          // -1 for none
+    };
+
+    struct State
+    {
+        std::string name;
+        int enter;  // -1 for none
+        int exit;
+        float timeout;  // 0 for untimed
+        unsigned int timeoutState;
+        unsigned int firstTransition;
+        unsigned int transitionCount;
+    };
+
+    struct Machine
+    {
+        unsigned int firstState;
+        unsigned int stateCount;
+    };
+
+    // A machine while its lines are read; names resolve when it ends
+    struct PendingMachine
+    {
+        std::string name;
+        std::vector<State> states;
+        std::vector<std::string> timeoutTargets;
+        std::vector<std::string> sources, targets;  // Per transition
+        std::vector<Transition> transitions;
+    };
+
+    struct QueuedEvent
+    {
+        unsigned int object;
+        unsigned int event;
+    };
+
+    // Definitions
+    std::vector<Action> actions;
+    std::vector<Guard> guards;
+    std::map<std::string, int> actionIds, guardIds;
+    std::map<std::string, unsigned int> eventIds, machineIds;
+    std::vector<Machine> machines;
+    std::vector<State> states;            // All machines, each machine's contiguous
+    std::vector<Transition> transitions;  // Grouped by source state
+
+    // Objects, one row each
+    std::vector<unsigned int> objectState;
+    std::vector<int> timerSlot;   // Index into timed, -1 when untimed
+    std::vector<double> deadline;
+
+    std::vector<unsigned int> timed;  // Objects in a state with "after"
+    std::vector<QueuedEvent> queue, processing;
+    double time;
+
+    void transition(unsigned int object, unsigned int target, int action)
+    {
+        const State& from = this->states[this->objectState[object]];
+        if (from.exit >= 0)
+            this->actions[from.exit](object);
+        if (this->timerSlot[object] >= 0)
+            this->stopTimer(object);
+        if (action >= 0)
+            this->actions[action](object);
+
+        this->objectState[object] = target;
+        const State& to = this->states[target];
+        if (to.timeout > 0.0f) {
+            this->timerSlot[object] = (int)this->timed.size();
+            this->timed.push_back(object);
+            this->deadline[object] = this->time + to.timeout;
+        }
+        if (to.enter >= 0)
+            this->actions[to.enter](object);
+    }
+
+    void stopTimer(unsigned int object)
+    {
+        size_t slot = (size_t)this->timerSlot[object];
+        unsigned int last = this->timed.back();
+        this->timed[slot] = last;
+        this->timerSlot[last] = (int)slot;
+        this->timed.pop_back();
+        this->timerSlot[object] = -1;
+    }
+
+    // Error message, or empty
+    std::string parseLine(const std::string& line, PendingMachine& machine)
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword))
+            return "";
+
+        if (keyword == "machine") {
+            std::string error = this->finishMachine(machine);
+            machine = PendingMachine();
+            if (!(words >> machine.name))
+                return "machine without a name";
+            if (this->machineIds.count(machine.name))
+                return "machine " + machine.name + " defined twice";
+            return error;
+        }
+        if (machine.name.empty())
+            return keyword + " outside a machine";
+
+        if (keyword == "state") {
+            State state = { "", -1, -1, 0.0f, 0, 0, 0 };
+            std::string timeoutTarget;
+            if (!(words >> state.name))
+                return "state without a name";
+            std::string option, name;
+            while (words >> option) {
+                if (option == "after") {
+                    if (!(words >> state.timeout >> timeoutTarget) || state.timeout <= 0.0f)
+                        return "expected: after <seconds> <state>";
+                }
+                else if ((option == "enter" || option == "exit") && words >> name) {
+                    if (!lookup(this->actionIds, name, option == "enter" ? state.enter : state.exit))
+                        return "unknown action " + name;
+                }
+                else {
+                    return "bad state option " + option;
+                }
+            }
+            machine.states.push_back(state);
+            machine.timeoutTargets.push_back(timeoutTarget);
+            return "";
+        }
+
+        if (keyword == "on") {
+            Transition transition = { 0, 0, 0, -1, false, -1 };
+            std::string source, event, arrow, target;
+            if (!(words >> source >> event >> arrow >> target) || arrow != "->")
+                return "expected: on <state> <event> -> <state>";
+            transition.event = this->Event(event);
+
+            std::string option, name;
+            while (words >> option) {
+                if (!(words >> name))
+                    return "missing name after " + option;
+                if (option == "if") {
+                    transition.negate = name[0] == '!';
+                    if (transition.negate)
+                        name = name.substr(1);
+                    if (!lookup(this->guardIds, name, transition.guard))
+                        return "unknown guard " + name;
+                }
+                else if (option == "do") {
+                    if (!lookup(this->actionIds, name, transition.action))
+                        return "unknown action " + name;
+                }
+                else {
+                    return "bad transition option " + option;
+                }
+            }
+            machine.sources.push_back(source);
+            machine.targets.push_back(target);
+            machine.transitions.push_back(transition);
+            return "";
+        }
+
+        return "unknown keyword " + keyword;
+    }
+
+    // Resolves state names and appends the machine to the tables
+    std::string finishMachine(PendingMachine& machine)
+    {
+        if (machine.name.empty())
+            return "";
+        if (machine.states.empty())
+            return "machine " + machine.name + " has no states";
+
+        unsigned int first = (unsigned int)this->states.size();
+        std::map<std::string, unsigned int> stateIds;
+        for (size_t i = 0; i < machine.states.size(); i++)
+            stateIds[machine.states[i].name] = first + (unsigned int)i;
+
+        for (size_t i = 0; i < machine.states.size(); i++) {
+            if (machine.states[i].timeout > 0.0f &&
+                !lookup(stateIds, machine.timeoutTargets[i], machine.states[i].timeoutState))
+                return "machine " + machine.name + ": unknown state " + machine.timeoutTargets[i];
+        }
+        for (size_t i = 0; i < machine.transitions.size(); i++) {
+            if (!lookup(stateIds, machine.sources[i], machine.transitions[i].state))
+                return "machine " + machine.name + ": unknown state " + machine.sources[i];
+            if (!lookup(stateIds, machine.targets[i], machine.transitions[i].target))
+                return "machine " + machine.name + ": unknown state " + machine.targets[i];
+        }
+
+        // Each state's transitions end up contiguous, in file order
+        for (size_t i = 0; i < machine.states.size(); i++) {
+            State& state = machine.states[i];
+            state.firstTransition = (unsigned int)this->transitions.size();
+            for (const Transition& transition : machine.transitions) {
+                if (transition.state == first + i)
+                    this->transitions.push_back(transition);
+            }
+            state.transitionCount = (unsigned int)this->transitions.size() - state.firstTransition;
+            this->states.push_back(state);
+        }
+
+        Machine added = { first, (unsigned int)machine.states.size() };
+        this->machineIds[machine.name] = (unsigned int)this->machines.size();
+        this->machines.push_back(added);
+        machine = PendingMachine();
+        return "";
+    }
+
+    template <typename Id, typename Out>
+    static bool lookup(const std::map<std::string, Id>& ids, const std::string& name, Out& id)
+    {
+        typename std::map<std::string, Id>::const_iterator found = ids.find(name);
+        if (found == ids.end())
+            return false;
+        id = (Out)found->second;
+        return true;
+    }
+};
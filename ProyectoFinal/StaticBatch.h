@@ -0,0 +1,400 @@
+#pragma once
+
+// Static scene geometry in one vertex/index buffer
+// Models that never move are transformed to world space on the loader's worker threads
+// and appended here instead of getting a VAO of their own. Build() uploads everything
+// at once and groups the mesh ranges by material, so the whole static scene is one VAO
+// and one glMultiDrawElementsBaseVertex per material group, or one
+// glMultiDrawElementsIndirect per group when GL 4.3 / ARB_multi_draw_indirect exists.
+// Diffuse maps do not split groups: every one becomes a layer of a texture array (see
+// TextureLayers.h) and each vertex carries its layer, so groups differ only in pass,
+// specular map and shininess. casa.mtl's 60 images and 18 solid colours draw in one
+// call; Build() prints the count. Groups are drawn through the RenderQueue, which binds
+// the array. Cull() tests every mesh range against the frustum, the portal cells and
+// the occlusion buffer, picks each visible range's level of detail and compacts each
+// group's draw list.
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "CachedModel.h"
+#include "Frustum.h"
+#include "LodSelector.h"
+#include "NormalMatrix.h"
+#include "OcclusionBuffer.h"
+#include "PortalCells.h"
+#include "TextureLayers.h"
+#include "TextureStreamer.h"
+#include "VertexFormat.h"
+
+class StaticBatch
+{
+public:
+    // Draws sharing textures, shininess and alpha
+    struct GroupKey
+    {
+        float alpha;  // Below 1 goes to the transparent pass
+        bool layered;  // Diffuse maps from the array; false only once it is full
+        TextureHandle diffuse;  // NO_TEXTURE when layered
+        TextureHandle specular;
+        float shininess;
+
+        bool operator<(const GroupKey& other) const
+        {
+            if (this->alpha != other.alpha)
+                return this->alpha > other.alpha;
+            if (this->layered != other.layered)
+                return this->layered;
+            if (this->diffuse != other.diffuse)
+                return this->diffuse < other.diffuse;
+            if (this->specular != other.specular)
+                return this->specular < other.specular;
+            return this->shininess < other.shininess;
+        }
+    };
+
+    struct Group
+    {
+        GroupKey key;
+        glm::vec3 aabbMin, aabbMax;  // World space
+        std::vector<size_t> ranges;  // Every mesh range in the group
+        std::vector<GLsizei> counts;   // Visible ranges only, rebuilt by Cull()
+        std::vector<GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+        GLuint indexCount;    // Sum of counts
+        size_t firstCommand;  // Indirect path only
+    };
+
+    glm::vec3 aabbMin, aabbMax;  // World space
+
+    StaticBatch()
+        : aabbMin(FLT_MAX), aabbMax(-FLT_MAX), VAO(0), VBO(0), EBO(0), layerBuffer(0), indirectBuffer(0), indirect(false),
+        occluded(0), maskCells(nullptr)
+    {
+    }
+
+    ~StaticBatch()
+    {
+        glDeleteVertexArrays(1, &this->VAO);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+        glDeleteBuffers(1, &this->layerBuffer);
+        glDeleteBuffers(1, &this->indirectBuffer);
+    }
+
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    // CPU phase (any thread): copy a prepared model's geometry in, baked into world space.
+    // alpha below 1 draws the model's meshes in the transparent pass.
+    void Append(const CachedModel& model, const glm::mat4& world, float alpha = 1.0f)
+    {
+        const ModelData* data = model.CpuData();
+        if (!data)
+            return;
+
+        // Transform outside the lock so several models can bake at once
+        glm::mat3 normalMatrix = NormalMatrix(world);
+        std::vector<CacheVertex> baked(data->vertices, data->vertices + data->header->vertexCount);
+        glm::vec3 bakedMin(FLT_MAX), bakedMax(-FLT_MAX);
+        for (size_t i = 0; i < baked.size(); i++) {
+            baked[i].Position = glm::vec3(world * glm::vec4(baked[i].Position, 1.0f));
+            glm::vec3 normal = normalMatrix * baked[i].Normal;
+            float length = glm::length(normal);
+            baked[i].Normal = length > 0.0f ? normal / length : normal;
+            bakedMin = glm::min(bakedMin, baked[i].Position);
+            bakedMax = glm::max(bakedMax, baked[i].Position);
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        GLint vertexBase = (GLint)this->vertices.size();
+        GLuint indexBase = (GLuint)this->indices.size();
+        this->vertices.insert(this->vertices.end(), baked.begin(), baked.end());
+        this->indices.insert(this->indices.end(), data->indices, data->indices + data->header->indexCount);
+        this->aabbMin = glm::min(this->aabbMin, bakedMin);
+        this->aabbMax = glm::max(this->aabbMax, bakedMax);
+
+        // LOD errors are baked to world units along with the vertices
+        float errorScale = LodSelector::MaxScale(world);
+        for (size_t i = 0; i < model.meshes.size(); i++) {
+            const CacheMesh& mesh = model.meshes[i];
+            Range range;
+            range.model = &model;
+            range.material = model.MeshMaterial(i);
+            range.lodCount = mesh.lodCount;
+            for (uint32_t l = 0; l < mesh.lodCount; l++) {
+                range.lods[l].firstIndex = indexBase + mesh.lods[l].firstIndex;
+                range.lods[l].indexCount = mesh.lods[l].indexCount;
+                range.lods[l].error = mesh.lods[l].error * errorScale;
+            }
+            range.baseVertex = vertexBase + (GLint)mesh.baseVertex;
+            range.vertexCount = mesh.vertexCount;
+            range.alpha = alpha;
+            TransformAabb(world, mesh.aabbMin, mesh.aabbMax, range.aabbMin, range.aabbMax);
+            this->ranges.push_back(range);
+        }
+    }
+
+    // GL phase: group draws and upload; every appended model must have requested its textures
+    void Build()
+    {
+        // One group per distinct (pass, specular, shininess); diffuse maps become layers,
+        // and texture handles are shared across models, so identical images from
+        // different files share a layer
+        std::vector<uint16_t> vertexLayers(this->vertices.size(), 0);
+        std::map<GroupKey, size_t> groupIndex;
+        for (size_t i = 0; i < this->ranges.size(); i++) {
+            const Range& range = this->ranges[i];
+            GroupKey key;
+            key.alpha = range.alpha;
+            key.diffuse = range.model->DiffuseTexture(range.material);
+            key.specular = range.model->SpecularTexture(range.material);
+            key.shininess = range.model->Shininess(range.material);
+
+            int layer = this->diffuseLayers.Add(key.diffuse);
+            key.layered = layer >= 0;
+            if (key.layered) {
+                key.diffuse = NO_TEXTURE;
+                std::fill(vertexLayers.begin() + range.baseVertex, vertexLayers.begin() + range.baseVertex + range.vertexCount,
+                    (uint16_t)layer);
+            }
+
+            std::map<GroupKey, size_t>::iterator found = groupIndex.find(key);
+            if (found == groupIndex.end()) {
+                found = groupIndex.insert(std::make_pair(key, this->groups.size())).first;
+                Group group;
+                group.key = key;
+                group.aabbMin = glm::vec3(FLT_MAX);
+                group.aabbMax = glm::vec3(-FLT_MAX);
+                group.indexCount = 0;
+                group.firstCommand = 0;
+                this->groups.push_back(group);
+            }
+
+            Group& group = this->groups[found->second];
+            group.ranges.push_back(i);
+            group.aabbMin = glm::min(group.aabbMin, range.aabbMin);
+            group.aabbMax = glm::max(group.aabbMax, range.aabbMax);
+            this->bounds.Add(range.aabbMin, range.aabbMax);
+        }
+        this->diffuseLayers.Create();
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+        glGenBuffers(1, &this->layerBuffer);
+
+        // Same layout as CachedModel, quantized over the whole batch. The layers sit in a
+        // buffer of their own, so the packed and FULL_VERTICES layouts need no change.
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        this->format.Upload(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        glBindBuffer(GL_ARRAY_BUFFER, this->layerBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertexLayers.size() * sizeof(uint16_t), vertexLayers.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(uint16_t), (GLvoid*)0);
+        glBindVertexArray(0);
+
+        // Indirect path: each group owns a run of commands in one buffer, visible ones first
+        this->indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+        if (this->indirect) {
+            size_t firstCommand = 0;
+            for (size_t g = 0; g < this->groups.size(); g++) {
+                this->groups[g].firstCommand = firstCommand;
+                firstCommand += this->groups[g].ranges.size();
+            }
+            this->commands.resize(firstCommand);
+
+            glGenBuffers(1, &this->indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, this->commands.size() * sizeof(DrawCommand), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        // Everything is visible, at full detail, until the first Cull()
+        this->visible.assign(this->ranges.size(), 1);
+        this->levels.assign(this->ranges.size(), 0);
+        this->compact();
+
+        std::cout << "Static batch: " << this->ranges.size() << " meshes, " << this->vertices.size() << " vertices -> "
+            << this->groups.size() << (this->indirect ? " indirect" : " multi-draw") << " calls, "
+            << this->diffuseLayers.LayerCount() << " diffuse textures in " << this->diffuseLayers.LayerSize() << "x"
+            << this->diffuseLayers.LayerSize() << " array layers" << std::endl;
+
+        // The GPU owns the geometry now
+        std::vector<CacheVertex>().swap(this->vertices);
+        std::vector<GLuint>().swap(this->indices);
+    }
+
+    // Frustum-tests every mesh range, then drops the ones in rooms the portals do not
+    // reach and the ones behind the occluders, and picks a level for the rest; returns
+    // how many are visible. Draw lists are only rebuilt when the visible set or a level
+    // changed since the last call.
+    size_t Cull(const Frustum& frustum, const OcclusionBuffer* occlusion = nullptr, const PortalCells* cells = nullptr,
+        const LodSelector* lods = nullptr)
+    {
+        size_t visibleCount = this->bounds.Cull(frustum, this->cullResult);
+
+        // Ranges never move: their rooms are looked up once per PortalCells
+        if (cells && cells != this->maskCells) {
+            this->rangeCells.resize(this->ranges.size());
+            for (size_t r = 0; r < this->ranges.size(); r++)
+                this->rangeCells[r] = cells->CellMask(this->ranges[r].aabbMin, this->ranges[r].aabbMax);
+            this->maskCells = cells;
+        }
+
+        this->occluded = 0;
+        for (size_t r = 0; r < this->ranges.size(); r++) {
+            if (!this->cullResult[r])
+                continue;
+            if ((cells && !cells->IsVisible(this->rangeCells[r]))
+                || (occlusion && !occlusion->IsVisible(this->ranges[r].aabbMin, this->ranges[r].aabbMax))) {
+                this->cullResult[r] = 0;
+                this->occluded++;
+                continue;
+            }
+            if (lods) {
+                const Range& range = this->ranges[r];
+                this->levels[r] = (unsigned char)lods->Select(range.lods, range.lodCount, 1.0f, this->levels[r],
+                    range.aabbMin, range.aabbMax);
+                this->cullResult[r] = (unsigned char)(1 + this->levels[r]);
+            }
+        }
+        visibleCount -= this->occluded;
+        if (this->cullResult != this->visible) {
+            this->visible.swap(this->cullResult);
+            this->compact();
+        }
+        return visibleCount;
+    }
+
+    size_t RangeCount() const { return this->ranges.size(); }
+    size_t OccludedCount() const { return this->occluded; }  // Last Cull(), hidden by portals or occluders
+
+    const std::vector<Group>& Groups() const { return this->groups; }
+    GLuint VertexArray() const { return this->VAO; }
+    const VertexFormat& Format() const { return this->format; }
+    GLuint DiffuseArray() const { return this->diffuseLayers.Texture(); }
+
+    // GL thread, once per frame after the streamer's Update(): copies newly streamed
+    // diffuse maps into their layers with Shader/layerCopy.*
+    void UpdateTextures(const TextureStreamer& streamer, GLuint copyProgram)
+    {
+        this->diffuseLayers.Update(streamer, copyProgram);
+    }
+
+    void PrintStats() const { this->diffuseLayers.PrintStats(); }
+
+    // Issues one group's draws; the batch's VAO and the group's textures (the array for
+    // layered groups) must be bound
+    void DrawGroup(size_t g) const
+    {
+        const Group& group = this->groups[g];
+        if (this->indirect) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, this->format.indexType,
+                (const GLvoid*)(group.firstCommand * sizeof(DrawCommand)), (GLsizei)group.counts.size(), 0);
+        }
+        else {
+            // This GLEW declares the arrays non-const
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, const_cast<GLsizei*>(group.counts.data()), this->format.indexType,
+                const_cast<GLvoid**>(group.offsets.data()), (GLsizei)group.counts.size(), const_cast<GLint*>(group.baseVertices.data()));
+        }
+    }
+
+private:
+    // One mesh of one appended model, in batch index/vertex space
+    struct Range
+    {
+        const CachedModel* model;
+        GLuint material;
+        unsigned int lodCount;
+        CacheLod lods[MODEL_CACHE_MAX_LODS];  // Batch index space, world-unit errors
+        GLint baseVertex;
+        GLuint vertexCount;
+        float alpha;
+        glm::vec3 aabbMin, aabbMax;  // World space
+    };
+
+    // Layout fixed by glMultiDrawElementsIndirect
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    GLuint VAO, VBO, EBO, layerBuffer, indirectBuffer;
+    VertexFormat format;
+    TextureLayers diffuseLayers;
+    bool indirect;
+    std::vector<Group> groups;
+
+    std::vector<Range> ranges;
+    AabbList bounds;                    // Per range, in range order
+    std::vector<unsigned char> visible; // Per range, as of the last Cull(): 0 hidden, else 1 + level
+    std::vector<unsigned char> cullResult;
+    std::vector<unsigned char> levels;  // Per range, kept while hidden for the hysteresis
+    size_t occluded;
+    const PortalCells* maskCells;       // Owner of rangeCells
+    std::vector<uint32_t> rangeCells;   // Per range, rooms it stands in
+    std::vector<DrawCommand> commands;  // CPU copy of the indirect buffer
+
+    // Filled by Append, released by Build
+    std::mutex mutex;
+    std::vector<CacheVertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Rebuilds each group's draw list from the visible ranges
+    void compact()
+    {
+        for (size_t g = 0; g < this->groups.size(); g++) {
+            Group& group = this->groups[g];
+            group.counts.clear();
+            group.offsets.clear();
+            group.baseVertices.clear();
+            group.indexCount = 0;
+            for (size_t i = 0; i < group.ranges.size(); i++) {
+                size_t r = group.ranges[i];
+                if (!this->visible[r])
+                    continue;
+
+                const Range& range = this->ranges[r];
+                const CacheLod& lod = range.lods[this->visible[r] - 1];
+                if (this->indirect) {
+                    DrawCommand& command = this->commands[group.firstCommand + group.counts.size()];
+                    command.count = lod.indexCount;
+                    command.instanceCount = 1;
+                    command.firstIndex = lod.firstIndex;
+                    command.baseVertex = range.baseVertex;
+                    command.baseInstance = 0;
+                }
+                group.counts.push_back((GLsizei)lod.indexCount);
+                group.offsets.push_back((GLvoid*)(size_t)(lod.firstIndex * this->format.indexSize));
+                group.baseVertices.push_back(range.baseVertex);
+                group.indexCount += lod.indexCount;
+            }
+        }
+
+        if (this->indirect && !this->commands.empty()) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, this->commands.size() * sizeof(DrawCommand), this->commands.data());
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+// Streamed textures gathered into the layers of one GL_TEXTURE_2D_ARRAY
+// The static batch samples all of its diffuse maps through one array, so its draws no
+// longer split per texture: each vertex carries the layer of its material. Layers are
+// one size (512 x 512 RGBA8 with mips by default), whatever the source. Update() redraws
+// a layer from the streamer's current texture whenever that changes (the placeholder
+// first, then the real image), one full-screen triangle per mip level sampled with the
+// source's own trilinear filtering, so any format the streamer uploads, block-compressed
+// included, lands scaled. Larger sources lose their top levels in the array: at
+// 1024 x 1024 the 80 or so house textures would take over 400 MB.
+
+#include <map>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+#include "TextureStreamer.h"
+
+class TextureLayers
+{
+public:
+    static const GLsizei DEFAULT_LAYER_SIZE = 512;
+
+    explicit TextureLayers(GLsizei layerSize = DEFAULT_LAYER_SIZE)
+        : layerSize(layerSize), levels(1), maxLayers(0), texture(0), framebuffer(0), emptyVAO(0), copies(0)
+    {
+        while ((layerSize >> this->levels) > 0)
+            this->levels++;
+    }
+
+    ~TextureLayers()
+    {
+        glDeleteTextures(1, &this->texture);
+        glDeleteFramebuffers(1, &this->framebuffer);
+        glDeleteVertexArrays(1, &this->emptyVAO);
+    }
+
+    TextureLayers(const TextureLayers&) = delete;
+    TextureLayers& operator=(const TextureLayers&) = delete;
+
+    // GL thread, before Create(): layer of a texture, added on first use; -1 once the
+    // array holds as many layers as the driver allows
+    int Add(TextureHandle handle)
+    {
+        std::map<TextureHandle, int>::iterator known = this->layerOf.find(handle);
+        if (known != this->layerOf.end())
+            return known->second;
+
+        if (this->maxLayers == 0)
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &this->maxLayers);
+        if ((GLint)this->handles.size() >= this->maxLayers)
+            return -1;
+
+        int layer = (int)this->handles.size();
+        this->handles.push_back(handle);
+        this->layerOf[handle] = layer;
+        return layer;
+    }
+
+    // GL thread: allocates the array once every layer is added
+    void Create()
+    {
+        if (this->handles.empty())
+            return;
+
+        glGenTextures(1, &this->texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture);
+        for (GLint level = 0; level < this->levels; level++) {
+            GLsizei size = this->layerSize >> level;
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, (GLsizei)this->handles.size(), 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &this->framebuffer);
+        glGenVertexArrays(1, &this->emptyVAO);  // Full-screen triangle, from gl_VertexID
+        this->sources.assign(this->handles.size(), 0);
+    }
+
+    // GL thread, once per frame after TextureStreamer::Update(): redraws the layers whose
+    // texture changed since the last call with copyProgram (Shader/layerCopy.*). GL state
+    // the frame relies on is put back.
+    void Update(const TextureStreamer& streamer, GLuint copyProgram)
+    {
+        if (this->texture == 0)
+            return;
+
+        bool bound = false;
+        GLint viewport[4], drawFramebuffer = 0, program = 0, vertexArray = 0;
+        GLboolean depthTest = GL_FALSE;
+        for (size_t layer = 0; layer < this->handles.size(); layer++) {
+            GLuint source = streamer.Texture(this->handles[layer]);
+            if (source == this->sources[layer])
+                continue;
+
+            if (!bound) {
+                glGetIntegerv(GL_VIEWPORT, viewport);
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+                glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+                glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+                depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+                glDisable(GL_DEPTH_TEST);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->framebuffer);
+                glUseProgram(copyProgram);
+                glBindVertexArray(this->emptyVAO);
+                glActiveTexture(GL_TEXTURE0);
+                bound = true;
+            }
+
+            glBindTexture(GL_TEXTURE_2D, source);
+            for (GLint level = 0; level < this->levels; level++) {
+                GLsizei size = this->layerSize >> level;
+                glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->texture, level, (GLint)layer);
+                glViewport(0, 0, size, size);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            this->sources[layer] = source;
+            this->copies++;
+        }
+
+        if (bound) {
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            glUseProgram(program);
+            glBindVertexArray(vertexArray);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            if (depthTest)
+                glEnable(GL_DEPTH_TEST);
+        }
+    }
+
+    GLuint Texture() const { return this->texture; }
+    size_t LayerCount() const { return this->handles.size(); }
+    GLsizei LayerSize() const { return this->layerSize; }
+
+    // Layers redrawn so far, placeholders included
+    void PrintStats() const
+    {
+        std::cout << "Texture layers: " << this->handles.size() << " of " << this->layerSize << "x" << this->layerSize
+            << ", " << this->copies << " copies, "
+            << this->handles.size() * this->layerSize * this->layerSize * 4 * 4 / 3 / (1024 * 1024) << " MB" << std::endl;
+    }
+
+private:
+    GLsizei layerSize;
+    GLint levels;
+    GLint maxLayers;  // GL_MAX_ARRAY_TEXTURE_LAYERS, queried on the first Add()
+    GLuint texture;
+    GLuint framebuffer;
+    GLuint emptyVAO;
+    size_t copies;
+    std::vector<TextureHandle> handles;   // Per layer
+    std::vector<GLuint> sources;          // Per layer, GL name last drawn into it
+    std::map<TextureHandle, int> layerOf;
+};
@@ -0,0 +1,429 @@
+#pragma once
+
+// Process-wide texture registry with asynchronous streaming
+// Materials hold TextureHandles instead of GL names. Every image file is read and
+// hashed on a worker; files with identical contents (e.g. _102.jpg in casa/, door/
+// and door2/) resolve to the same handle, so each distinct image is decoded and
+// uploaded once. Solid colours are deduplicated the same way.
+//
+// Until an image lands, its handle shows a 1x1 placeholder texel. Decoded pixels are
+// copied by workers straight into a ring of mapped pixel buffer objects; Update()
+// (once per frame, GL thread) unmaps finished copies, uploads them from the PBO and
+// fences the slot for reuse.
+//
+// When "<image>.ktx2" exists (see Tools/CompressTextures.cpp) and the driver supports
+// the format, its prebuilt block-compressed mip chain is uploaded instead of decoding
+// the JPEG/PNG, with no runtime mip generation. A .ktx2 whose recorded source no longer
+// matches the image next to it is stale: it is skipped with a warning and the image is
+// decoded instead.
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+// Image loading library
+#include "SOIL2/SOIL2.h"
+
+#include "FileUtils.h"
+#include "Ktx2.h"
+#include "ThreadPool.h"
+
+typedef unsigned int TextureHandle;
+const TextureHandle NO_TEXTURE = 0;
+
+class TextureStreamer
+{
+public:
+    // frameBudget caps the bytes uploaded per Update() so large images do not hitch a frame
+    TextureStreamer(ThreadPool& pool, size_t ringSize = 4, size_t frameBudget = 16 * 1024 * 1024)
+        : pool(pool), frameBudget(frameBudget), aliasCount(0), compressedCount(0), pendingDecodes(0)
+    {
+        // Read by workers, so capture the extension flags up front
+        this->supportsS3tc = GLEW_EXT_texture_compression_s3tc != 0;
+        this->supportsBptc = GLEW_ARB_texture_compression_bptc != 0;
+
+        this->slots.resize(ringSize);
+        for (size_t i = 0; i < this->slots.size(); i++)
+            glGenBuffers(1, &this->slots[i].pbo);
+
+        // Handle 0 is "no texture"
+        this->names.push_back(0);
+        this->canonical.push_back(NO_TEXTURE);
+    }
+
+    ~TextureStreamer()
+    {
+        // Workers may still be writing into mapped PBOs
+        this->pool.Wait();
+
+        for (size_t i = 0; i < this->slots.size(); i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state == SLOT_COPYING) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        for (size_t i = 0; i < this->decoded.size(); i++)
+            freeImage(this->decoded[i]);
+        if (!this->owned.empty())
+            glDeleteTextures((GLsizei)this->owned.size(), this->owned.data());
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // GL thread: returns a handle usable right away; the image replaces the placeholder later
+    TextureHandle Request(const std::string& path, const glm::vec3& placeholder)
+    {
+        std::map<std::string, TextureHandle>::iterator known = this->pathHandles.find(path);
+        if (known != this->pathHandles.end())
+            return known->second;
+
+        // Solid() may add a handle of its own, so it has to run before this one is taken
+        GLuint placeholderName = this->Texture(this->Solid(placeholder));
+        TextureHandle handle = (TextureHandle)this->names.size();
+        this->names.push_back(placeholderName);
+        this->canonical.push_back(handle);
+        this->pathHandles[path] = handle;
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pendingDecodes++;
+        }
+        this->pool.Submit([this, path, handle] { this->decode(path, handle); });
+        return handle;
+    }
+
+    // GL thread: shared 1x1 texture for a flat colour (materials without map_Kd)
+    TextureHandle Solid(const glm::vec3& color)
+    {
+        unsigned char texel[4] = {
+            (unsigned char)(glm::clamp(color.r, 0.0f, 1.0f) * 255.0f + 0.5f),
+            (unsigned char)(glm::clamp(color.g, 0.0f, 1.0f) * 255.0f + 0.5f),
+            (unsigned char)(glm::clamp(color.b, 0.0f, 1.0f) * 255.0f + 0.5f),
+            255 };
+
+        ContentKey key(HashBytes(texel, sizeof(texel)), 0);
+        std::map<ContentKey, TextureHandle>::iterator known = this->solidHandles.find(key);
+        if (known != this->solidHandles.end())
+            return known->second;
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        this->setSamplerState(false);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        this->owned.push_back(textureID);
+
+        TextureHandle handle = (TextureHandle)this->names.size();
+        this->names.push_back(textureID);
+        this->canonical.push_back(handle);
+        this->solidHandles[key] = handle;
+        return handle;
+    }
+
+    // GL thread: current GL name for a handle (placeholder, real image, or the image it aliases)
+    GLuint Texture(TextureHandle handle) const
+    {
+        return this->names[this->canonical[handle]];
+    }
+
+    // GL thread, once per frame
+    void Update()
+    {
+        this->resolveAliases();
+
+        size_t budget = this->frameBudget;
+
+        // Recycle slots whose uploads the GPU has consumed
+        for (size_t i = 0; i < this->slots.size(); i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state == SLOT_UPLOADING
+                && glClientWaitSync(slot.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+                slot.state = SLOT_FREE;
+            }
+        }
+
+        // Upload images whose pixels have landed in a PBO
+        for (size_t i = 0; i < this->slots.size(); i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state != SLOT_COPYING || !this->copyFinished(slot))
+                continue;
+            size_t bytes = slot.size;
+            if (bytes > budget && budget != this->frameBudget)
+                break;
+            budget = bytes > budget ? 0 : budget - bytes;
+
+            // A fresh name, since the placeholder may be shared with other handles
+            GLuint textureID;
+            glGenTextures(1, &textureID);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindTexture(GL_TEXTURE_2D, textureID);
+            if (slot.compressed) {
+                // Offsets are relative to the bound PBO
+                UploadKtx2Levels(slot.ktx, (const unsigned char*)0);
+                this->compressedCount++;
+            }
+            else {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, slot.width, slot.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+            this->setSamplerState(true);
+            this->owned.push_back(textureID);
+            this->names[slot.handle] = textureID;
+
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slot.state = SLOT_UPLOADING;
+        }
+
+        // Hand decoded images to free slots; workers copy into the mapped memory
+        for (size_t i = 0; i < this->slots.size(); i++) {
+            Slot& slot = this->slots[i];
+            if (slot.state != SLOT_FREE)
+                continue;
+
+            Image image;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (this->decoded.empty())
+                    break;
+                image = this->decoded.front();
+                this->decoded.pop_front();
+            }
+
+            size_t bytes = image.size;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            if (bytes > slot.capacity) {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+                slot.capacity = bytes;
+            }
+            void* target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!target) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->decoded.push_front(image);
+                break;
+            }
+
+            slot.handle = image.handle;
+            slot.width = image.width;
+            slot.height = image.height;
+            slot.size = image.size;
+            slot.compressed = image.blocks != nullptr;
+            slot.ktx = image.ktx;
+            slot.copied = false;
+            slot.state = SLOT_COPYING;
+
+            Slot* slotPtr = &slot;
+            this->pool.Submit([this, slotPtr, image, target, bytes] {
+                Image copy = image;
+                std::memcpy(target, copy.blocks ? copy.blocks->data() : copy.pixels, bytes);
+                freeImage(copy);
+                std::lock_guard<std::mutex> lock(this->mutex);
+                slotPtr->copied = true;
+            });
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // True once every requested image has been uploaded or aliased
+    bool Idle()
+    {
+        for (size_t i = 0; i < this->slots.size(); i++) {
+            if (this->slots[i].state == SLOT_COPYING)
+                return false;
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->pendingDecodes == 0 && this->decoded.empty() && this->aliases.empty();
+    }
+
+    // Distinct image files requested vs. ones that turned out to duplicate another file
+    void PrintStats() const
+    {
+        std::cout << "Textures: " << this->pathHandles.size() << " files, "
+            << this->aliasCount << " shared by content, "
+            << this->compressedCount << " block-compressed, "
+            << this->solidHandles.size() << " solid colours" << std::endl;
+    }
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_COPYING, SLOT_UPLOADING };
+
+    typedef std::pair<uint64_t, size_t> ContentKey;  // Hash and byte size
+
+    struct Image
+    {
+        TextureHandle handle = NO_TEXTURE;
+        unsigned char* pixels = nullptr;                       // RGBA8 from SOIL
+        std::shared_ptr<std::vector<unsigned char> > blocks;  // KTX2 level data
+        Ktx2Image ktx;
+        int width = 0;
+        int height = 0;
+        size_t size = 0;
+    };
+
+    struct Slot
+    {
+        GLuint pbo = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+        SlotState state = SLOT_FREE;
+        bool copied = false;      // Written by the copying worker under mutex
+        TextureHandle handle = NO_TEXTURE;
+        int width = 0;
+        int height = 0;
+        size_t size = 0;
+        bool compressed = false;
+        Ktx2Image ktx;
+    };
+
+    ThreadPool& pool;
+    size_t frameBudget;
+    std::vector<Slot> slots;
+
+    // GL-thread state
+    std::vector<GLuint> names;               // Per handle
+    std::vector<TextureHandle> canonical;    // Per handle; differs from itself for content duplicates
+    std::vector<GLuint> owned;
+    std::map<std::string, TextureHandle> pathHandles;
+    std::map<ContentKey, TextureHandle> solidHandles;
+    size_t aliasCount;
+    size_t compressedCount;
+    bool supportsS3tc;
+    bool supportsBptc;
+
+    // Shared with workers, guarded by mutex
+    std::mutex mutex;
+    std::map<ContentKey, TextureHandle> contentHandles;
+    std::deque<Image> decoded;
+    std::vector<std::pair<TextureHandle, TextureHandle> > aliases;
+    unsigned int pendingDecodes;
+
+    // Worker: read and hash the file, then decode it unless identical bytes were seen before
+    void decode(const std::string& path, TextureHandle handle)
+    {
+        Image image;
+        image.handle = handle;
+
+        // Prefer a prebuilt compressed chain when the driver can take it and it was built
+        // from the current source (files from external encoders carry no record)
+        std::vector<char> source;
+        bool haveSource = ReadWholeFile(path, source) && !source.empty();
+        std::vector<char> bytes;
+        std::shared_ptr<std::vector<unsigned char> > blocks(new std::vector<unsigned char>());
+        bool compressed = ReadWholeFile(path + ".ktx2", bytes)
+            && ParseKtx2(bytes.data(), bytes.size(), image.ktx, *blocks)
+            && this->formatSupported(image.ktx.vkFormat);
+        if (compressed && haveSource && !image.ktx.source.empty() && image.ktx.source != Ktx2SourceRecord(source)) {
+            std::cout << "WARNING::TEXTURE:: " << path << ".ktx2 is out of date with its source, decoding "
+                << path << " instead (rerun CompressTextures)" << std::endl;
+            compressed = false;
+        }
+        if (!compressed)
+            bytes.swap(source);
+
+        if (!compressed && !haveSource) {
+            std::cout << "Failed to load texture " << path << std::endl;
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pendingDecodes--;
+            return;
+        }
+
+        ContentKey key(HashBytes(bytes.data(), bytes.size()), bytes.size());
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            std::map<ContentKey, TextureHandle>::iterator known = this->contentHandles.find(key);
+            if (known != this->contentHandles.end()) {
+                this->aliases.push_back(std::make_pair(handle, known->second));
+                this->pendingDecodes--;
+                return;
+            }
+            this->contentHandles[key] = handle;
+        }
+
+        if (compressed) {
+            image.blocks = blocks;
+            image.width = image.ktx.width;
+            image.height = image.ktx.height;
+            image.size = blocks->size();
+        }
+        else {
+            image.pixels = SOIL_load_image_from_memory((const unsigned char*)bytes.data(), (int)bytes.size(),
+                &image.width, &image.height, 0, SOIL_LOAD_RGBA);
+            image.size = (size_t)image.width * image.height * 4;
+            if (!image.pixels)
+                std::cout << "Failed to load texture " << path << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->pendingDecodes--;
+        if (image.pixels || image.blocks)
+            this->decoded.push_back(image);
+    }
+
+    bool formatSupported(uint32_t vkFormat) const
+    {
+        if (vkFormat == VK_FORMAT_BC7_UNORM_BLOCK || vkFormat == VK_FORMAT_BC7_SRGB_BLOCK)
+            return this->supportsBptc;
+        return this->supportsS3tc;
+    }
+
+    static void freeImage(Image& image)
+    {
+        if (image.pixels)
+            SOIL_free_image_data(image.pixels);
+        image.pixels = nullptr;
+        image.blocks.reset();
+    }
+
+    // Point duplicate handles at the handle that owns the decoded image
+    void resolveAliases()
+    {
+        std::vector<std::pair<TextureHandle, TextureHandle> > resolved;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            resolved.swap(this->aliases);
+        }
+        for (size_t i = 0; i < resolved.size(); i++) {
+            this->canonical[resolved[i].first] = resolved[i].second;
+            this->aliasCount++;
+        }
+    }
+
+    bool copyFinished(const Slot& slot)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return slot.copied;
+    }
+
+    void setSamplerState(bool mipmapped)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mipmapped ? GL_LINEAR : GL_NEAREST);
+    }
+};
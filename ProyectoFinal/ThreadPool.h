@@ -0,0 +1,94 @@
+#pragma once
+
+// Fixed-size worker pool for CPU-side loading work
+// Tasks may submit further tasks; Wait() returns once the queue has drained.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // threadCount = 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0)
+        : running(0), stopping(false)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 2;
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->taskReady.notify_all();
+        for (size_t i = 0; i < this->workers.size(); i++)
+            this->workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->tasks.push_back(std::move(task));
+        }
+        this->taskReady.notify_one();
+    }
+
+    // Blocks until every submitted task (including ones submitted by tasks) has finished
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->idle.wait(lock, [this] { return this->tasks.empty() && this->running == 0; });
+    }
+
+    unsigned int Size() const { return (unsigned int)this->workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable idle;
+    unsigned int running;
+    bool stopping;
+
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->taskReady.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+                if (this->stopping && this->tasks.empty())
+                    return;
+                task = std::move(this->tasks.front());
+                this->tasks.pop_front();
+                this->running++;
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->running--;
+                if (this->tasks.empty() && this->running == 0)
+                    this->idle.notify_all();
+            }
+        }
+    }
+};
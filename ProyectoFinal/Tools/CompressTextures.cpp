@@ -0,0 +1,216 @@
+// Offline texture compression stage
+// Converts the JPEG/PNG textures under Models/ into block-compressed KTX2 files
+// (<image>.ktx2 next to each source) with a precomputed, gamma-correct mip chain.
+// TextureStreamer picks these up automatically and uploads them with
+// glCompressedTexImage2D; delete a .ktx2 to go back to the source image.
+//
+// Usage (from ProyectoFinal/):
+//   CompressTextures [--force] Models/casa/*.jpg Models/casa/*.png ...
+//   CompressTextures --verify Models/casa/*.jpg ...
+//
+// --verify uploads every .ktx2 through the same path the viewer uses, reads each
+// level back with glGetTexImage and compares it with the CPU decoder. It only needs
+// a GL 3.3 context, so it runs headlessly on Mesa's software rasterizer:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./CompressTextures --verify Models/*/*.jpg
+//
+// Built as its own console target (not part of the viewer), e.g.
+//   g++ -std=c++14 -O2 -I.. CompressTextures.cpp -lsoil2 -lglfw -lGLEW -lGL
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLFW for the hidden verification context
+#include <GLFW/glfw3.h>
+
+// Image loading library
+#include "SOIL2/SOIL2.h"
+
+#include "FileUtils.h"
+#include "Ktx2.h"
+#include "BlockCompression.h"
+
+// Returns false on error; rgbaBytes/compressedBytes accumulate VRAM estimates
+static bool CompressFile(const std::string& path, bool force, size_t& rgbaBytes, size_t& compressedBytes)
+{
+    std::vector<char> source;
+    if (!ReadWholeFile(path, source) || source.empty()) {
+        std::cout << "Cannot read " << path << std::endl;
+        return false;
+    }
+
+    std::string record = Ktx2SourceRecord(source);
+    std::string outPath = path + ".ktx2";
+
+    // Skip files whose KTX2 was built from these exact bytes
+    std::vector<char> existing;
+    Ktx2Image previous;
+    std::vector<unsigned char> previousData;
+    if (!force && ReadWholeFile(outPath, existing)
+        && ParseKtx2(existing.data(), existing.size(), previous, previousData) && previous.source == record) {
+        std::cout << "Up to date  " << outPath << std::endl;
+        return true;
+    }
+
+    int width, height;
+    unsigned char* pixels = SOIL_load_image_from_memory((const unsigned char*)source.data(), (int)source.size(),
+        &width, &height, 0, SOIL_LOAD_RGBA);
+    if (!pixels) {
+        std::cout << "Cannot decode " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+    SOIL_free_image_data(pixels);
+
+    // Any translucent texel selects BC3, otherwise BC1
+    bool hasAlpha = false;
+    for (size_t i = 3; i < level.size(); i += 4) {
+        if (level[i] != 255) {
+            hasAlpha = true;
+            break;
+        }
+    }
+
+    std::vector<std::vector<unsigned char> > levels;
+    int levelWidth = width, levelHeight = height;
+    for (;;) {
+        rgbaBytes += level.size();
+        levels.push_back(CompressImage(level, levelWidth, levelHeight, hasAlpha));
+        compressedBytes += levels.back().size();
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        int nextWidth, nextHeight;
+        level = DownsampleSrgb(level, levelWidth, levelHeight, nextWidth, nextHeight);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    uint32_t vkFormat = hasAlpha ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    std::vector<unsigned char> file = WriteKtx2(vkFormat, width, height, levels, record);
+    if (!WriteWholeFile(outPath, file.data(), file.size())) {
+        std::cout << "Cannot write " << outPath << std::endl;
+        return false;
+    }
+
+    std::cout << (hasAlpha ? "BC3 " : "BC1 ") << width << "x" << height << " "
+        << levels.size() << " levels  " << outPath << std::endl;
+    return true;
+}
+
+// Uploads a KTX2 file and checks every level read back from GL against the CPU decoder
+static bool VerifyFile(const std::string& path)
+{
+    std::string ktxPath = path + ".ktx2";
+    std::vector<char> bytes;
+    Ktx2Image image;
+    std::vector<unsigned char> levelData;
+    if (!ReadWholeFile(ktxPath, bytes) || !ParseKtx2(bytes.data(), bytes.size(), image, levelData)) {
+        std::cout << "FAIL  " << ktxPath << " missing or malformed" << std::endl;
+        return false;
+    }
+
+    bool bc3 = Ktx2BlockBytes(image.vkFormat) == 16;
+    if (image.vkFormat == VK_FORMAT_BC7_UNORM_BLOCK || image.vkFormat == VK_FORMAT_BC7_SRGB_BLOCK) {
+        std::cout << "SKIP  " << ktxPath << " (BC7 has no CPU reference decoder)" << std::endl;
+        return true;
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    UploadKtx2Levels(image, levelData.data());
+
+    int worst = 0;
+    bool ok = glGetError() == GL_NO_ERROR;
+    for (size_t i = 0; ok && i < image.levels.size(); i++) {
+        const Ktx2Level& level = image.levels[i];
+        std::vector<unsigned char> expected = DecompressImage(&levelData[(size_t)level.offset], level.width, level.height, bc3);
+        std::vector<unsigned char> actual(expected.size());
+        glGetTexImage(GL_TEXTURE_2D, (GLint)i, GL_RGBA, GL_UNSIGNED_BYTE, actual.data());
+
+        // Hardware and Mesa interpolate the 1/3 and 2/3 palette entries with slightly different rounding
+        for (size_t j = 0; j < expected.size(); j++) {
+            int error = std::abs((int)expected[j] - (int)actual[j]);
+            worst = error > worst ? error : worst;
+        }
+    }
+    ok = ok && worst <= 3 && glGetError() == GL_NO_ERROR;
+    glDeleteTextures(1, &texture);
+
+    std::cout << (ok ? "OK    " : "FAIL  ") << ktxPath << " (max error " << worst << ")" << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    bool force = false, verify = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--force")
+            force = true;
+        else if (arg == "--verify")
+            verify = true;
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty()) {
+        std::cout << "Usage: CompressTextures [--force | --verify] image..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    if (!verify) {
+        size_t rgbaBytes = 0, compressedBytes = 0;
+        for (size_t i = 0; i < files.size(); i++)
+            failures += CompressFile(files[i], force, rgbaBytes, compressedBytes) ? 0 : 1;
+        if (compressedBytes > 0)
+            std::cout << "VRAM (rewritten files): " << rgbaBytes / 1024 << " KB as RGBA8 -> "
+                << compressedBytes / 1024 << " KB compressed" << std::endl;
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // Hidden 3.3 core context, the same profile the viewer asks for
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "CompressTextures", nullptr, nullptr);
+    if (nullptr == window) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    if (GLEW_OK != glewInit()) {
+        std::cout << "Failed to initialize GLEW" << std::endl;
+        return EXIT_FAILURE;
+    }
+    glGetError();
+
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    if (!GLEW_EXT_texture_compression_s3tc) {
+        std::cout << "GL_EXT_texture_compression_s3tc not supported" << std::endl;
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+        failures += VerifyFile(files[i]) ? 0 : 1;
+
+    glfwTerminate();
+    std::cout << files.size() - failures << "/" << files.size() << " verified" << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+// Normal matrix benchmark
+// Measures what moving transpose(inverse(model)) out of lighting.vs buys:
+//   CPU: glm's inverse-transpose against NormalMatrices() (NormalMatrix.h), the batch
+//        RenderQueue::Flush() runs over its transforms, in ns per matrix
+//   GPU: the same vertex stage with the inverse per vertex and with the normalMatrix
+//        uniform, timed with GL_TIME_ELAPSED queries and with the wall clock around a
+//        glFinish (software rasterizers run the draw outside the query). Rasterization
+//        is discarded and Normal is captured with transform feedback, so only the
+//        vertex work is timed and the driver cannot drop it; both captures are
+//        compared afterwards.
+//
+// Usage (from ProyectoFinal/):
+//   NormalMatrixBench [vertices]
+// It only needs a GL 3.3 context; under Mesa's software rasterizer the GPU numbers
+// measure llvmpipe rather than a GPU:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./NormalMatrixBench
+//
+// Built as its own console target (not part of the viewer), e.g.
+//   g++ -std=c++14 -O2 -I.. NormalMatrixBench.cpp -lglfw -lGLEW -lGL
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLFW for the hidden benchmark context
+#include <GLFW/glfw3.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "NormalMatrix.h"
+
+static const int REPEATS = 15;
+
+static const char* PER_VERTEX_SOURCE =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 normal;\n"
+    "uniform mat4 model;\n"
+    "out vec3 Normal;\n"
+    "void main() { Normal = mat3(transpose(inverse(model))) * normal; }\n";
+
+static const char* UNIFORM_SOURCE =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 normal;\n"
+    "uniform mat4 model;\n"
+    "uniform mat3 normalMatrix;\n"
+    "out vec3 Normal;\n"
+    "void main() { Normal = normalMatrix * normal; }\n";
+
+// Rotated, translated and non-uniformly scaled, like the scene's furniture
+static glm::mat4 TestMatrix(unsigned int seed)
+{
+    float t = (float)(seed % 997) * 0.37f;
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(t, -t * 0.5f, 2.0f));
+    model = glm::rotate(model, t, glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f + t)));
+    return glm::scale(model, glm::vec3(1.0f + (seed % 7) * 0.25f, 0.5f + (seed % 5) * 0.5f, 1.5f));
+}
+
+static double Milliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void BenchCpu()
+{
+    const size_t COUNT = 100000;
+    std::vector<glm::mat4> models(COUNT);
+    for (size_t i = 0; i < COUNT; i++)
+        models[i] = TestMatrix((unsigned int)i);
+    std::vector<glm::mat3> reference(COUNT), batched(COUNT);
+
+    // Best of REPEATS, so the first pass's page faults do not count
+    double glmTime = 1e30, batchTime = 1e30;
+    for (int r = 0; r < REPEATS; r++) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < COUNT; i++)
+            reference[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+        glmTime = std::min(glmTime, Milliseconds(start));
+
+        start = std::chrono::high_resolution_clock::now();
+        NormalMatrices(models.data(), COUNT, batched.data());
+        batchTime = std::min(batchTime, Milliseconds(start));
+    }
+
+    float worst = 0.0f;
+    for (size_t i = 0; i < COUNT; i++) {
+        for (int c = 0; c < 3; c++)
+            worst = std::max(worst, glm::length(batched[i][c] - reference[i][c]) / glm::length(reference[i][c]));
+    }
+
+    std::cout << "CPU, " << COUNT << " matrices:" << std::endl;
+    std::cout << "  transpose(inverse(mat3))  " << glmTime * 1e6 / COUNT << " ns per matrix" << std::endl;
+    std::cout << "  NormalMatrices            " << batchTime * 1e6 / COUNT << " ns per matrix"
+#if defined(NORMAL_MATRIX_SSE)
+        << " (SSE)"
+#endif
+        << ", max relative difference " << worst << std::endl;
+}
+
+static GLuint CompileProgram(const char* source)
+{
+    GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    const GLchar* varyings[] = { "Normal" };
+    glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    glDeleteShader(shader);
+    return success ? program : 0;
+}
+
+struct GpuTime
+{
+    double query;   // GL_TIME_ELAPSED, ms
+    double finish;  // Wall clock from the draw to glFinish, ms
+};
+
+// Best times of REPEATS draws of every vertex; the last capture is read back into normals
+static GpuTime TimeProgram(GLuint program, GLuint VAO, GLuint feedback, GLsizei vertexCount, std::vector<glm::vec3>& normals)
+{
+    glm::mat4 model = TestMatrix(12345);
+    glm::mat3 normalMatrix;
+    NormalMatrices(&model, 1, &normalMatrix);
+
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &model[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"), 1, GL_FALSE, &normalMatrix[0][0]);
+    glBindVertexArray(VAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedback);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    GpuTime best = { 1e30, 1e30 };
+    glFinish();
+    for (int r = 0; r < REPEATS; r++) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, vertexCount);
+        glEndTransformFeedback();
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        best.finish = std::min(best.finish, Milliseconds(start));
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        best.query = std::min(best.query, elapsed / 1e6);
+    }
+    glDeleteQueries(1, &query);
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    normals.resize(vertexCount);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vertexCount * sizeof(glm::vec3), normals.data());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    return best;
+}
+
+static bool BenchGpu(GLsizei vertexCount)
+{
+    GLuint perVertex = CompileProgram(PER_VERTEX_SOURCE);
+    GLuint uniform = CompileProgram(UNIFORM_SOURCE);
+    if (!perVertex || !uniform)
+        return false;
+
+    std::vector<glm::vec3> source(vertexCount);
+    for (GLsizei i = 0; i < vertexCount; i++) {
+        float a = i * 0.618034f, b = i * 0.000731f;
+        source[i] = glm::vec3(std::cos(a) * std::sin(b), std::sin(a) * std::sin(b), std::cos(b));
+    }
+
+    GLuint VAO, VBO, feedback;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &feedback);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), source.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, feedback);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, vertexCount * sizeof(glm::vec3), nullptr, GL_STREAM_READ);
+
+    std::vector<glm::vec3> perVertexNormals, uniformNormals;
+    GpuTime perVertexTime = TimeProgram(perVertex, VAO, feedback, vertexCount, perVertexNormals);
+    GpuTime uniformTime = TimeProgram(uniform, VAO, feedback, vertexCount, uniformNormals);
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        std::cout << "ERROR::NORMALMATRIXBENCH::GL_ERROR 0x" << std::hex << error << std::dec << std::endl;
+        return false;
+    }
+
+    float worst = 0.0f;
+    for (GLsizei i = 0; i < vertexCount; i++)
+        worst = std::max(worst, glm::length(perVertexNormals[i] - uniformNormals[i]) / std::max(glm::length(perVertexNormals[i]), 1e-6f));
+
+    std::cout << "GPU vertex stage, " << vertexCount << " vertices (query / glFinish):" << std::endl;
+    std::cout << "  inverse per vertex   " << perVertexTime.query << " / " << perVertexTime.finish << " ms" << std::endl;
+    std::cout << "  normalMatrix uniform " << uniformTime.query << " / " << uniformTime.finish << " ms ("
+        << 100.0 * (1.0 - uniformTime.finish / perVertexTime.finish) << "% less by glFinish)" << std::endl;
+    std::cout << "  max relative difference " << worst << std::endl;
+
+    glDeleteBuffers(1, &feedback);
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteProgram(perVertex);
+    glDeleteProgram(uniform);
+    return worst < 1e-3f;
+}
+
+int main(int argc, char** argv)
+{
+    GLsizei vertexCount = argc > 1 ? (GLsizei)std::atoi(argv[1]) : 4000000;
+    if (vertexCount <= 0) {
+        std::cout << "Usage: NormalMatrixBench [vertices]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    BenchCpu();
+
+    // Hidden 3.3 core context, the same profile the viewer asks for
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "NormalMatrixBench", nullptr, nullptr);
+    if (nullptr == window) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(window);
+
+    glewExperimental = GL_TRUE;
+    if (GLEW_OK != glewInit()) {
+        std::cout << "Failed to initialize GLEW" << std::endl;
+        return EXIT_FAILURE;
+    }
+    glGetError();
+
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    bool ok = BenchGpu(vertexCount);
+
+    glfwTerminate();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
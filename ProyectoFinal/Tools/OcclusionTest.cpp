@@ -0,0 +1,170 @@
+// Headless check of OcclusionBuffer against brute-force ray casts
+// The only occluder is a walled room (10 x 3 x 10 m, ceiling, doorway in the front
+// wall). For 20 cameras, 15 inside the room and 5 outside facing the doorway:
+// - every pixel of the buffer is compared with a ray cast through its centre: coverage
+//   must match exactly and 1/w to 0.1%
+// - the buffer rasterized on a ThreadPool must be bit-identical to the one rasterized
+//   on the calling thread
+// - 300 random boxes: each one IsVisible() rejects inside the frustum is sampled at 200
+//   surface points, none of which may have a clear line to the camera
+// It also prints the share of in-frustum boxes outside the room that were culled.
+//
+// Usage (from ProyectoFinal/Tools/): OcclusionTest; exits with EXIT_FAILURE on a mismatch
+//
+// Built as its own console target (not part of the viewer), e.g.
+//   g++ -std=c++14 -O2 -I.. -I"../../External Libraries/glm" -I"../../External Libraries/assimp/include" OcclusionTest.cpp -lpthread
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "OcclusionBuffer.h"
+#include "Frustum.h"
+#include "ThreadPool.h"
+#include "TestScenes.h"
+
+const int CAMERA_COUNT = 20;
+const int OUTSIDE_CAMERAS = 5;
+const int BOXES_PER_CAMERA = 300;
+const int SAMPLES_PER_BOX = 200;
+
+// Room centred on the origin, doorway [-0.5, 0.5] x [0, 2] in the z = 5 wall
+static void BuildRoom(TestMesh& room)
+{
+    room.Grid(glm::vec3(-5.0f, 0.0f, -5.0f), glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(0.0f, 3.0f, 0.0f), 8);  // Back
+    room.Grid(glm::vec3(-5.0f, 0.0f, -5.0f), glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f, 3.0f, 0.0f), 8);  // Left
+    room.Grid(glm::vec3(5.0f, 0.0f, -5.0f), glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f, 3.0f, 0.0f), 8);   // Right
+    room.Grid(glm::vec3(-5.0f, 3.0f, -5.0f), glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 10.0f), 8); // Ceiling
+    room.Grid(glm::vec3(-5.0f, 0.0f, 5.0f), glm::vec3(4.5f, 0.0f, 0.0f), glm::vec3(0.0f, 3.0f, 0.0f), 4);   // Front, left of the door
+    room.Grid(glm::vec3(0.5f, 0.0f, 5.0f), glm::vec3(4.5f, 0.0f, 0.0f), glm::vec3(0.0f, 3.0f, 0.0f), 4);    // Front, right of the door
+    room.Grid(glm::vec3(-0.5f, 2.0f, 5.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1);   // Lintel
+    room.Build();
+}
+
+// Compares every pixel with a ray cast through its centre
+static void CheckPixels(const OcclusionBuffer& buffer, const glm::mat4& viewProjection, const std::vector<glm::vec3>& triangles,
+    int& coverageErrors, int& depthErrors)
+{
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    for (int y = 0; y < OcclusionBuffer::HEIGHT; y++) {
+        for (int x = 0; x < OcclusionBuffer::WIDTH; x++) {
+            glm::vec2 ndc((x + 0.5f) / OcclusionBuffer::WIDTH * 2.0f - 1.0f, (y + 0.5f) / OcclusionBuffer::HEIGHT * 2.0f - 1.0f);
+            glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+            float expected = 0.0f;
+            float t = NearestHit(triangles, origin, direction);
+            if (t < FLT_MAX)
+                expected = 1.0f / (viewProjection * glm::vec4(origin + direction * t, 1.0f)).w;
+
+            float actual = buffer.Depth()[y * OcclusionBuffer::WIDTH + x];
+            if ((expected > 0.0f) != (actual > 0.0f))
+                coverageErrors++;
+            else if (expected > 0.0f && std::fabs(expected - actual) > 1e-3f * expected)
+                depthErrors++;
+        }
+    }
+}
+
+// True when some sampled point of a box's surface inside the view has a clear line to the eye
+static bool BoxSeen(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& eye, const glm::mat4& viewProjection,
+    const std::vector<glm::vec3>& triangles, TestRandom& random)
+{
+    for (int s = 0; s < SAMPLES_PER_BOX; s++) {
+        glm::vec3 point(random.Uniform(boxMin.x, boxMax.x), random.Uniform(boxMin.y, boxMax.y), random.Uniform(boxMin.z, boxMax.z));
+        int face = random.Integer(3);
+        point[face] = random.Integer(2) ? boxMin[face] : boxMax[face];
+
+        glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+        if (clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w)
+            continue;
+        if (!SegmentBlocked(triangles, eye, point))
+            return true;
+    }
+    return false;
+}
+
+int main()
+{
+    TestMesh room;
+    BuildRoom(room);
+    glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 2.0f));
+    glm::vec3 roomCentre(1.0f, 0.0f, 2.0f);
+    std::vector<glm::vec3> triangles = room.WorldTriangles(world);
+
+    ThreadPool pool;
+    OcclusionBuffer threaded(&pool), single(nullptr);
+    threaded.AddOccluders(room.bvh, world, 100000);
+    single.AddOccluders(room.bvh, world, 100000);
+
+    TestRandom random(12);
+    int coverageErrors = 0, depthErrors = 0, threadErrors = 0, falselyCulled = 0;
+    int outsideBoxes = 0, outsideCulled = 0;
+    double renderMicros = 0.0;
+    for (int c = 0; c < CAMERA_COUNT; c++) {
+        glm::vec3 eye, forward;
+        if (c < CAMERA_COUNT - OUTSIDE_CAMERAS) {
+            eye = roomCentre + glm::vec3(random.Uniform(-4.0f, 4.0f), random.Uniform(0.5f, 2.5f), random.Uniform(-4.0f, 4.0f));
+            float yaw = random.Uniform(0.0f, 6.283f);
+            forward = glm::vec3(std::cos(yaw), random.Uniform(-0.2f, 0.2f), std::sin(yaw));
+        }
+        else {
+            eye = roomCentre + glm::vec3(random.Uniform(-5.0f, 5.0f), 1.5f, random.Uniform(12.0f, 17.0f));
+            forward = glm::vec3(random.Uniform(-0.2f, 0.2f), 0.0f, -1.0f);
+        }
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.6f, 0.1f, 100.0f)
+            * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        threaded.Render(viewProjection);
+        renderMicros += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+        single.Render(viewProjection);
+
+        for (int i = 0; i < OcclusionBuffer::WIDTH * OcclusionBuffer::HEIGHT; i++) {
+            if (threaded.Depth()[i] != single.Depth()[i])
+                threadErrors++;
+        }
+        CheckPixels(threaded, viewProjection, triangles, coverageErrors, depthErrors);
+
+        Frustum frustum(viewProjection);
+        for (int b = 0; b < BOXES_PER_CAMERA; b++) {
+            glm::vec3 centre = roomCentre + glm::vec3(random.Uniform(-15.0f, 15.0f), random.Uniform(0.0f, 3.0f), random.Uniform(-15.0f, 15.0f));
+            glm::vec3 extent(random.Uniform(0.05f, 0.55f));
+            glm::vec3 boxMin = centre - extent, boxMax = centre + extent;
+
+            AabbList box;
+            box.Add(boxMin, boxMax);
+            std::vector<unsigned char> inFrustum;
+            if (box.Cull(frustum, inFrustum) == 0)
+                continue;
+
+            bool visible = threaded.IsVisible(boxMin, boxMax);
+            bool outside = std::fabs(centre.x - roomCentre.x) > 5.6f || std::fabs(centre.z - roomCentre.z) > 5.6f;
+            if (outside) {
+                outsideBoxes++;
+                outsideCulled += visible ? 0 : 1;
+            }
+            if (!visible && BoxSeen(boxMin, boxMax, eye, viewProjection, triangles, random))
+                falselyCulled++;
+        }
+    }
+
+    int pixels = CAMERA_COUNT * OcclusionBuffer::WIDTH * OcclusionBuffer::HEIGHT;
+    std::cout << "Pixels: " << coverageErrors << " coverage and " << depthErrors << " depth mismatches of " << pixels << std::endl;
+    std::cout << "Threaded vs single-threaded: " << threadErrors << " differing pixels" << std::endl;
+    std::cout << "Boxes culled while visible: " << falselyCulled << std::endl;
+    std::cout << "Boxes outside the room: " << outsideCulled << " of " << outsideBoxes << " in the frustum culled" << std::endl;
+    std::cout << "Render: " << renderMicros / CAMERA_COUNT << " us for " << threaded.OccluderCount() << " triangles" << std::endl;
+
+    bool passed = coverageErrors == 0 && depthErrors == 0 && threadErrors == 0 && falselyCulled == 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,159 @@
+// Headless check of PortalCells against brute-force line-of-sight tests
+// The house is two rooms (8 x 6 m, 2.5 m walls 15 cm thick, no roof) split by a
+// partition with a doorway, with a window in three outer walls. It is rotated and
+// offset so nothing lines up with the detection grid. The doorway gets a door angle
+// that alternates between open and shut.
+// - Detection must find 3 cells (both rooms and the outside) and 4 portals.
+// - 4,000 random cameras, two thirds inside the house, each test 40 random points in
+//   view below the wall tops. A point with a clear line to the eye (through no wall,
+//   and no door panel while the door is shut) must not be in a hidden cell.
+// It also prints the average number of rooms reached and the cost of Update().
+//
+// Usage (from ProyectoFinal/Tools/): PortalTest; exits with EXIT_FAILURE on a mismatch
+//
+// Built as its own console target (not part of the viewer), e.g.
+//   g++ -std=c++14 -O2 -I.. -I"../../External Libraries/glm" -I"../../External Libraries/assimp/include" PortalTest.cpp
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PortalCells.h"
+#include "TestScenes.h"
+
+const float WALL_HEIGHT = 2.5f;
+const float WALL_THICKNESS = 0.15f;
+const int CAMERA_COUNT = 4000;
+const int POINTS_PER_CAMERA = 40;
+
+// Wall from a to b on the floor plan (x, z), both faces and end caps. An opening
+// [along0, along1] x [low, high] leaves a hole, filled by a pane in filler if given.
+static void Wall(TestMesh& walls, TestMesh* filler, const glm::vec2& a, const glm::vec2& b,
+    float along0 = -1.0f, float along1 = -1.0f, float low = 0.0f, float high = 0.0f)
+{
+    glm::vec2 direction = glm::normalize(b - a);
+    glm::vec2 normal(-direction.y, direction.x);
+    float length = glm::length(b - a);
+    // Point along the wall at height y, on face side (-1, 0 = centre, 1)
+    auto at = [&](float along, float y, float side) {
+        glm::vec2 p = a + direction * along + normal * (side * WALL_THICKNESS * 0.5f);
+        return glm::vec3(p.x, y, p.y);
+    };
+    auto slab = [&](float from, float to, float bottom, float top) {
+        walls.Quad(at(from, bottom, -1.0f), at(to, bottom, -1.0f), at(to, top, -1.0f), at(from, top, -1.0f));
+        walls.Quad(at(from, bottom, 1.0f), at(to, bottom, 1.0f), at(to, top, 1.0f), at(from, top, 1.0f));
+    };
+    auto cap = [&](float along, float bottom, float top) {
+        walls.Quad(at(along, bottom, -1.0f), at(along, bottom, 1.0f), at(along, top, 1.0f), at(along, top, -1.0f));
+    };
+
+    if (along0 < 0.0f) {
+        slab(0.0f, length, 0.0f, WALL_HEIGHT);
+    }
+    else {
+        slab(0.0f, along0, 0.0f, WALL_HEIGHT);
+        slab(along1, length, 0.0f, WALL_HEIGHT);
+        if (low > 0.0f)
+            slab(along0, along1, 0.0f, low);
+        slab(along0, along1, high, WALL_HEIGHT);
+        cap(along0, low, high);
+        cap(along1, low, high);
+        if (filler)
+            filler->Quad(at(along0, low, 0.0f), at(along1, low, 0.0f), at(along1, high, 0.0f), at(along0, high, 0.0f));
+    }
+    cap(0.0f, 0.0f, WALL_HEIGHT);
+    cap(length, 0.0f, WALL_HEIGHT);
+}
+
+int main()
+{
+    TestMesh house, glass, door;
+    Wall(house, &glass, glm::vec2(0.0f, 0.0f), glm::vec2(8.0f, 0.0f), 1.0f, 2.5f, 0.8f, 2.0f);  // Back, window in room A
+    Wall(house, &glass, glm::vec2(8.0f, 6.0f), glm::vec2(0.0f, 6.0f), 1.0f, 2.5f, 0.8f, 2.0f);  // Front, window in room B
+    Wall(house, nullptr, glm::vec2(0.0f, 6.0f), glm::vec2(0.0f, 0.0f));                         // Left
+    Wall(house, &glass, glm::vec2(8.0f, 0.0f), glm::vec2(8.0f, 6.0f), 2.0f, 4.0f, 0.3f, 2.2f);  // Right, tall window in room B
+    Wall(house, &door, glm::vec2(4.0f, 0.0f), glm::vec2(4.0f, 6.0f), 2.5f, 3.4f, 0.0f, 2.1f);   // Partition with the doorway
+    house.Build();
+    glass.Build();
+    door.Build();
+
+    glm::mat4 world = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.2f, -2.0f)), 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+    float doorAngle = 0.0f;
+    PortalCells cells;
+    cells.AddWalls(house.bvh, world);
+    cells.AddPortals(glass.bvh, world);
+    cells.AddPortals(door.bvh, world, &doorAngle);
+    cells.Build(0.6f, 2.0f);
+    bool detected = cells.CellCount() == 3 && cells.PortalCount() == 4;
+
+    std::vector<glm::vec3> wallTriangles = house.WorldTriangles(world);
+    std::vector<glm::vec3> doorTriangles = door.WorldTriangles(world);
+
+    // Cameras and points are drawn in house space, then moved to the world
+    TestRandom random(13);
+    int checks = 0, hidden = 0, falselyHidden = 0;
+    unsigned int roomsReached = 0;
+    for (int c = 0; c < CAMERA_COUNT; c++) {
+        doorAngle = (c % 2) ? 0.0f : 30.0f;
+        glm::vec3 local = (c % 3 == 0)
+            ? glm::vec3(random.Uniform(-3.0f, 11.0f), random.Uniform(0.6f, 2.0f), random.Uniform(-3.0f, 9.0f))
+            : glm::vec3(random.Uniform(0.3f, 7.7f), random.Uniform(0.6f, 2.0f), random.Uniform(0.3f, 5.7f));
+        glm::vec3 eye = glm::vec3(world * glm::vec4(local, 1.0f));
+        float yaw = random.Uniform(0.0f, 6.283f);
+        glm::vec3 forward(std::cos(yaw), random.Uniform(-0.3f, 0.3f), std::sin(yaw));
+        glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.6f, 0.1f, 100.0f)
+            * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+        cells.Update(eye, viewProjection);
+        roomsReached += cells.VisibleCells();
+
+        for (int p = 0; p < POINTS_PER_CAMERA; p++) {
+            glm::vec3 pointLocal;
+            int where = random.Integer(3);
+            if (where == 0)
+                pointLocal = glm::vec3(random.Uniform(0.2f, 3.8f), random.Uniform(0.25f, 2.4f), random.Uniform(0.2f, 5.8f));
+            else if (where == 1)
+                pointLocal = glm::vec3(random.Uniform(4.2f, 7.8f), random.Uniform(0.25f, 2.4f), random.Uniform(0.2f, 5.8f));
+            else
+                pointLocal = glm::vec3(random.Uniform(-4.0f, 12.0f), random.Uniform(0.2f, 2.4f), random.Uniform(-4.0f, 10.0f));
+            glm::vec3 point = glm::vec3(world * glm::vec4(pointLocal, 1.0f));
+
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 0.1f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w)
+                continue;
+
+            checks++;
+            bool visible = cells.IsVisible(cells.CellMask(point - glm::vec3(0.01f), point + glm::vec3(0.01f)));
+            hidden += visible ? 0 : 1;
+            bool seen = !SegmentBlocked(wallTriangles, eye, point) && !(doorAngle == 0.0f && SegmentBlocked(doorTriangles, eye, point));
+            if (seen && !visible)
+                falselyHidden++;
+        }
+    }
+
+    // Cost of one walk, from room A looking through the open doorway
+    glm::vec3 eye = glm::vec3(world * glm::vec4(2.0f, 1.2f, 3.0f, 1.0f));
+    glm::vec3 forward = glm::vec3(world * glm::vec4(1.0f, 0.0f, 0.0f, 0.0f));
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 1.6f, 0.1f, 100.0f)
+        * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    doorAngle = 30.0f;
+    const int UPDATE_RUNS = 10000;
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < UPDATE_RUNS; i++)
+        cells.Update(eye, viewProjection);
+    double updateMicros = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / UPDATE_RUNS;
+
+    std::cout << "Detected: " << cells.CellCount() << " cells, " << cells.PortalCount() << " portals (expected 3, 4)" << std::endl;
+    std::cout << "Points hidden while in sight: " << falselyHidden << " of " << checks << " (" << hidden << " hidden)" << std::endl;
+    std::cout << "Rooms reached: " << (float)roomsReached / CAMERA_COUNT << " of " << cells.CellCount() << " on average" << std::endl;
+    std::cout << "Update: " << updateMicros << " us" << std::endl;
+
+    bool passed = detected && falselyHidden == 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// Geometry shared by the headless culling tests (OcclusionTest.cpp, PortalTest.cpp)
+// TestMesh builds a model out of quads and gives it a TriangleBvh through the same
+// ModelData path the viewer uses; SegmentBlocked() is the brute-force reference the
+// culling results are checked against.
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "ModelCache.h"
+
+class TestMesh
+{
+public:
+    std::vector<CacheVertex> vertices;
+    std::vector<uint32_t> indices;
+    TriangleBvh bvh;
+
+    // Two triangles, a-b-c and a-c-d
+    void Quad(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+    {
+        const glm::vec3 corners[6] = { a, b, c, a, c, d };
+        for (int i = 0; i < 6; i++) {
+            CacheVertex vertex;
+            vertex.Position = corners[i];
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoords = glm::vec2(0.0f);
+            this->indices.push_back((uint32_t)this->vertices.size());
+            this->vertices.push_back(vertex);
+        }
+    }
+
+    // origin + [0, 1]^2 over the two axes, split into cuts x cuts quads
+    void Grid(const glm::vec3& origin, const glm::vec3& axisA, const glm::vec3& axisB, int cuts)
+    {
+        for (int i = 0; i < cuts; i++) {
+            for (int j = 0; j < cuts; j++) {
+                glm::vec3 p = origin + axisA * ((float)i / cuts) + axisB * ((float)j / cuts);
+                glm::vec3 a = axisA / (float)cuts, b = axisB / (float)cuts;
+                this->Quad(p, p + a, p + a + b, p + b);
+            }
+        }
+    }
+
+    // One mesh, no materials: enough for TriangleBvh::Build
+    void Build()
+    {
+        CacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.meshCount = 1;
+        header.vertexCount = (uint32_t)this->vertices.size();
+        header.indexCount = (uint32_t)this->indices.size();
+
+        CacheMesh mesh;
+        std::memset(&mesh, 0, sizeof(mesh));
+        mesh.indexCount = (uint32_t)this->indices.size();
+        mesh.vertexCount = (uint32_t)this->vertices.size();
+
+        ModelData data;
+        data.header = &header;
+        data.meshes = &mesh;
+        data.vertices = this->vertices.data();
+        data.indices = this->indices.data();
+        this->bvh.Build(data);
+    }
+
+    // World-space triangle soup, three corners per triangle
+    std::vector<glm::vec3> WorldTriangles(const glm::mat4& world) const
+    {
+        std::vector<glm::vec3> result;
+        for (size_t i = 0; i < this->indices.size(); i++)
+            result.push_back(glm::vec3(world * glm::vec4(this->vertices[this->indices[i]].Position, 1.0f)));
+        return result;
+    }
+};
+
+// Moller-Trumbore; t is in units of direction
+inline bool RayTriangle(const glm::vec3& origin, const glm::vec3& direction,
+    const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& t)
+{
+    glm::vec3 edge1 = v1 - v0, edge2 = v2 - v0;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    if (std::fabs(determinant) < 1e-12f)
+        return false;
+
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = origin - v0;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(edge2, q) * inverse;
+    return t > 0.0f;
+}
+
+// Nearest hit along the ray, FLT_MAX when it hits nothing
+inline float NearestHit(const std::vector<glm::vec3>& triangles, const glm::vec3& origin, const glm::vec3& direction)
+{
+    float nearest = FLT_MAX, t;
+    for (size_t k = 0; k + 2 < triangles.size(); k += 3) {
+        if (RayTriangle(origin, direction, triangles[k], triangles[k + 1], triangles[k + 2], t) && t < nearest)
+            nearest = t;
+    }
+    return nearest;
+}
+
+// True when a triangle lies strictly between from and to
+inline bool SegmentBlocked(const std::vector<glm::vec3>& triangles, const glm::vec3& from, const glm::vec3& to)
+{
+    glm::vec3 direction = to - from;
+    float t;
+    for (size_t k = 0; k + 2 < triangles.size(); k += 3) {
+        if (RayTriangle(from, direction, triangles[k], triangles[k + 1], triangles[k + 2], t) && t > 1e-4f && t < 1.0f - 1e-4f)
+            return true;
+    }
+    return false;
+}
+
+// Fixed seed, so every run checks the same cameras
+class TestRandom
+{
+public:
+    explicit TestRandom(unsigned int seed) : engine(seed) {}
+
+    float Uniform(float low, float high) { return std::uniform_real_distribution<float>(low, high)(this->engine); }
+    int Integer(int count) { return std::uniform_int_distribution<int>(0, count - 1)(this->engine); }
+
+private:
+    std::mt19937 engine;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+// Tween engine for animated properties
+// A track eases one float from a start to an end value over a fixed duration; a vec3
+// is three tracks. Only running tracks are stored, in one structure-of-arrays block per
+// easing curve, so Update() is a few straight loops per curve with the curve inlined.
+// A finished track writes its exact end value and is swap-removed; idle props cost nothing.
+// Time advances in whole fixed steps (the remainder carries over to the next frame), so
+// the same input gives the same poses at any frame rate. Tracks are closed-form in their
+// elapsed time, so any number of steps in a frame is still a single evaluation.
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/gtx/easing.hpp>
+
+// Curves from glm/gtx/easing.hpp
+enum TweenEasing
+{
+    TWEEN_LINEAR,
+    TWEEN_QUADRATIC_IN_OUT,
+    TWEEN_CUBIC_IN_OUT,
+    TWEEN_SINE_IN_OUT,
+    TWEEN_BACK_OUT,
+    TWEEN_BOUNCE_OUT,
+    TWEEN_EASING_COUNT
+};
+
+class TweenEngine
+{
+public:
+    static constexpr float STEP = 1.0f / 120.0f;
+
+    TweenEngine()
+        : accumulator(0.0f)
+    {
+    }
+
+    TweenEngine(const TweenEngine&) = delete;
+    TweenEngine& operator=(const TweenEngine&) = delete;
+
+    // Eases *target from its current value to end. A target that is already animating
+    // is retargeted from where it is now. target must outlive the track.
+    void To(float* target, float end, float duration, TweenEasing easing)
+    {
+        this->Stop(target);
+        if (duration <= 0.0f || *target == end) {
+            *target = end;
+            return;
+        }
+
+        Block& block = this->blocks[easing];
+        this->slots[target] = std::make_pair(easing, block.targets.size());
+        block.targets.push_back(target);
+        block.from.push_back(*target);
+        block.to.push_back(end);
+        block.elapsed.push_back(0.0f);
+        block.inverseDuration.push_back(1.0f / duration);
+        block.values.push_back(*target);
+    }
+
+    void To(glm::vec3* target, const glm::vec3& end, float duration, TweenEasing easing)
+    {
+        for (int i = 0; i < 3; i++)
+            this->To(&(*target)[i], end[i], duration, easing);
+    }
+
+    // Leaves the property where it is
+    void Stop(float* target)
+    {
+        std::unordered_map<float*, std::pair<int, size_t> >::iterator found = this->slots.find(target);
+        if (found != this->slots.end())
+            this->remove(found->second.first, found->second.second);
+    }
+
+    // Advances every running track by the whole steps in deltaTime
+    void Update(float deltaTime)
+    {
+        this->accumulator += deltaTime;
+        int steps = (int)(this->accumulator / STEP);
+        if (steps <= 0)
+            return;
+        this->accumulator -= steps * STEP;
+        float advance = steps * STEP;
+
+        for (int easing = 0; easing < TWEEN_EASING_COUNT; easing++) {
+            Block& block = this->blocks[easing];
+            size_t count = block.targets.size();
+            if (count == 0)
+                continue;
+
+            float* elapsed = block.elapsed.data();
+            const float* inverseDuration = block.inverseDuration.data();
+            float* t = block.values.data();
+            for (size_t i = 0; i < count; i++) {
+                elapsed[i] += advance;
+                t[i] = std::min(elapsed[i] * inverseDuration[i], 1.0f);
+            }
+
+            switch (easing) {
+            case TWEEN_LINEAR: break;
+            case TWEEN_QUADRATIC_IN_OUT: Ease(t, count, [](float x) { return glm::quadraticEaseInOut(x); }); break;
+            case TWEEN_CUBIC_IN_OUT: Ease(t, count, [](float x) { return glm::cubicEaseInOut(x); }); break;
+            case TWEEN_SINE_IN_OUT: Ease(t, count, [](float x) { return glm::sineEaseInOut(x); }); break;
+            case TWEEN_BACK_OUT: Ease(t, count, [](float x) { return glm::backEaseOut(x); }); break;
+            case TWEEN_BOUNCE_OUT: Ease(t, count, [](float x) { return glm::bounceEaseOut(x); }); break;
+            }
+
+            const float* from = block.from.data();
+            const float* to = block.to.data();
+            for (size_t i = 0; i < count; i++)
+                t[i] = from[i] + (to[i] - from[i]) * t[i];
+
+            for (size_t i = 0; i < count; i++)
+                *block.targets[i] = t[i];
+
+            // Backwards, so swap-removal only moves tracks already visited
+            for (size_t i = count; i-- > 0;) {
+                if (block.elapsed[i] * block.inverseDuration[i] >= 1.0f) {
+                    *block.targets[i] = block.to[i];
+                    this->remove(easing, i);
+                }
+            }
+        }
+    }
+
+    size_t ActiveTracks() const { return this->slots.size(); }
+
+private:
+    // Running tracks of one curve; values is scratch for Update()
+    struct Block
+    {
+        std::vector<float*> targets;
+        std::vector<float> from;
+        std::vector<float> to;
+        std::vector<float> elapsed;
+        std::vector<float> inverseDuration;
+        std::vector<float> values;
+    };
+
+    Block blocks[TWEEN_EASING_COUNT];
+    std::unordered_map<float*, std::pair<int, size_t> > slots;  // Target -> curve, index
+    float accumulator;
+
+    template <typename Curve>
+    static void Ease(float* t, size_t count, Curve curve)
+    {
+        for (size_t i = 0; i < count; i++)
+            t[i] = curve(t[i]);
+    }
+
+    void remove(int easing, size_t index)
+    {
+        Block& block = this->blocks[easing];
+        size_t last = block.targets.size() - 1;
+        this->slots.erase(block.targets[index]);
+        if (index != last) {
+            block.targets[index] = block.targets[last];
+            block.from[index] = block.from[last];
+            block.to[index] = block.to[last];
+            block.elapsed[index] = block.elapsed[last];
+            block.inverseDuration[index] = block.inverseDuration[last];
+            this->slots[block.targets[index]].second = index;
+        }
+        block.targets.pop_back();
+        block.from.pop_back();
+        block.to.pop_back();
+        block.elapsed.pop_back();
+        block.inverseDuration.pop_back();
+        block.values.pop_back();
+    }
+};
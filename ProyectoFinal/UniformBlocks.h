@@ -0,0 +1,139 @@
+#pragma once
+
+// std140 uniform blocks shared by every program
+// The Camera block is written once per frame and read by all shaders through a fixed
+// binding point; the Lights block keeps a CPU copy and only reaches the GPU again
+// after Edit() marks it dirty. The C++ structs mirror the GLSL declarations in
+// Shader/*.vs and lighting.frag byte for byte (vec3s are padded with a float to 16).
+// Point lights are not in the block: they are binned per cluster (ClusteredLights.h).
+
+#include <cstddef>
+#include <iostream>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+// Binding points, shared with every program through Attach()
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHT_BLOCK_BINDING = 1;
+
+// layout(std140) uniform Camera
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 viewPos;
+    float pad0;
+};
+
+struct DirLightBlock
+{
+    glm::vec3 direction;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct SpotLightBlock
+{
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+
+// layout(std140) uniform Lights
+struct LightBlock
+{
+    DirLightBlock dirLight;
+    SpotLightBlock spotLight;
+};
+
+static_assert(sizeof(CameraBlock) == 208, "Camera block does not match std140");
+static_assert(sizeof(DirLightBlock) == 64 && sizeof(SpotLightBlock) == 80, "Light structs do not match std140");
+static_assert(offsetof(LightBlock, spotLight) == 64 && sizeof(LightBlock) == 144, "Lights block does not match std140");
+
+// One buffer bound to a fixed binding point, with a CPU copy of its contents
+template <typename T>
+class UniformBlock
+{
+public:
+    explicit UniformBlock(GLuint binding)
+        : binding(binding), data(), dirty(true), uploads(0)
+    {
+        glGenBuffers(1, &this->UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->UBO);
+    }
+
+    ~UniformBlock()
+    {
+        glDeleteBuffers(1, &this->UBO);
+    }
+
+    UniformBlock(const UniformBlock&) = delete;
+    UniformBlock& operator=(const UniformBlock&) = delete;
+
+    // Points the program's block at this binding; programs that do not use it are skipped
+    void Attach(GLuint program, const char* blockName) const
+    {
+        GLuint index = glGetUniformBlockIndex(program, blockName);
+        if (index == GL_INVALID_INDEX)
+            return;
+
+        GLint size = 0;
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size != (GLint)sizeof(T))
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK " << blockName << " is " << size
+                << " bytes, expected " << sizeof(T) << std::endl;
+        glUniformBlockBinding(program, index, this->binding);
+    }
+
+    const T& Data() const { return this->data; }
+
+    // Marks the block for upload; callers only edit when something changed
+    T& Edit()
+    {
+        this->dirty = true;
+        return this->data;
+    }
+
+    // Returns true when the buffer was rewritten
+    bool Upload()
+    {
+        if (!this->dirty)
+            return false;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &this->data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        this->dirty = false;
+        this->uploads++;
+        return true;
+    }
+
+    unsigned int Uploads() const { return this->uploads; }
+
+private:
+    GLuint UBO;
+    GLuint binding;
+    T data;
+    bool dirty;
+    unsigned int uploads;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+// GPU vertex layouts
+// Unless the build defines FULL_VERTICES, vertices reach the GPU in 16 bytes (see
+// VertexPacking.h) instead of the 32 of CacheVertex:
+//   position   3 x unorm16 over the buffer's bounding box (+ 2 bytes padding)
+//   normal     2 x snorm16, octahedral
+//   texCoords  2 x unorm16 over the buffer's UV range; the SketchUp maps reach |12|,
+//              where half floats would only resolve 1/128 of the texture
+// Models come packed from the .mcache and are uploaded as-is; the static batch packs
+// its own world-space vertices. lighting.vs undoes the mapping with the VertexFormat's
+// decode uniforms. Indices are local to their mesh (draws add baseVertex), so they drop
+// to 16 bits whenever every mesh has at most 65536 vertices.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GLEW for OpenGL function loading
+#include <GL/glew.h>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+#include "ShaderUniforms.h"
+#include "ModelCache.h"
+#include "VertexPacking.h"
+
+#if defined(FULL_VERTICES)
+const bool PACKED_VERTICES = false;
+#else
+const bool PACKED_VERTICES = true;
+#endif
+
+// How a buffer's vertices and indices are stored, and the shader's decode constants
+struct VertexFormat
+{
+    bool packed;
+    VertexPacking decode;
+    GLenum indexType;
+    GLuint indexSize;
+
+    VertexFormat()
+        : packed(false), indexType(GL_UNSIGNED_INT), indexSize(sizeof(GLuint))
+    {
+    }
+
+    // Fills the bound VBO/EBO from a model's cache image, which already holds the packed
+    // vertices and 16-bit indices, and sets the attributes of the bound VAO
+    void Upload(const ModelData& data)
+    {
+        size_t vertexCount = data.header->vertexCount;
+        size_t indexCount = data.header->indexCount;
+        this->packed = PACKED_VERTICES;
+        if (this->packed) {
+            this->decode.positionOffset = data.header->positionOffset;
+            this->decode.positionScale = data.header->positionScale;
+            this->decode.texCoordDecode = data.header->texCoordDecode;
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), data.packedVertices, GL_STATIC_DRAW);
+            this->packedAttributes();
+        }
+        else {
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(CacheVertex), data.vertices, GL_STATIC_DRAW);
+            this->fullAttributes();
+        }
+
+        if (this->packed && data.shortIndices)
+            this->shortIndices(data.shortIndices, indexCount);
+        else
+            this->fullIndices(data.indices, indexCount);
+    }
+
+    // Same for vertices built at run time (the static batch), packing them here
+    void Upload(const CacheVertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+    {
+        this->packed = PACKED_VERTICES;
+        if (this->packed) {
+            this->decode.Fit(vertices, vertexCount);
+            std::vector<PackedVertex> packedVertices(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++)
+                packedVertices[i] = this->decode.Pack(vertices[i]);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+            this->packedAttributes();
+        }
+        else {
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(CacheVertex), vertices, GL_STATIC_DRAW);
+            this->fullAttributes();
+        }
+
+        uint32_t largestIndex = 0;
+        for (size_t i = 0; i < indexCount; i++)
+            largestIndex = std::max(largestIndex, indices[i]);
+        if (this->packed && largestIndex <= 0xFFFF) {
+            std::vector<uint16_t> shortList(indices, indices + indexCount);
+            this->shortIndices(shortList.data(), indexCount);
+        }
+        else {
+            this->fullIndices(indices, indexCount);
+        }
+    }
+
+private:
+    void packedAttributes() const
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, texCoords));
+    }
+
+    void fullAttributes() const
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)offsetof(CacheVertex, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)offsetof(CacheVertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(CacheVertex), (GLvoid*)offsetof(CacheVertex, TexCoords));
+    }
+
+    void shortIndices(const uint16_t* indices, size_t indexCount)
+    {
+        this->indexType = GL_UNSIGNED_SHORT;
+        this->indexSize = sizeof(uint16_t);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+    }
+
+    void fullIndices(const uint32_t* indices, size_t indexCount)
+    {
+        this->indexType = GL_UNSIGNED_INT;
+        this->indexSize = sizeof(GLuint);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+    }
+};
+
+// Decode uniforms of lighting.vs, resolved once per program
+struct VertexFormatUniforms
+{
+    Uniform<glm::vec3> positionOffset;
+    Uniform<glm::vec3> positionScale;
+    Uniform<glm::vec4> texCoordDecode;
+    Uniform<int> octahedralNormals;
+
+    explicit VertexFormatUniforms(const ShaderUniforms& uniforms)
+        : positionOffset(uniforms.Get<glm::vec3>("positionOffset")),
+        positionScale(uniforms.Get<glm::vec3>("positionScale")),
+        texCoordDecode(uniforms.Get<glm::vec4>("texCoordDecode")),
+        octahedralNormals(uniforms.Get<int>("octahedralNormals"))
+    {
+    }
+
+    void Set(const VertexFormat& format) const
+    {
+        ShaderUniforms::Set(this->positionOffset, format.decode.positionOffset);
+        ShaderUniforms::Set(this->positionScale, format.decode.positionScale);
+        ShaderUniforms::Set(this->texCoordDecode, format.decode.texCoordDecode);
+        ShaderUniforms::Set(this->octahedralNormals, format.packed ? 1 : 0);
+    }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+// CPU side of the 16-byte vertex layout (see VertexFormat.h)
+// ModelCache packs every model once at import and stores the result, with its decode
+// parameters, next to the float vertices in the .mcache; StaticBatch packs its
+// world-space copy when it builds. Report() is the round-trip check of a fresh pack.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <iostream>
+
+// GLM for mathematics
+#include <glm/glm.hpp>
+
+struct PackedVertex
+{
+    uint16_t position[4];  // xyz, w unused
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+
+// Quantization ranges of one buffer; lighting.vs gets them as decode uniforms
+struct VertexPacking
+{
+    glm::vec3 positionOffset;  // position = offset + stored * scale
+    glm::vec3 positionScale;
+    glm::vec4 texCoordDecode;  // xy offset, zw scale
+
+    VertexPacking()
+        : positionOffset(0.0f), positionScale(1.0f), texCoordDecode(0.0f, 0.0f, 1.0f, 1.0f)
+    {
+    }
+
+    // Ranges over the bounds of a vertex array (anything with Position/Normal/TexCoords)
+    template <typename Vertex>
+    void Fit(const Vertex* vertices, size_t vertexCount)
+    {
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        glm::vec2 uvLow(FLT_MAX), uvHigh(-FLT_MAX);
+        for (size_t i = 0; i < vertexCount; i++) {
+            low = glm::min(low, vertices[i].Position);
+            high = glm::max(high, vertices[i].Position);
+            uvLow = glm::min(uvLow, vertices[i].TexCoords);
+            uvHigh = glm::max(uvHigh, vertices[i].TexCoords);
+        }
+        if (vertexCount == 0) {
+            low = high = glm::vec3(0.0f);
+            uvLow = uvHigh = glm::vec2(0.0f);
+        }
+        this->positionOffset = low;
+        this->positionScale = glm::max(high - low, glm::vec3(FLT_MIN));
+        this->texCoordDecode = glm::vec4(uvLow, glm::max(uvHigh - uvLow, glm::vec2(FLT_MIN)));
+    }
+
+    template <typename Vertex>
+    PackedVertex Pack(const Vertex& vertex) const
+    {
+        PackedVertex result;
+        glm::vec3 position = (vertex.Position - this->positionOffset) / this->positionScale;
+        for (int i = 0; i < 3; i++)
+            result.position[i] = unorm16(position[i]);
+        result.position[3] = 0;
+
+        glm::vec2 normal = OctahedralEncode(vertex.Normal);
+        result.normal[0] = snorm16(normal.x);
+        result.normal[1] = snorm16(normal.y);
+
+        glm::vec2 uv = (vertex.TexCoords - glm::vec2(this->texCoordDecode)) / glm::vec2(this->texCoordDecode.z, this->texCoordDecode.w);
+        result.texCoords[0] = unorm16(uv.x);
+        result.texCoords[1] = unorm16(uv.y);
+        return result;
+    }
+
+    // What the shader reconstructs from a packed vertex
+    template <typename Vertex>
+    Vertex Unpack(const PackedVertex& vertex) const
+    {
+        Vertex result;
+        for (int i = 0; i < 3; i++)
+            result.Position[i] = this->positionOffset[i] + vertex.position[i] / 65535.0f * this->positionScale[i];
+        result.Normal = OctahedralDecode(glm::vec2(std::max(vertex.normal[0] / 32767.0f, -1.0f), std::max(vertex.normal[1] / 32767.0f, -1.0f)));
+        result.TexCoords = glm::vec2(this->texCoordDecode.x + vertex.texCoords[0] / 65535.0f * this->texCoordDecode.z,
+            this->texCoordDecode.y + vertex.texCoords[1] / 65535.0f * this->texCoordDecode.w);
+        return result;
+    }
+
+    // Round-trip check: worst error of each attribute against the float source
+    template <typename Vertex>
+    void Report(const Vertex* vertices, const PackedVertex* packedVertices, size_t vertexCount, const std::string& name) const
+    {
+        float positionError = 0.0f, normalError = 0.0f, texCoordError = 0.0f;
+        for (size_t i = 0; i < vertexCount; i++) {
+            Vertex decoded = this->Unpack<Vertex>(packedVertices[i]);
+            positionError = std::max(positionError, glm::length(decoded.Position - vertices[i].Position));
+            float length = glm::length(vertices[i].Normal);
+            if (length > 0.0f) {
+                float cosine = glm::clamp(glm::dot(decoded.Normal, vertices[i].Normal / length), -1.0f, 1.0f);
+                normalError = std::max(normalError, glm::degrees(std::acos(cosine)));
+            }
+            texCoordError = std::max(texCoordError, glm::length(decoded.TexCoords - vertices[i].TexCoords));
+        }
+        std::cout << "Packed vertices: " << name << " " << vertexCount * sizeof(Vertex) / 1024 << " -> "
+            << vertexCount * sizeof(PackedVertex) / 1024 << " KB, max error " << positionError * 1000.0f << " mm, "
+            << normalError << " deg, " << texCoordError << " uv" << std::endl;
+        if (positionError > 1e-3f * glm::length(this->positionScale) || normalError > 0.1f || texCoordError > 1e-3f)
+            std::cout << "WARNING::VERTEXFORMAT:: " << name << " loses precision when packed" << std::endl;
+    }
+
+    // Unit vector to the [-1, 1] square: the octahedron |x|+|y|+|z| = 1, lower half folded out
+    static glm::vec2 OctahedralEncode(const glm::vec3& normal)
+    {
+        float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (sum <= 0.0f)
+            return glm::vec2(0.0f);
+        glm::vec2 p = glm::vec2(normal.x, normal.y) / sum;
+        if (normal.z < 0.0f)
+            p = glm::vec2((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+        return p;
+    }
+
+    // Same as decodeNormal in lighting.vs
+    static glm::vec3 OctahedralDecode(const glm::vec2& p)
+    {
+        glm::vec3 n(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+        float t = std::max(-n.z, 0.0f);
+        n.x += n.x >= 0.0f ? -t : t;
+        n.y += n.y >= 0.0f ? -t : t;
+        return glm::normalize(n);
+    }
+
+private:
+    static uint16_t unorm16(float value)
+    {
+        return (uint16_t)std::floor(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    static int16_t snorm16(float value)
+    {
+        return (int16_t)std::floor(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+    }
+};